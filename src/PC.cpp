@@ -1,5 +1,8 @@
 #include "PC.h"
 #include "cpu.h"
+#include "snapshot.h"
+#include <cstdlib>
+#include <vector>
 
 PC::PC()
 {
@@ -9,19 +12,82 @@ PC::~PC()
 {
     delete cpu;
 }
-void PC::init()
+bool PC::init()
 {
     cpu->init();
-    load_bios("rom/Apple2e.rom");
+    return load_bios("rom/Apple2e.rom");
 }
-void PC::load_bios(string path)
+// The enhanced IIe ROM ($FBC0 = $E0) needs a 65C02, every other ROM runs on
+// the NMOS core.
+bool PC::load_bios(string path)
 {
-    cpu->mem->set_bin(path, true);
+    if (!cpu->mem->set_bin(path, true))
+        return false;
+    cpu->variant = cpu->mem->ram[0xfbb3] == 0x06 && cpu->mem->ram[0xfbc0] == 0xe0 ? CPU_CMOS : CPU_NMOS;
+    return true;
 }
-void PC::load_prg(string path)
+bool PC::load_prg(string path)
 {
-    cpu->mem->set_bin(path, false);
+    if (!cpu->mem->set_bin(path, false))
+        return false;
     cpu->pc = cpu->mem->prg_offset;
+    return true;
+}
+// Brings the loaded bios and program to `frames` frames after power-on,
+// pressing the keys in `script` ("frame:ascii,..." e.g. "60:13,90:32") on
+// the way. Unless `dir` is empty the result is cached there under the bios,
+// program and script hash; later calls restore the mapped snapshot instead
+// of emulating.
+bool PC::warm_boot(string dir, size_t frames, string script, bool *hit)
+{
+    if (cpu->mem->bios_rom == nullptr || cpu->mem->prg_rom == nullptr) {
+        printf("warm boot: load the bios and program first\n");
+        return false;
+    }
+    std::vector<std::pair<size_t, uint8_t>> keys;
+    for (size_t pos = 0; pos < script.size();) {
+        size_t end   = script.find(',', pos);
+        string item  = script.substr(pos, end == string::npos ? string::npos : end - pos);
+        char  *rest  = nullptr;
+        char  *last  = nullptr;
+        size_t frame = strtoull(item.c_str(), &rest, 10);
+        size_t ascii = *rest == ':' ? strtoul(rest + 1, &last, 10) : 0;
+        if (rest == item.c_str() || *rest != ':' || last == rest + 1 || *last != 0 || ascii == 0 || ascii > 0x7f) {
+            printf("warm boot: bad script entry '%s'\n", item.c_str());
+            return false;
+        }
+        keys.push_back({frame, (uint8_t)ascii});
+        pos = end == string::npos ? script.size() : end + 1;
+    }
+
+    uint64_t key  = SnapshotCache::key(cpu->mem->bios_rom->hash, cpu->mem->prg_rom->hash, frames, script);
+    string   path = SnapshotCache::path(dir, key);
+    if (hit != nullptr)
+        *hit = false;
+
+    const Snapshot *cached = dir.empty() ? nullptr : SnapshotCache::open(path, key);
+    if (cached != nullptr) {
+        cached->restore(cpu);
+        if (hit != nullptr)
+            *hit = true;
+        return true;
+    }
+
+    for (size_t f = 0; f < frames; f++) {
+        for (auto &k : keys) {
+            if (k.first == f)
+                key_down(k.second);
+        }
+        cpu->run_frame();
+    }
+    if (dir.empty())
+        return true;
+
+    // a snapshot that cannot be written is reported, the machine is booted anyway
+    Snapshot *snap = Snapshot::take(cpu);
+    SnapshotCache::save(path, key, *snap);
+    delete snap;
+    return true;
 }
 void PC::start()
 {
@@ -33,3 +99,7 @@ void PC::tick()
         cpu->step();
     }
 }
+void PC::key_down(uint8_t ascii)
+{
+    cpu->mem->key_down(ascii);
+}
@@ -10,12 +10,14 @@ class PC {
     PC();
     ~PC();
 
-    void init();
-    void load_bios(string path);
-    void load_prg(string path);
+    bool init();
+    bool load_bios(string path);
+    bool load_prg(string path);
+    bool warm_boot(string dir, size_t frames, string script, bool *hit = nullptr);
 
     void start();
     void tick();
+    void key_down(uint8_t ascii);
 
   private:
 };
@@ -0,0 +1,197 @@
+#include "batch.h"
+#include <cstring>
+
+// the seven pixels of a hi-res byte, one 0/1 byte each (the eighth is spare)
+static struct PixelTable
+{
+    uint64_t bytes[128];
+    PixelTable()
+    {
+        for (int v = 0; v < 128; v++) {
+            bytes[v] = 0;
+            for (int k = 0; k < 7; k++)
+                bytes[v] |= (uint64_t)((v >> k) & 1) << (8 * k);
+        }
+    }
+} pixel_table;
+static const uint64_t *expand = pixel_table.bytes;
+
+BatchEnv::BatchEnv()
+{
+}
+BatchEnv::~BatchEnv()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    go.notify_all();
+    for (auto &w : workers)
+        w.join();
+    for (auto pc : envs)
+        delete pc;
+    delete snap;
+}
+bool BatchEnv::init(const BatchConfig &config)
+{
+    cfg = config;
+    if (cfg.count == 0 || cfg.frameskip == 0) {
+        printf("batch: count and frameskip must be at least 1\n");
+        return false;
+    }
+    if (cfg.ram_addr + cfg.ram_len > 0x10000) {
+        printf("batch: ram window $%04X+%zu is outside memory\n", cfg.ram_addr, cfg.ram_len);
+        return false;
+    }
+    if (cfg.scale > 0 && (280 % cfg.scale != 0 || 192 % cfg.scale != 0)) {
+        printf("batch: scale %zu does not divide 280x192\n", cfg.scale);
+        return false;
+    }
+    width  = cfg.scale > 0 ? 280 / cfg.scale : 0;
+    height = cfg.scale > 0 ? 192 / cfg.scale : 0;
+
+    PC *boot = new PC();
+    boot->cpu->init();
+    if (!boot->load_bios(cfg.bios) || !boot->load_prg(cfg.prg)) {
+        delete boot;
+        return false;
+    }
+    if (!boot->warm_boot(cfg.cache_dir, cfg.warmup, cfg.script)) {
+        delete boot;
+        return false;
+    }
+    snap = Snapshot::take(boot->cpu);
+
+    envs.push_back(boot);
+    for (size_t i = 1; i < cfg.count; i++) {
+        PC *pc = new PC();
+        pc->cpu->init();
+        if (!pc->load_bios(cfg.bios) || !pc->load_prg(cfg.prg)) {
+            delete pc;
+            return false;
+        }
+        envs.push_back(pc);
+    }
+    for (auto pc : envs) {
+        snap->restore(pc->cpu);
+        pc->start();
+    }
+
+    size_t threads = cfg.threads > 0 ? cfg.threads : std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+    if (threads > cfg.count)
+        threads = cfg.count;
+    cfg.threads = threads;
+    for (size_t t = 1; t < threads; t++)
+        workers.emplace_back(&BatchEnv::worker_loop, this, t);
+    return true;
+}
+size_t BatchEnv::ram_size()
+{
+    return cfg.count * cfg.ram_len;
+}
+size_t BatchEnv::frame_size()
+{
+    return cfg.count * width * height;
+}
+PC *BatchEnv::env(size_t i)
+{
+    return envs[i];
+}
+void BatchEnv::step(const uint8_t *actions, uint8_t *ram, uint8_t *frames)
+{
+    run(false, actions, nullptr, ram, frames);
+}
+void BatchEnv::reset(const uint8_t *mask, uint8_t *ram, uint8_t *frames)
+{
+    run(true, nullptr, mask, ram, frames);
+}
+void BatchEnv::run(bool reset, const uint8_t *actions, const uint8_t *mask, uint8_t *ram, uint8_t *frames)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        resetting     = reset;
+        this->actions = actions;
+        this->mask    = mask;
+        ram_out       = ram;
+        frame_out     = frames;
+        remaining     = workers.size();
+        generation++;
+    }
+    go.notify_all();
+    run_slice(0);
+
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this] { return remaining == 0; });
+}
+void BatchEnv::worker_loop(size_t slice)
+{
+    size_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            go.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        run_slice(slice);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            remaining--;
+        }
+        done.notify_one();
+    }
+}
+void BatchEnv::run_slice(size_t slice)
+{
+    size_t first = cfg.count * slice / cfg.threads;
+    size_t last  = cfg.count * (slice + 1) / cfg.threads;
+
+    for (size_t i = first; i < last; i++) {
+        Cpu *cpu = envs[i]->cpu;
+        if (resetting) {
+            if (mask != nullptr && !mask[i])
+                continue;
+            snap->restore(cpu);
+        } else {
+            if (actions != nullptr && actions[i] != 0)
+                envs[i]->key_down(actions[i]);
+            for (size_t f = 0; f < cfg.frameskip; f++)
+                cpu->run_frame();
+        }
+        observe(i);
+    }
+}
+void BatchEnv::observe(size_t i)
+{
+    Mem *mem = envs[i]->cpu->mem;
+    if (ram_out != nullptr && cfg.ram_len > 0)
+        memcpy(ram_out + i * cfg.ram_len, mem->ram + cfg.ram_addr, cfg.ram_len);
+    if (frame_out == nullptr || cfg.scale == 0)
+        return;
+
+    uint8_t *out   = frame_out + i * width * height;
+    size_t   base  = mem->display_page() ? 0x4000 : 0x2000;
+    size_t   cells = cfg.scale * cfg.scale;
+    uint8_t  pixels[280 + 1];
+    uint16_t sums[280];
+
+    for (size_t row = 0; row < height; row++) {
+        memset(sums, 0, sizeof(sums));
+        for (size_t sub = 0; sub < cfg.scale; sub++) {
+            const uint8_t *line = mem->ram + base + mem->scanline_to_offset[row * cfg.scale + sub];
+            for (size_t b = 0; b < 40; b++)
+                memcpy(pixels + b * 7, &expand[line[b] & 0x7f], 8);
+            for (size_t px = 0; px < 280; px++)
+                sums[px] += pixels[px];
+        }
+        for (size_t col = 0; col < width; col++) {
+            uint16_t lit = 0;
+            for (size_t k = 0; k < cfg.scale; k++)
+                lit += sums[col * cfg.scale + k];
+            out[row * width + col] = lit * 255 / cells;
+        }
+    }
+}
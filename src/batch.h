@@ -0,0 +1,80 @@
+#ifndef _H_BATCH
+#define _H_BATCH
+#include "PC.h"
+#include "snapshot.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+struct BatchConfig
+{
+    string   bios      = "rom/Apple2e.rom";
+    string   prg       = "";
+    size_t   count     = 1;
+    size_t   threads   = 0;    // 0 = one per hardware thread
+    size_t   frameskip = 1;
+    size_t   warmup    = 0;    // frames run before the reset snapshot is taken
+    string   script    = "";   // keys pressed during warmup, see PC::warm_boot
+    string   cache_dir = "";   // keep the warmed-up snapshot here across runs
+    uint16_t ram_addr  = 0;
+    size_t   ram_len   = 0x100;
+    size_t   scale     = 2;    // hi-res observation is 280/scale x 192/scale, 0 = none
+};
+
+// Many independent machines stepped together for training loops. An action
+// is the ASCII code of a key to press (0 = none) and is held for `frameskip`
+// frames; afterwards every machine writes `ram_len` RAM bytes and a
+// downsampled hi-res frame (0-255 per cell, share of lit pixels) into the
+// caller's arrays, laid out as [count][ram_len] and [count][height][width].
+// Machines are split into fixed slices over a persistent pool of worker
+// threads, nothing is allocated per step.
+class BatchEnv {
+  public:
+    BatchConfig cfg;
+    size_t      width  = 0;
+    size_t      height = 0;
+
+  private:
+    vector<PC *>   envs;
+    Snapshot      *snap = nullptr;
+    vector<thread> workers;
+
+    mutex              lock;
+    condition_variable go;
+    condition_variable done;
+    size_t             generation = 0;
+    size_t             remaining  = 0;
+    bool               stopping   = false;
+
+    bool           resetting = false;
+    const uint8_t *actions   = nullptr;
+    const uint8_t *mask      = nullptr;
+    uint8_t       *ram_out   = nullptr;
+    uint8_t       *frame_out = nullptr;
+
+  public:
+    BatchEnv();
+    ~BatchEnv();
+
+    bool   init(const BatchConfig &config);
+    size_t ram_size();
+    size_t frame_size();
+
+    void step(const uint8_t *actions, uint8_t *ram, uint8_t *frames);
+    void reset(const uint8_t *mask, uint8_t *ram, uint8_t *frames);
+
+    PC *env(size_t i);
+
+  private:
+    void run(bool reset, const uint8_t *actions, const uint8_t *mask, uint8_t *ram, uint8_t *frames);
+    void run_slice(size_t slice);
+    void worker_loop(size_t slice);
+    void observe(size_t i);
+};
+#endif
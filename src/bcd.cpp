@@ -0,0 +1,60 @@
+#include "bcd.h"
+
+BcdResult Bcd::adc_table[2][256][256];
+BcdResult Bcd::sbc_table[2][256][256];
+
+static BcdResult decimal_adc(int a, int b, int c)
+{
+    int al = (a & 0x0f) + (b & 0x0f) + c;
+    if (al >= 0x0a)
+        al = ((al + 0x06) & 0x0f) + 0x10;
+
+    int sum        = (a & 0xf0) + (b & 0xf0) + al;
+    int signed_sum = (int8_t)(a & 0xf0) + (int8_t)(b & 0xf0) + al;
+    if (sum >= 0xa0)
+        sum += 0x60;
+
+    uint8_t flags = 0;
+    flags |= (signed_sum & 0x80) ? BCD_N : 0;
+    flags |= (signed_sum < -128 || signed_sum > 127) ? BCD_V : 0;
+    flags |= ((a + b + c) & 0xff) == 0 ? BCD_Z : 0;
+    flags |= sum >= 0x100 ? BCD_C : 0;
+    return BcdResult{(uint8_t)sum, flags};
+}
+static BcdResult decimal_sbc(int a, int b, int c)
+{
+    int al = (a & 0x0f) - (b & 0x0f) + c - 1;
+    if (al < 0)
+        al = ((al - 0x06) & 0x0f) - 0x10;
+
+    int diff = (a & 0xf0) - (b & 0xf0) + al;
+    if (diff < 0)
+        diff -= 0x60;
+
+    int     bin   = a + (b ^ 0xff) + c;
+    uint8_t flags = 0;
+    flags |= (bin & 0x80) ? BCD_N : 0;
+    flags |= ((a ^ bin) & ((b ^ 0xff) ^ bin) & 0x80) ? BCD_V : 0;
+    flags |= (bin & 0xff) == 0 ? BCD_Z : 0;
+    flags |= bin > 0xff ? BCD_C : 0;
+    return BcdResult{(uint8_t)diff, flags};
+}
+void Bcd::init()
+{
+    for (int c = 0; c < 2; c++) {
+        for (int a = 0; a < 256; a++) {
+            for (int b = 0; b < 256; b++) {
+                adc_table[c][a][b] = decimal_adc(a, b, c);
+                sbc_table[c][a][b] = decimal_sbc(a, b, c);
+            }
+        }
+    }
+}
+
+static struct BcdInit
+{
+    BcdInit()
+    {
+        Bcd::init();
+    }
+} bcd_init;
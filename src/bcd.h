@@ -0,0 +1,38 @@
+#ifndef _H_BCD
+#define _H_BCD
+#include <cstdint>
+
+#define BCD_N 0x80
+#define BCD_V 0x40
+#define BCD_Z 0x02
+#define BCD_C 0x01
+
+struct BcdResult
+{
+    uint8_t value;
+    uint8_t flags;
+};
+
+// NMOS 6502 decimal mode ADC/SBC results for every carry, A and operand,
+// filled once at startup so that decimal arithmetic is a single lookup.
+// N, V and Z follow the NMOS quirks: ADC derives N and V from the
+// intermediate sum before the high nibble is adjusted and Z from the binary
+// sum, SBC sets all flags exactly like binary SBC.
+class Bcd {
+  public:
+    static BcdResult adc_table[2][256][256];
+    static BcdResult sbc_table[2][256][256];
+
+  public:
+    static void init();
+
+    static inline const BcdResult &adc(uint8_t a, uint8_t value, bool carry)
+    {
+        return adc_table[carry][a][value];
+    }
+    static inline const BcdResult &sbc(uint8_t a, uint8_t value, bool carry)
+    {
+        return sbc_table[carry][a][value];
+    }
+};
+#endif
@@ -0,0 +1,333 @@
+#include "capture.h"
+#include <cstring>
+
+#define Y4M_PLANE  (CAPTURE_WIDTH * CAPTURE_ROWS)
+#define Y4M_FRAME  (Y4M_PLANE + Y4M_PLANE / 2)
+#define FRAME_SIZE (CAPTURE_ROWS * CAPTURE_ROW_BYTES)
+#define PACK_MAX   (FRAME_SIZE + FRAME_SIZE / 128 + 8)
+
+Capture::Capture(string path, CaptureFormat format, size_t slots)
+{
+    this->format = format;
+    this->slots  = slots < 2 ? 2 : slots;
+    ring         = new CaptureFrame[this->slots];
+    if (format == CAPTURE_Y4M)
+        plane = new uint8_t[Y4M_FRAME];
+    else
+        packed = new uint8_t[PACK_MAX];
+
+    out = fopen(path.c_str(), "wb");
+    if (out == nullptr) {
+        printf("capture: cannot write %s\n", path.c_str());
+        return;
+    }
+    if (format == CAPTURE_Y4M) {
+        write_y4m_header(out);
+    } else {
+        CaptureHeader hdr{CAPTURE_MAGIC, CAPTURE_VERSION, CAPTURE_WIDTH, CAPTURE_ROWS, 60, CAPTURE_ROW_BYTES, 0, 0};
+        fwrite(&hdr, sizeof(hdr), 1, out);
+    }
+    encoder = std::thread(&Capture::encoder_loop, this);
+}
+Capture::~Capture()
+{
+    close();
+    delete[] ring;
+    delete[] plane;
+    delete[] packed;
+}
+bool Capture::ok()
+{
+    return out != nullptr;
+}
+// Hi-res and 40-column text both hold 7 dots a byte with bit 0 leftmost, so
+// either fills a frame row as is. Lo-res, 80 columns and double hi-res do not
+// fit 280 one-bit dots; their rows are recorded blank.
+static const char *unsupported(uint32_t mode)
+{
+    if (!(mode & SW_TEXT) && !(mode & SW_HIRES))
+        return "lo-res";
+    if (!(mode & SW_TEXT) && (mode & SW_DHIRES) && (mode & SW_80COL))
+        return "double hi-res";
+    if ((mode & (SW_TEXT | SW_MIXED)) && (mode & SW_80COL))
+        return "80-column text";
+    return nullptr;
+}
+static void screen_row(Mem *mem, uint32_t mode, int y, uint8_t *dst)
+{
+    int  page = mode >> 8;
+    bool text = (mode & SW_TEXT) || ((mode & SW_MIXED) && y >= 160);
+    if (text && !(mode & SW_80COL)) {
+        const uint8_t *src = mem->ram + (page ? 0x800 : 0x400) + mem->text_row_to_offset[y / 8];
+        for (int x = 0; x < CAPTURE_ROW_BYTES; x++)
+            dst[x] = mem->text_glyph[src[x]][y & 7];
+    } else if (!text && (mode & SW_HIRES) && !((mode & SW_DHIRES) && (mode & SW_80COL))) {
+        memcpy(dst, mem->ram + (page ? 0x4000 : 0x2000) + mem->scanline_to_offset[y], CAPTURE_ROW_BYTES);
+    } else {
+        memset(dst, 0, CAPTURE_ROW_BYTES);
+    }
+}
+void Capture::frame(Mem *mem)
+{
+    if (out == nullptr)
+        return;
+    frames++;
+    uint32_t    mode = mem->display_mode();
+    const char *what = unsupported(mode);
+    if (what != nullptr)
+        blanked++;
+    if (mem->video_writes == last_writes && mode == last_mode && stored > 0) {
+        pending++;
+        return;
+    }
+    if (what != nullptr && mode != last_mode)
+        printf("capture: frame %zu is %s, which does not fit 280x192 one-bit frames; recording it blank\n",
+               frames - 1, what);
+    last_writes = mem->video_writes;
+    last_mode   = mode;
+
+    bool    same = stored > 0;
+    uint8_t row[CAPTURE_ROW_BYTES];
+    for (int y = 0; y < CAPTURE_ROWS; y++) {
+        screen_row(mem, mode, y, row);
+        if (memcmp(last[y], row, CAPTURE_ROW_BYTES) != 0) {
+            memcpy(last[y], row, CAPTURE_ROW_BYTES);
+            same = false;
+        }
+    }
+    if (same) {
+        pending++;
+        return;
+    }
+
+    if (head >= written.load(std::memory_order_acquire) + slots) {
+        stalls++;
+        std::unique_lock<std::mutex> lk(lock);
+        drained.wait(lk, [this] { return written.load() + slots > head; });
+    }
+    CaptureFrame &f = ring[head % slots];
+    f.repeats       = pending;
+    memcpy(f.rows, last, sizeof(last));
+    pending = 0;
+    stored++;
+    head++;
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        filled.store(head, std::memory_order_release);
+    }
+    ready.notify_one();
+}
+void Capture::encoder_loop()
+{
+    for (;;) {
+        size_t done = written.load();
+        {
+            std::unique_lock<std::mutex> lk(lock);
+            ready.wait(lk, [this, done] { return filled.load() > done || stopping.load(); });
+        }
+        size_t end = filled.load(std::memory_order_acquire);
+        if (end == done)
+            return;
+
+        for (size_t pos = done; pos < end; pos++) {
+            encode(ring[pos % slots]);
+            written.store(pos + 1, std::memory_order_release);
+            std::lock_guard<std::mutex> lk(lock);
+            drained.notify_one();
+        }
+    }
+}
+void Capture::encode(const CaptureFrame &f)
+{
+    if (format == CAPTURE_Y4M) {
+        write_y4m(out, prev, f.repeats, plane);
+        write_y4m(out, f.rows, 1, plane);
+        memcpy(prev, f.rows, sizeof(prev));
+        return;
+    }
+    if (f.repeats > 0) {
+        CaptureRecord r{CAP_REPEAT, {}, f.repeats};
+        fwrite(&r, sizeof(r), 1, out);
+    }
+    uint8_t mask[CAPTURE_ROWS / 8]{};
+    uint8_t rows[FRAME_SIZE];
+    size_t  n = 0;
+    for (int y = 0; y < CAPTURE_ROWS; y++) {
+        if (memcmp(f.rows[y], prev[y], CAPTURE_ROW_BYTES) == 0)
+            continue;
+        mask[y >> 3] |= 1 << (y & 7);
+        memcpy(rows + n, f.rows[y], CAPTURE_ROW_BYTES);
+        n += CAPTURE_ROW_BYTES;
+    }
+    CaptureRecord r{CAP_DELTA, {}, (uint32_t)pack(rows, n, packed)};
+    fwrite(&r, sizeof(r), 1, out);
+    fwrite(mask, sizeof(mask), 1, out);
+    fwrite(packed, 1, r.count, out);
+    memcpy(prev, f.rows, sizeof(prev));
+}
+void Capture::close()
+{
+    if (out == nullptr)
+        return;
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        stopping = true;
+    }
+    ready.notify_one();
+    encoder.join();
+
+    if (pending > 0) {
+        if (format == CAPTURE_Y4M) {
+            write_y4m(out, prev, pending, plane);
+        } else {
+            CaptureRecord r{CAP_REPEAT, {}, pending};
+            fwrite(&r, sizeof(r), 1, out);
+        }
+        pending = 0;
+    }
+    if (format == CAPTURE_A2V) {
+        CaptureHeader hdr{CAPTURE_MAGIC, CAPTURE_VERSION, CAPTURE_WIDTH,   CAPTURE_ROWS,
+                          60,            CAPTURE_ROW_BYTES, (uint32_t)frames, 0};
+        bytes = ftell(out);
+        fseek(out, 0, SEEK_SET);
+        fwrite(&hdr, sizeof(hdr), 1, out);
+    } else {
+        bytes = ftell(out);
+    }
+    fclose(out);
+    out = nullptr;
+}
+void Capture::write_y4m_header(FILE *f)
+{
+    fprintf(f, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", CAPTURE_WIDTH, CAPTURE_ROWS);
+}
+// One dot per bit, bit 0 leftmost, lit dots white; chroma is flat grey.
+void Capture::write_y4m(FILE *f, const uint8_t (*rows)[CAPTURE_ROW_BYTES], uint32_t count, uint8_t *plane)
+{
+    if (count == 0)
+        return;
+    uint8_t *dst = plane;
+    for (int y = 0; y < CAPTURE_ROWS; y++) {
+        for (int x = 0; x < CAPTURE_ROW_BYTES; x++) {
+            uint8_t c = rows[y][x];
+            for (int i = 0; i < 7; i++)
+                *dst++ = ((c >> i) & 1) ? 0xff : 0x00;
+        }
+    }
+    memset(plane + Y4M_PLANE, 0x80, Y4M_PLANE / 2);
+    for (uint32_t i = 0; i < count; i++) {
+        fputs("FRAME\n", f);
+        fwrite(plane, 1, Y4M_FRAME, f);
+    }
+}
+// PackBits: n < 128 is followed by n + 1 literal bytes, n > 128 by one byte
+// repeated 257 - n times. Runs shorter than three stay in the literals, so
+// the output is at most one byte per 128 longer than the input.
+size_t Capture::pack(const uint8_t *src, size_t len, uint8_t *dst)
+{
+    size_t n = 0;
+    size_t i = 0;
+    while (i < len) {
+        size_t run = 1;
+        while (i + run < len && run < 128 && src[i + run] == src[i])
+            run++;
+        if (run >= 3) {
+            dst[n++] = 257 - run;
+            dst[n++] = src[i];
+            i += run;
+            continue;
+        }
+        size_t start = i;
+        while (i < len && i - start < 128 && !(i + 2 < len && src[i] == src[i + 1] && src[i] == src[i + 2]))
+            i++;
+        dst[n++] = i - start - 1;
+        memcpy(dst + n, src + start, i - start);
+        n += i - start;
+    }
+    return n;
+}
+bool Capture::unpack(const uint8_t *src, size_t len, uint8_t *dst, size_t max)
+{
+    size_t n = 0;
+    size_t i = 0;
+    while (i < len) {
+        uint8_t c = src[i++];
+        if (c < 128) {
+            if (i + c + 1 > len || n + c + 1 > max)
+                return false;
+            memcpy(dst + n, src + i, c + 1);
+            i += c + 1;
+            n += c + 1;
+        } else if (c > 128) {
+            if (i >= len || n + 257 - c > max)
+                return false;
+            memset(dst + n, src[i++], 257 - c);
+            n += 257 - c;
+        }
+    }
+    return n == max;
+}
+bool Capture::to_y4m(string in, string out)
+{
+    FILE *f = fopen(in.c_str(), "rb");
+    if (f == nullptr) {
+        printf("capture: cannot open %s\n", in.c_str());
+        return false;
+    }
+    CaptureHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != CAPTURE_MAGIC || hdr.version != CAPTURE_VERSION ||
+        hdr.width != CAPTURE_WIDTH || hdr.height != CAPTURE_ROWS || hdr.row_bytes != CAPTURE_ROW_BYTES) {
+        printf("capture: %s is not a capture file\n", in.c_str());
+        fclose(f);
+        return false;
+    }
+    FILE *o = fopen(out.c_str(), "wb");
+    if (o == nullptr) {
+        printf("capture: cannot write %s\n", out.c_str());
+        fclose(f);
+        return false;
+    }
+    write_y4m_header(o);
+
+    uint8_t  frame[CAPTURE_ROWS][CAPTURE_ROW_BYTES]{};
+    uint8_t  rows[FRAME_SIZE];
+    uint8_t *src    = new uint8_t[PACK_MAX];
+    uint8_t *plane  = new uint8_t[Y4M_FRAME];
+    size_t   frames = 0;
+    bool     ok     = true;
+
+    CaptureRecord r;
+    while (ok && fread(&r, sizeof(r), 1, f) == 1) {
+        if (r.kind == CAP_REPEAT) {
+            write_y4m(o, frame, r.count, plane);
+            frames += r.count;
+            continue;
+        }
+        uint8_t mask[CAPTURE_ROWS / 8];
+        size_t  changed = 0;
+        ok              = r.kind == CAP_DELTA && r.count <= PACK_MAX && fread(mask, sizeof(mask), 1, f) == 1 &&
+             fread(src, 1, r.count, f) == r.count;
+        for (int y = 0; ok && y < CAPTURE_ROWS; y++)
+            changed += (mask[y >> 3] >> (y & 7)) & 1;
+        ok = ok && unpack(src, r.count, rows, changed * CAPTURE_ROW_BYTES);
+        if (!ok)
+            break;
+        for (int y = 0, n = 0; y < CAPTURE_ROWS; y++) {
+            if ((mask[y >> 3] >> (y & 7)) & 1) {
+                memcpy(frame[y], rows + n, CAPTURE_ROW_BYTES);
+                n += CAPTURE_ROW_BYTES;
+            }
+        }
+        write_y4m(o, frame, 1, plane);
+        frames++;
+    }
+    if (!ok || frames != hdr.frames) {
+        printf("capture: %s is truncated after %zu of %u frames\n", in.c_str(), frames, hdr.frames);
+        ok = false;
+    }
+    delete[] src;
+    delete[] plane;
+    fclose(o);
+    fclose(f);
+    return ok;
+}
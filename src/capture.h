@@ -0,0 +1,126 @@
+#ifndef _H_CAPTURE
+#define _H_CAPTURE
+#include "mem.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+#define CAPTURE_MAGIC   0x31563241    // "A2V1"
+#define CAPTURE_VERSION 1
+
+#define CAPTURE_ROWS      192
+#define CAPTURE_ROW_BYTES 40
+#define CAPTURE_WIDTH     (CAPTURE_ROW_BYTES * 7)
+
+enum CaptureFormat
+{
+    CAPTURE_A2V,
+    CAPTURE_Y4M
+};
+
+enum CaptureKind
+{
+    CAP_REPEAT = 1,
+    CAP_DELTA  = 2
+};
+
+struct CaptureHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint16_t width;
+    uint16_t height;
+    uint16_t fps;
+    uint16_t row_bytes;
+    uint32_t frames;
+    uint32_t reserved;
+};
+
+// CAP_REPEAT: the previous frame is shown `count` more times.
+// CAP_DELTA: a 24-byte mask of changed rows follows, then `count` bytes of
+// PackBits data that unpack to 40 hi-res bytes per changed row.
+struct CaptureRecord
+{
+    uint8_t  kind;
+    uint8_t  pad[3];
+    uint32_t count;
+};
+
+// One frame as it leaves the emulator: 40 bytes of 7 dots per scanline,
+// plus how often the frame before it repeated.
+struct CaptureFrame
+{
+    uint32_t repeats;
+    uint8_t  rows[CAPTURE_ROWS][CAPTURE_ROW_BYTES];
+};
+
+// Records the displayed screen once per frame. The screen is monochrome, one
+// bit per dot with bit 7 ignored, so the hi-res bytes, or the glyph rows of
+// 40-column text, are the frame; nothing is taken from the ARGB image. Frames
+// in lo-res, 80-column or double hi-res modes are recorded blank, counted in
+// blanked and reported when the mode is entered. A frame with no video writes
+// or mode change since the last one costs one compare, a frame whose pixels
+// did not change costs a pass over the screen, and only changed frames are
+// copied into a bounded ring drained by an encoder thread. The encoder
+// writes either a delta file (changed rows, PackBits) or 280x192 grey Y4M,
+// and frame() only blocks when it falls a whole ring behind.
+class Capture {
+  public:
+    size_t frames  = 0;
+    size_t stored  = 0;
+    size_t stalls  = 0;
+    size_t bytes   = 0;
+    size_t blanked = 0;    // frames in a mode that cannot be recorded
+
+  private:
+    CaptureFormat format;
+    FILE         *out   = nullptr;
+    CaptureFrame *ring  = nullptr;
+    size_t        slots = 0;
+    size_t        head  = 0;
+
+    uint8_t  last[CAPTURE_ROWS][CAPTURE_ROW_BYTES]{};
+    size_t   last_writes = SIZE_MAX;
+    uint32_t last_mode   = UINT32_MAX;
+    uint32_t pending     = 0;
+
+    uint8_t  prev[CAPTURE_ROWS][CAPTURE_ROW_BYTES]{};
+    uint8_t *plane  = nullptr;
+    uint8_t *packed = nullptr;
+
+    std::atomic<size_t>     filled{0};
+    std::atomic<size_t>     written{0};
+    std::atomic<bool>       stopping{false};
+    std::mutex              lock;
+    std::condition_variable ready;
+    std::condition_variable drained;
+    std::thread             encoder;
+
+  public:
+    Capture(string path, CaptureFormat format, size_t slots = 64);
+    ~Capture();
+
+    bool ok();
+    void frame(Mem *mem);
+    void close();
+
+    static bool to_y4m(string in, string out);
+
+  private:
+    void encoder_loop();
+    void encode(const CaptureFrame &f);
+
+    static void   write_y4m_header(FILE *f);
+    static void   write_y4m(FILE *f, const uint8_t (*rows)[CAPTURE_ROW_BYTES], uint32_t count, uint8_t *plane);
+
+    static size_t pack(const uint8_t *src, size_t len, uint8_t *dst);
+    static bool   unpack(const uint8_t *src, size_t len, uint8_t *dst, size_t max);
+};
+#endif
@@ -1,17 +1,545 @@
 #include "cpu.h"
 #include "cpu_enum.h"
+#include "bcd.h"
 #include "mem.h"
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
+
+const Opcode Cpu::opcodes[258] = {
+    {BRK, 0, "0", "BRK", IMP, 7},
+    {ORA, 1, "1", "ORA", IZX, 6},
+    {KIL, 2, "2", "KIL", IMP, 2},
+    {SLO, 3, "3", "SLO", IZX, 8},
+    {NOP, 4, "4", "NOP", ZP, 3},
+    {ORA, 5, "5", "ORA", ZP, 3},
+    {ASL, 6, "6", "ASL", ZP, 5},
+    {SLO, 7, "7", "SLO", ZP, 5},
+    {PHP, 8, "8", "PHP", IMP, 3},
+    {ORA, 9, "9", "ORA", IMM, 2},
+    {ASLA, 10, "a", "ASLA", IMP, 2},
+    {ANC, 11, "b", "ANC", IMM, 2},
+    {NOP, 12, "c", "NOP", ABS, 4},
+    {ORA, 13, "d", "ORA", ABS, 4},
+    {ASL, 14, "e", "ASL", ABS, 6},
+    {SLO, 15, "f", "SLO", ABS, 6},
+    {BPL, 16, "10", "BPL", REL, 2},
+    {ORA, 17, "11", "ORA", IZYr, 5},
+    {KIL, 18, "12", "KIL", IMP, 2},
+    {SLO, 19, "13", "SLO", IZY, 8},
+    {NOP, 20, "14", "NOP", ZPX, 4},
+    {ORA, 21, "15", "ORA", ZPX, 4},
+    {ASL, 22, "16", "ASL", ZPX, 6},
+    {SLO, 23, "17", "SLO", ZPX, 6},
+    {CLC, 24, "18", "CLC", IMP, 2},
+    {ORA, 25, "19", "ORA", ABYr, 4},
+    {NOP, 26, "1a", "NOP", IMP, 2},
+    {SLO, 27, "1b", "SLO", ABY, 7},
+    {NOP, 28, "1c", "NOP", ABXr, 4},
+    {ORA, 29, "1d", "ORA", ABXr, 4},
+    {ASL, 30, "1e", "ASL", ABX, 7},
+    {SLO, 31, "1f", "SLO", ABX, 7},
+    {JSR, 32, "20", "JSR", ABS, 6},
+    {AND, 33, "21", "AND", IZX, 6},
+    {KIL, 34, "22", "KIL", IMP, 2},
+    {RLA, 35, "23", "RLA", IZX, 8},
+    {BIT, 36, "24", "BIT", ZP, 3},
+    {AND, 37, "25", "AND", ZP, 3},
+    {ROL, 38, "26", "ROL", ZP, 5},
+    {RLA, 39, "27", "RLA", ZP, 5},
+    {PLP, 40, "28", "PLP", IMP, 4},
+    {AND, 41, "29", "AND", IMM, 2},
+    {ROLA, 42, "2a", "ROLA", IMP, 2},
+    {ANC, 43, "2b", "ANC", IMM, 2},
+    {BIT, 44, "2c", "BIT", ABS, 4},
+    {AND, 45, "2d", "AND", ABS, 4},
+    {ROL, 46, "2e", "ROL", ABS, 6},
+    {RLA, 47, "2f", "RLA", ABS, 6},
+    {BMI, 48, "30", "BMI", REL, 2},
+    {AND, 49, "31", "AND", IZYr, 5},
+    {KIL, 50, "32", "KIL", IMP, 2},
+    {RLA, 51, "33", "RLA", IZY, 8},
+    {NOP, 52, "34", "NOP", ZPX, 4},
+    {AND, 53, "35", "AND", ZPX, 4},
+    {ROL, 54, "36", "ROL", ZPX, 6},
+    {RLA, 55, "37", "RLA", ZPX, 6},
+    {SEC, 56, "38", "SEC", IMP, 2},
+    {AND, 57, "39", "AND", ABYr, 4},
+    {NOP, 58, "3a", "NOP", IMP, 2},
+    {RLA, 59, "3b", "RLA", ABY, 7},
+    {NOP, 60, "3c", "NOP", ABXr, 4},
+    {AND, 61, "3d", "AND", ABXr, 4},
+    {ROL, 62, "3e", "ROL", ABX, 7},
+    {RLA, 63, "3f", "RLA", ABX, 7},
+    {RTI, 64, "40", "RTI", IMP, 6},
+    {EOR, 65, "41", "EOR", IZX, 6},
+    {KIL, 66, "42", "KIL", IMP, 2},
+    {SRE, 67, "43", "SRE", IZX, 8},
+    {NOP, 68, "44", "NOP", ZP, 3},
+    {EOR, 69, "45", "EOR", ZP, 3},
+    {LSR, 70, "46", "LSR", ZP, 5},
+    {SRE, 71, "47", "SRE", ZP, 5},
+    {PHA, 72, "48", "PHA", IMP, 3},
+    {EOR, 73, "49", "EOR", IMM, 2},
+    {LSRA, 74, "4a", "LSRA", IMP, 2},
+    {ALR, 75, "4b", "ALR", IMM, 2},
+    {JMP, 76, "4c", "JMP", ABS, 3},
+    {EOR, 77, "4d", "EOR", ABS, 4},
+    {LSR, 78, "4e", "LSR", ABS, 6},
+    {SRE, 79, "4f", "SRE", ABS, 6},
+    {BVC, 80, "50", "BVC", REL, 2},
+    {EOR, 81, "51", "EOR", IZYr, 5},
+    {KIL, 82, "52", "KIL", IMP, 2},
+    {SRE, 83, "53", "SRE", IZY, 8},
+    {NOP, 84, "54", "NOP", ZPX, 4},
+    {EOR, 85, "55", "EOR", ZPX, 4},
+    {LSR, 86, "56", "LSR", ZPX, 6},
+    {SRE, 87, "57", "SRE", ZPX, 6},
+    {CLI, 88, "58", "CLI", IMP, 2},
+    {EOR, 89, "59", "EOR", ABYr, 4},
+    {NOP, 90, "5a", "NOP", IMP, 2},
+    {SRE, 91, "5b", "SRE", ABY, 7},
+    {NOP, 92, "5c", "NOP", ABXr, 4},
+    {EOR, 93, "5d", "EOR", ABXr, 4},
+    {LSR, 94, "5e", "LSR", ABX, 7},
+    {SRE, 95, "5f", "SRE", ABX, 7},
+    {RTS, 96, "60", "RTS", IMP, 6},
+    {ADC, 97, "61", "ADC", IZX, 6},
+    {KIL, 98, "62", "KIL", IMP, 2},
+    {RRA, 99, "63", "RRA", IZX, 8},
+    {NOP, 100, "64", "NOP", ZP, 3},
+    {ADC, 101, "65", "ADC", ZP, 3},
+    {ROR, 102, "66", "ROR", ZP, 5},
+    {RRA, 103, "67", "RRA", ZP, 5},
+    {PLA, 104, "68", "PLA", IMP, 4},
+    {ADC, 105, "69", "ADC", IMM, 2},
+    {RORA, 106, "6a", "RORA", IMP, 2},
+    {ARR, 107, "6b", "ARR", IMM, 2},
+    {JMP, 108, "6c", "JMP", IND, 5},
+    {ADC, 109, "6d", "ADC", ABS, 4},
+    {ROR, 110, "6e", "ROR", ABS, 6},
+    {RRA, 111, "6f", "RRA", ABS, 6},
+    {BVS, 112, "70", "BVS", REL, 2},
+    {ADC, 113, "71", "ADC", IZYr, 5},
+    {KIL, 114, "72", "KIL", IMP, 2},
+    {RRA, 115, "73", "RRA", IZY, 8},
+    {NOP, 116, "74", "NOP", ZPX, 4},
+    {ADC, 117, "75", "ADC", ZPX, 4},
+    {ROR, 118, "76", "ROR", ZPX, 6},
+    {RRA, 119, "77", "RRA", ZPX, 6},
+    {SEI, 120, "78", "SEI", IMP, 2},
+    {ADC, 121, "79", "ADC", ABYr, 4},
+    {NOP, 122, "7a", "NOP", IMP, 2},
+    {RRA, 123, "7b", "RRA", ABY, 7},
+    {NOP, 124, "7c", "NOP", ABXr, 4},
+    {ADC, 125, "7d", "ADC", ABXr, 4},
+    {ROR, 126, "7e", "ROR", ABX, 7},
+    {RRA, 127, "7f", "RRA", ABX, 7},
+    {NOP, 128, "80", "NOP", IMM, 2},
+    {STA, 129, "81", "STA", IZX, 6},
+    {NOP, 130, "82", "NOP", IMM, 2},
+    {SAX, 131, "83", "SAX", IZX, 6},
+    {STY, 132, "84", "STY", ZP, 3},
+    {STA, 133, "85", "STA", ZP, 3},
+    {STX, 134, "86", "STX", ZP, 3},
+    {SAX, 135, "87", "SAX", ZP, 3},
+    {DEY, 136, "88", "DEY", IMP, 2},
+    {NOP, 137, "89", "NOP", IMM, 2},
+    {TXA, 138, "8a", "TXA", IMP, 2},
+    {UNI, 139, "8b", "UNI", IMM, 2},
+    {STY, 140, "8c", "STY", ABS, 4},
+    {STA, 141, "8d", "STA", ABS, 4},
+    {STX, 142, "8e", "STX", ABS, 4},
+    {SAX, 143, "8f", "SAX", ABS, 4},
+    {BCC, 144, "90", "BCC", REL, 2},
+    {STA, 145, "91", "STA", IZY, 6},
+    {KIL, 146, "92", "KIL", IMP, 2},
+    {UNI, 147, "93", "UNI", IZY, 6},
+    {STY, 148, "94", "STY", ZPX, 4},
+    {STA, 149, "95", "STA", ZPX, 4},
+    {STX, 150, "96", "STX", ZPY, 4},
+    {SAX, 151, "97", "SAX", ZPY, 4},
+    {TYA, 152, "98", "TYA", IMP, 2},
+    {STA, 153, "99", "STA", ABY, 5},
+    {TXS, 154, "9a", "TXS", IMP, 2},
+    {UNI, 155, "9b", "UNI", ABY, 5},
+    {UNI, 156, "9c", "UNI", ABX, 5},
+    {STA, 157, "9d", "STA", ABX, 5},
+    {UNI, 158, "9e", "UNI", ABY, 5},
+    {UNI, 159, "9f", "UNI", ABY, 5},
+    {LDY, 160, "a0", "LDY", IMM, 2},
+    {LDA, 161, "a1", "LDA", IZX, 6},
+    {LDX, 162, "a2", "LDX", IMM, 2},
+    {LAX, 163, "a3", "LAX", IZX, 6},
+    {LDY, 164, "a4", "LDY", ZP, 3},
+    {LDA, 165, "a5", "LDA", ZP, 3},
+    {LDX, 166, "a6", "LDX", ZP, 3},
+    {LAX, 167, "a7", "LAX", ZP, 3},
+    {TAY, 168, "a8", "TAY", IMP, 2},
+    {LDA, 169, "a9", "LDA", IMM, 2},
+    {TAX, 170, "aa", "TAX", IMP, 2},
+    {UNI, 171, "ab", "UNI", IMM, 2},
+    {LDY, 172, "ac", "LDY", ABS, 4},
+    {LDA, 173, "ad", "LDA", ABS, 4},
+    {LDX, 174, "ae", "LDX", ABS, 4},
+    {LAX, 175, "af", "LAX", ABS, 4},
+    {BCS, 176, "b0", "BCS", REL, 2},
+    {LDA, 177, "b1", "LDA", IZYr, 5},
+    {KIL, 178, "b2", "KIL", IMP, 2},
+    {LAX, 179, "b3", "LAX", IZYr, 5},
+    {LDY, 180, "b4", "LDY", ZPX, 4},
+    {LDA, 181, "b5", "LDA", ZPX, 4},
+    {LDX, 182, "b6", "LDX", ZPY, 4},
+    {LAX, 183, "b7", "LAX", ZPY, 4},
+    {CLV, 184, "b8", "CLV", IMP, 2},
+    {LDA, 185, "b9", "LDA", ABYr, 4},
+    {TSX, 186, "ba", "TSX", IMP, 2},
+    {UNI, 187, "bb", "UNI", ABYr, 4},
+    {LDY, 188, "bc", "LDY", ABXr, 4},
+    {LDA, 189, "bd", "LDA", ABXr, 4},
+    {LDX, 190, "be", "LDX", ABYr, 4},
+    {LAX, 191, "bf", "LAX", ABYr, 4},
+    {CPY, 192, "c0", "CPY", IMM, 2},
+    {CMP, 193, "c1", "CMP", IZX, 6},
+    {NOP, 194, "c2", "NOP", IMM, 2},
+    {DCP, 195, "c3", "DCP", IZX, 8},
+    {CPY, 196, "c4", "CPY", ZP, 3},
+    {CMP, 197, "c5", "CMP", ZP, 3},
+    {DEC, 198, "c6", "DEC", ZP, 5},
+    {DCP, 199, "c7", "DCP", ZP, 5},
+    {INY, 200, "c8", "INY", IMP, 2},
+    {CMP, 201, "c9", "CMP", IMM, 2},
+    {DEX, 202, "ca", "DEX", IMP, 2},
+    {AXS, 203, "cb", "AXS", IMM, 2},
+    {CPY, 204, "cc", "CPY", ABS, 4},
+    {CMP, 205, "cd", "CMP", ABS, 4},
+    {DEC, 206, "ce", "DEC", ABS, 6},
+    {DCP, 207, "cf", "DCP", ABS, 6},
+    {BNE, 208, "d0", "BNE", REL, 2},
+    {CMP, 209, "d1", "CMP", IZYr, 5},
+    {KIL, 210, "d2", "KIL", IMP, 2},
+    {DCP, 211, "d3", "DCP", IZY, 8},
+    {NOP, 212, "d4", "NOP", ZPX, 4},
+    {CMP, 213, "d5", "CMP", ZPX, 4},
+    {DEC, 214, "d6", "DEC", ZPX, 6},
+    {DCP, 215, "d7", "DCP", ZPX, 6},
+    {CLD, 216, "d8", "CLD", IMP, 2},
+    {CMP, 217, "d9", "CMP", ABYr, 4},
+    {NOP, 218, "da", "NOP", IMP, 2},
+    {DCP, 219, "db", "DCP", ABY, 7},
+    {NOP, 220, "dc", "NOP", ABXr, 4},
+    {CMP, 221, "dd", "CMP", ABXr, 4},
+    {DEC, 222, "de", "DEC", ABX, 7},
+    {DCP, 223, "df", "DCP", ABX, 7},
+    {CPX, 224, "e0", "CPX", IMM, 2},
+    {SBC, 225, "e1", "SBC", IZX, 6},
+    {NOP, 226, "e2", "NOP", IMM, 2},
+    {ISC, 227, "e3", "ISC", IZX, 8},
+    {CPX, 228, "e4", "CPX", ZP, 3},
+    {SBC, 229, "e5", "SBC", ZP, 3},
+    {INC, 230, "e6", "INC", ZP, 5},
+    {ISC, 231, "e7", "ISC", ZP, 5},
+    {INX, 232, "e8", "INX", IMP, 2},
+    {SBC, 233, "e9", "SBC", IMM, 2},
+    {NOP, 234, "ea", "NOP", IMP, 2},
+    {SBC, 235, "eb", "SBC", IMM, 2},
+    {CPX, 236, "ec", "CPX", ABS, 4},
+    {SBC, 237, "ed", "SBC", ABS, 4},
+    {INC, 238, "ee", "INC", ABS, 6},
+    {ISC, 239, "ef", "ISC", ABS, 6},
+    {BEQ, 240, "f0", "BEQ", REL, 2},
+    {SBC, 241, "f1", "SBC", IZYr, 5},
+    {KIL, 242, "f2", "KIL", IMP, 2},
+    {ISC, 243, "f3", "ISC", IZY, 8},
+    {NOP, 244, "f4", "NOP", ZPX, 4},
+    {SBC, 245, "f5", "SBC", ZPX, 4},
+    {INC, 246, "f6", "INC", ZPX, 6},
+    {ISC, 247, "f7", "ISC", ZPX, 6},
+    {SED, 248, "f8", "SED", IMP, 2},
+    {SBC, 249, "f9", "SBC", ABYr, 4},
+    {NOP, 250, "fa", "NOP", IMP, 2},
+    {ISC, 251, "fb", "ISC", ABY, 7},
+    {NOP, 252, "fc", "NOP", ABXr, 4},
+    {SBC, 253, "fd", "SBC", ABXr, 4},
+    {INC, 254, "fe", "INC", ABX, 7},
+    {ISC, 255, "ff", "ISC", ABX, 7},
+    {NMI, 256, "100", "NMI", NMI, 0},
+    {IRQ, 257, "101", "IRQ", IRQ, 0},
+};
+
+// 65C02: the NMOS table with the CMOS additions, the fixed JMP (abs) and
+// one cycle shorter read-modify-write abs,X. Opcodes the 65C02 leaves
+// undefined are NOPs of their documented length and timing.
+const Opcode Cpu::opcodes_c02[258] = {
+    {BRK, 0, "0", "BRK", IMP, 7},
+    {ORA, 1, "1", "ORA", IZX, 6},
+    {NOP, 2, "2", "NOP", IMM, 2},
+    {NOP, 3, "3", "NOP", IMP, 1},
+    {TSB, 4, "4", "TSB", ZP, 5},
+    {ORA, 5, "5", "ORA", ZP, 3},
+    {ASL, 6, "6", "ASL", ZP, 5},
+    {NOP, 7, "7", "NOP", IMP, 1},
+    {PHP, 8, "8", "PHP", IMP, 3},
+    {ORA, 9, "9", "ORA", IMM, 2},
+    {ASLA, 10, "a", "ASLA", IMP, 2},
+    {NOP, 11, "b", "NOP", IMP, 1},
+    {TSB, 12, "c", "TSB", ABS, 6},
+    {ORA, 13, "d", "ORA", ABS, 4},
+    {ASL, 14, "e", "ASL", ABS, 6},
+    {NOP, 15, "f", "NOP", IMP, 1},
+    {BPL, 16, "10", "BPL", REL, 2},
+    {ORA, 17, "11", "ORA", IZYr, 5},
+    {ORA, 18, "12", "ORA", IZP, 5},
+    {NOP, 19, "13", "NOP", IMP, 1},
+    {TRB, 20, "14", "TRB", ZP, 5},
+    {ORA, 21, "15", "ORA", ZPX, 4},
+    {ASL, 22, "16", "ASL", ZPX, 6},
+    {NOP, 23, "17", "NOP", IMP, 1},
+    {CLC, 24, "18", "CLC", IMP, 2},
+    {ORA, 25, "19", "ORA", ABYr, 4},
+    {INCA, 26, "1a", "INCA", IMP, 2},
+    {NOP, 27, "1b", "NOP", IMP, 1},
+    {TRB, 28, "1c", "TRB", ABS, 6},
+    {ORA, 29, "1d", "ORA", ABXr, 4},
+    {ASL, 30, "1e", "ASL", ABXr, 6},
+    {NOP, 31, "1f", "NOP", IMP, 1},
+    {JSR, 32, "20", "JSR", ABS, 6},
+    {AND, 33, "21", "AND", IZX, 6},
+    {NOP, 34, "22", "NOP", IMM, 2},
+    {NOP, 35, "23", "NOP", IMP, 1},
+    {BIT, 36, "24", "BIT", ZP, 3},
+    {AND, 37, "25", "AND", ZP, 3},
+    {ROL, 38, "26", "ROL", ZP, 5},
+    {NOP, 39, "27", "NOP", IMP, 1},
+    {PLP, 40, "28", "PLP", IMP, 4},
+    {AND, 41, "29", "AND", IMM, 2},
+    {ROLA, 42, "2a", "ROLA", IMP, 2},
+    {NOP, 43, "2b", "NOP", IMP, 1},
+    {BIT, 44, "2c", "BIT", ABS, 4},
+    {AND, 45, "2d", "AND", ABS, 4},
+    {ROL, 46, "2e", "ROL", ABS, 6},
+    {NOP, 47, "2f", "NOP", IMP, 1},
+    {BMI, 48, "30", "BMI", REL, 2},
+    {AND, 49, "31", "AND", IZYr, 5},
+    {AND, 50, "32", "AND", IZP, 5},
+    {NOP, 51, "33", "NOP", IMP, 1},
+    {BIT, 52, "34", "BIT", ZPX, 4},
+    {AND, 53, "35", "AND", ZPX, 4},
+    {ROL, 54, "36", "ROL", ZPX, 6},
+    {NOP, 55, "37", "NOP", IMP, 1},
+    {SEC, 56, "38", "SEC", IMP, 2},
+    {AND, 57, "39", "AND", ABYr, 4},
+    {DECA, 58, "3a", "DECA", IMP, 2},
+    {NOP, 59, "3b", "NOP", IMP, 1},
+    {BIT, 60, "3c", "BIT", ABXr, 4},
+    {AND, 61, "3d", "AND", ABXr, 4},
+    {ROL, 62, "3e", "ROL", ABXr, 6},
+    {NOP, 63, "3f", "NOP", IMP, 1},
+    {RTI, 64, "40", "RTI", IMP, 6},
+    {EOR, 65, "41", "EOR", IZX, 6},
+    {NOP, 66, "42", "NOP", IMM, 2},
+    {NOP, 67, "43", "NOP", IMP, 1},
+    {NOP, 68, "44", "NOP", ZP, 3},
+    {EOR, 69, "45", "EOR", ZP, 3},
+    {LSR, 70, "46", "LSR", ZP, 5},
+    {NOP, 71, "47", "NOP", IMP, 1},
+    {PHA, 72, "48", "PHA", IMP, 3},
+    {EOR, 73, "49", "EOR", IMM, 2},
+    {LSRA, 74, "4a", "LSRA", IMP, 2},
+    {NOP, 75, "4b", "NOP", IMP, 1},
+    {JMP, 76, "4c", "JMP", ABS, 3},
+    {EOR, 77, "4d", "EOR", ABS, 4},
+    {LSR, 78, "4e", "LSR", ABS, 6},
+    {NOP, 79, "4f", "NOP", IMP, 1},
+    {BVC, 80, "50", "BVC", REL, 2},
+    {EOR, 81, "51", "EOR", IZYr, 5},
+    {EOR, 82, "52", "EOR", IZP, 5},
+    {NOP, 83, "53", "NOP", IMP, 1},
+    {NOP, 84, "54", "NOP", ZPX, 4},
+    {EOR, 85, "55", "EOR", ZPX, 4},
+    {LSR, 86, "56", "LSR", ZPX, 6},
+    {NOP, 87, "57", "NOP", IMP, 1},
+    {CLI, 88, "58", "CLI", IMP, 2},
+    {EOR, 89, "59", "EOR", ABYr, 4},
+    {PHY, 90, "5a", "PHY", IMP, 3},
+    {NOP, 91, "5b", "NOP", IMP, 1},
+    {NOP, 92, "5c", "NOP", ABS, 8},
+    {EOR, 93, "5d", "EOR", ABXr, 4},
+    {LSR, 94, "5e", "LSR", ABXr, 6},
+    {NOP, 95, "5f", "NOP", IMP, 1},
+    {RTS, 96, "60", "RTS", IMP, 6},
+    {ADC, 97, "61", "ADC", IZX, 6},
+    {NOP, 98, "62", "NOP", IMM, 2},
+    {NOP, 99, "63", "NOP", IMP, 1},
+    {STZ, 100, "64", "STZ", ZP, 3},
+    {ADC, 101, "65", "ADC", ZP, 3},
+    {ROR, 102, "66", "ROR", ZP, 5},
+    {NOP, 103, "67", "NOP", IMP, 1},
+    {PLA, 104, "68", "PLA", IMP, 4},
+    {ADC, 105, "69", "ADC", IMM, 2},
+    {RORA, 106, "6a", "RORA", IMP, 2},
+    {NOP, 107, "6b", "NOP", IMP, 1},
+    {JMP, 108, "6c", "JMP", IND, 6},
+    {ADC, 109, "6d", "ADC", ABS, 4},
+    {ROR, 110, "6e", "ROR", ABS, 6},
+    {NOP, 111, "6f", "NOP", IMP, 1},
+    {BVS, 112, "70", "BVS", REL, 2},
+    {ADC, 113, "71", "ADC", IZYr, 5},
+    {ADC, 114, "72", "ADC", IZP, 5},
+    {NOP, 115, "73", "NOP", IMP, 1},
+    {STZ, 116, "74", "STZ", ZPX, 4},
+    {ADC, 117, "75", "ADC", ZPX, 4},
+    {ROR, 118, "76", "ROR", ZPX, 6},
+    {NOP, 119, "77", "NOP", IMP, 1},
+    {SEI, 120, "78", "SEI", IMP, 2},
+    {ADC, 121, "79", "ADC", ABYr, 4},
+    {PLY, 122, "7a", "PLY", IMP, 4},
+    {NOP, 123, "7b", "NOP", IMP, 1},
+    {JMP, 124, "7c", "JMP", IAX, 6},
+    {ADC, 125, "7d", "ADC", ABXr, 4},
+    {ROR, 126, "7e", "ROR", ABXr, 6},
+    {NOP, 127, "7f", "NOP", IMP, 1},
+    {BRA, 128, "80", "BRA", REL, 2},
+    {STA, 129, "81", "STA", IZX, 6},
+    {NOP, 130, "82", "NOP", IMM, 2},
+    {NOP, 131, "83", "NOP", IMP, 1},
+    {STY, 132, "84", "STY", ZP, 3},
+    {STA, 133, "85", "STA", ZP, 3},
+    {STX, 134, "86", "STX", ZP, 3},
+    {NOP, 135, "87", "NOP", IMP, 1},
+    {DEY, 136, "88", "DEY", IMP, 2},
+    {BITI, 137, "89", "BIT", IMM, 2},
+    {TXA, 138, "8a", "TXA", IMP, 2},
+    {NOP, 139, "8b", "NOP", IMP, 1},
+    {STY, 140, "8c", "STY", ABS, 4},
+    {STA, 141, "8d", "STA", ABS, 4},
+    {STX, 142, "8e", "STX", ABS, 4},
+    {NOP, 143, "8f", "NOP", IMP, 1},
+    {BCC, 144, "90", "BCC", REL, 2},
+    {STA, 145, "91", "STA", IZY, 6},
+    {STA, 146, "92", "STA", IZP, 5},
+    {NOP, 147, "93", "NOP", IMP, 1},
+    {STY, 148, "94", "STY", ZPX, 4},
+    {STA, 149, "95", "STA", ZPX, 4},
+    {STX, 150, "96", "STX", ZPY, 4},
+    {NOP, 151, "97", "NOP", IMP, 1},
+    {TYA, 152, "98", "TYA", IMP, 2},
+    {STA, 153, "99", "STA", ABY, 5},
+    {TXS, 154, "9a", "TXS", IMP, 2},
+    {NOP, 155, "9b", "NOP", IMP, 1},
+    {STZ, 156, "9c", "STZ", ABS, 4},
+    {STA, 157, "9d", "STA", ABX, 5},
+    {STZ, 158, "9e", "STZ", ABX, 5},
+    {NOP, 159, "9f", "NOP", IMP, 1},
+    {LDY, 160, "a0", "LDY", IMM, 2},
+    {LDA, 161, "a1", "LDA", IZX, 6},
+    {NOP, 162, "a2", "NOP", IMM, 2},
+    {NOP, 163, "a3", "NOP", IMP, 1},
+    {LDY, 164, "a4", "LDY", ZP, 3},
+    {LDA, 165, "a5", "LDA", ZP, 3},
+    {LDX, 166, "a6", "LDX", ZP, 3},
+    {NOP, 167, "a7", "NOP", IMP, 1},
+    {TAY, 168, "a8", "TAY", IMP, 2},
+    {LDA, 169, "a9", "LDA", IMM, 2},
+    {TAX, 170, "aa", "TAX", IMP, 2},
+    {NOP, 171, "ab", "NOP", IMP, 1},
+    {LDY, 172, "ac", "LDY", ABS, 4},
+    {LDA, 173, "ad", "LDA", ABS, 4},
+    {LDX, 174, "ae", "LDX", ABS, 4},
+    {NOP, 175, "af", "NOP", IMP, 1},
+    {BCS, 176, "b0", "BCS", REL, 2},
+    {LDA, 177, "b1", "LDA", IZYr, 5},
+    {LDA, 178, "b2", "LDA", IZP, 5},
+    {NOP, 179, "b3", "NOP", IMP, 1},
+    {LDY, 180, "b4", "LDY", ZPX, 4},
+    {LDA, 181, "b5", "LDA", ZPX, 4},
+    {LDX, 182, "b6", "LDX", ZPY, 4},
+    {NOP, 183, "b7", "NOP", IMP, 1},
+    {CLV, 184, "b8", "CLV", IMP, 2},
+    {LDA, 185, "b9", "LDA", ABYr, 4},
+    {TSX, 186, "ba", "TSX", IMP, 2},
+    {NOP, 187, "bb", "NOP", IMP, 1},
+    {LDY, 188, "bc", "LDY", ABXr, 4},
+    {LDA, 189, "bd", "LDA", ABXr, 4},
+    {LDX, 190, "be", "LDX", ABYr, 4},
+    {NOP, 191, "bf", "NOP", IMP, 1},
+    {CPY, 192, "c0", "CPY", IMM, 2},
+    {CMP, 193, "c1", "CMP", IZX, 6},
+    {NOP, 194, "c2", "NOP", IMM, 2},
+    {NOP, 195, "c3", "NOP", IMP, 1},
+    {CPY, 196, "c4", "CPY", ZP, 3},
+    {CMP, 197, "c5", "CMP", ZP, 3},
+    {DEC, 198, "c6", "DEC", ZP, 5},
+    {NOP, 199, "c7", "NOP", IMP, 1},
+    {INY, 200, "c8", "INY", IMP, 2},
+    {CMP, 201, "c9", "CMP", IMM, 2},
+    {DEX, 202, "ca", "DEX", IMP, 2},
+    {NOP, 203, "cb", "NOP", IMP, 1},
+    {CPY, 204, "cc", "CPY", ABS, 4},
+    {CMP, 205, "cd", "CMP", ABS, 4},
+    {DEC, 206, "ce", "DEC", ABS, 6},
+    {NOP, 207, "cf", "NOP", IMP, 1},
+    {BNE, 208, "d0", "BNE", REL, 2},
+    {CMP, 209, "d1", "CMP", IZYr, 5},
+    {CMP, 210, "d2", "CMP", IZP, 5},
+    {NOP, 211, "d3", "NOP", IMP, 1},
+    {NOP, 212, "d4", "NOP", ZPX, 4},
+    {CMP, 213, "d5", "CMP", ZPX, 4},
+    {DEC, 214, "d6", "DEC", ZPX, 6},
+    {NOP, 215, "d7", "NOP", IMP, 1},
+    {CLD, 216, "d8", "CLD", IMP, 2},
+    {CMP, 217, "d9", "CMP", ABYr, 4},
+    {PHX, 218, "da", "PHX", IMP, 3},
+    {NOP, 219, "db", "NOP", IMP, 1},
+    {NOP, 220, "dc", "NOP", ABS, 4},
+    {CMP, 221, "dd", "CMP", ABXr, 4},
+    {DEC, 222, "de", "DEC", ABX, 7},
+    {NOP, 223, "df", "NOP", IMP, 1},
+    {CPX, 224, "e0", "CPX", IMM, 2},
+    {SBC, 225, "e1", "SBC", IZX, 6},
+    {NOP, 226, "e2", "NOP", IMM, 2},
+    {NOP, 227, "e3", "NOP", IMP, 1},
+    {CPX, 228, "e4", "CPX", ZP, 3},
+    {SBC, 229, "e5", "SBC", ZP, 3},
+    {INC, 230, "e6", "INC", ZP, 5},
+    {NOP, 231, "e7", "NOP", IMP, 1},
+    {INX, 232, "e8", "INX", IMP, 2},
+    {SBC, 233, "e9", "SBC", IMM, 2},
+    {NOP, 234, "ea", "NOP", IMP, 2},
+    {NOP, 235, "eb", "NOP", IMP, 1},
+    {CPX, 236, "ec", "CPX", ABS, 4},
+    {SBC, 237, "ed", "SBC", ABS, 4},
+    {INC, 238, "ee", "INC", ABS, 6},
+    {NOP, 239, "ef", "NOP", IMP, 1},
+    {BEQ, 240, "f0", "BEQ", REL, 2},
+    {SBC, 241, "f1", "SBC", IZYr, 5},
+    {SBC, 242, "f2", "SBC", IZP, 5},
+    {NOP, 243, "f3", "NOP", IMP, 1},
+    {NOP, 244, "f4", "NOP", ZPX, 4},
+    {SBC, 245, "f5", "SBC", ZPX, 4},
+    {INC, 246, "f6", "INC", ZPX, 6},
+    {NOP, 247, "f7", "NOP", IMP, 1},
+    {SED, 248, "f8", "SED", IMP, 2},
+    {SBC, 249, "f9", "SBC", ABYr, 4},
+    {PLX, 250, "fa", "PLX", IMP, 4},
+    {NOP, 251, "fb", "NOP", IMP, 1},
+    {NOP, 252, "fc", "NOP", ABS, 4},
+    {SBC, 253, "fd", "SBC", ABXr, 4},
+    {INC, 254, "fe", "INC", ABX, 7},
+    {NOP, 255, "ff", "NOP", IMP, 1},
+    {NMI, 256, "100", "NMI", NMI, 0},
+    {IRQ, 257, "101", "IRQ", IRQ, 0},
+};
 
 Cpu::Cpu()
 {
-    create_opcodes();
-    mem = new Mem();
+    mem        = new Mem();
+    mem->clock = &totalcycle;
 }
 Cpu::~Cpu()
 {
+    delete[] imgdata;
     delete mem;
 }
 void Cpu::init()
@@ -34,11 +562,15 @@ void Cpu::reset()
     zero      = false;
     carry     = false;
 
-    toirq    = 0x00;
-    cpuclock = 7;
+    toirq     = 0x00;
+    irq_lines = 0;
+    nmi_lines = 0;
+    pending   = 0;
+    cpuclock  = 7;
     cycles   = 0;
     total    = 0;
 
+    events.rebase(totalcycle, 7);
     totalcycle = 7;
     steps      = 0;
 
@@ -49,51 +581,222 @@ void Cpu::reset()
 void Cpu::exec_nmi()
 {
     auto opc = opcodes[256];
-    cpuclock += 7;
-    exe_instruction(opc.opcode, 0);
+    cycles += 7;
+    if (variant == CPU_CMOS)
+        exe_instruction<CPU_CMOS>(opc.opcode, 0);
+    else
+        exe_instruction<CPU_NMOS>(opc.opcode, 0);
 }
 void Cpu::exec_irq()
 {
     auto opc = opcodes[257];
-    cpuclock += 7;
-    exe_instruction(opc.opcode, 0);
+    cycles += 7;
+    if (variant == CPU_CMOS)
+        exe_instruction<CPU_CMOS>(opc.opcode, 0);
+    else
+        exe_instruction<CPU_NMOS>(opc.opcode, 0);
+}
+void Cpu::assert_irq(uint32_t src)
+{
+    irq_lines |= src;
+    pending |= INT_IRQ;
+}
+void Cpu::release_irq(uint32_t src)
+{
+    irq_lines &= ~src;
+    if (irq_lines == 0)
+        pending &= ~INT_IRQ;
+}
+void Cpu::assert_nmi(uint32_t src)
+{
+    if (nmi_lines == 0)
+        pending |= INT_NMI;
+    nmi_lines |= src;
+}
+void Cpu::release_nmi(uint32_t src)
+{
+    nmi_lines &= ~src;
+}
+template <CpuVariant V> void Cpu::check_interrupts()
+{
+    if (pending & INT_NMI) {
+        pending &= ~INT_NMI;
+        cycles += 7;
+        exe_instruction<V>(NMI, 0);
+    } else if (!interrupt) {
+        cycles += 7;
+        exe_instruction<V>(IRQ, 0);
+    }
 }
 void Cpu::step()
 {
-    int i = 12600;
-    while (0 < i) {
-        i -= run(false);
+    if (metrics == nullptr) {
+        run_frame();
+        draw_frame();
+        return;
     }
+    size_t   steps0 = steps;
+    uint64_t t0     = Metrics::now();
+    run_frame();
+    uint64_t t1 = Metrics::now();
     draw_frame();
+    uint64_t t2 = Metrics::now();
+    metrics->observe(M_CPU_STEP, t2 - t0);
+    metrics->observe(M_DRAW_FRAME, t2 - t1);
+    metrics->add(M_INSTRUCTIONS, steps - steps0);
+    metrics->add(M_FRAMES, 1);
 }
-void Cpu::draw_frame()
+void Cpu::start_frame()
+{
+    frame_left = FRAME_CYCLES;
+    idle.valid = false;
+    mem->start_frame(totalcycle);
+}
+void Cpu::run_frame()
+{
+    start_frame();
+    if (variant == CPU_CMOS) {
+        while (0 < frame_left) {
+            frame_left -= run_variant<CPU_CMOS>(false);
+        }
+    } else {
+        while (0 < frame_left) {
+            frame_left -= run_variant<CPU_NMOS>(false);
+        }
+    }
+}
+// Lo-res colours; double hi-res reads the same colours from four dots with
+// the nibble rotated by one.
+static constexpr uint32_t lores_color[16] = {
+    0xff000000, 0xffdd0033, 0xff000099, 0xffdd22dd, 0xff007722, 0xff555555, 0xff2222ff, 0xff66aaff,
+    0xff885500, 0xffff6600, 0xffaaaaaa, 0xffff9988, 0xff11dd00, 0xffffff00, 0xff44ff99, 0xffffffff,
+};
+struct DhrColors
 {
-    bool     scanlines = true;
-    int      page_2    = mem->page_2;
-    int      y0        = (1 - page_2) ? 0 : 192;
-    int      src0      = (page_2 ? 0x4000 : 0x2000);
-    uint32_t imgidx    = 0;
+    uint32_t color[16];
+};
+static constexpr DhrColors make_dhr_colors()
+{
+    DhrColors t{};
+    for (int n = 0; n < 16; n++)
+        t.color[n] = lores_color[((n << 1) | (n >> 3)) & 15];
+    return t;
+}
+static constexpr DhrColors dhr = make_dhr_colors();
 
+// Redraws the rows whose memory changed since the last call, or whose mode
+// or displayed page did. Hi-res rows use the scanline flags, text and lo-res
+// rows the flag of their text row. Rows the beam passed before a mid-frame
+// switch are drawn in the mode they were scanned in.
+void Cpu::draw_frame()
+{
+    bool fresh = imgdata == nullptr;
+    if (fresh)
+        imgdata = new uint32_t[560 * 2 * 192]{};
+    uint32_t current = mem->display_mode();
     for (int y = 0; y < 192; y++) {
-        mem->dirty_scanlines[y + y0] = 0;
+        uint32_t mode  = y < mem->scan_line ? mem->line_mode[y] : current;
+        int      page  = mode >> 8;
+        bool     all   = fresh || mode != row_mode[y];
+        bool     text  = (mode & SW_TEXT) || ((mode & SW_MIXED) && y >= 160);
+        bool     lores = !text && !(mode & SW_HIRES);
+        row_mode[y]    = mode;
+        if (text || lores) {
+            if (!all && !mem->dirty_text[y / 8 + page * 24])
+                continue;
+            draw_text_row(y, page, lores, mode & SW_80COL);
+        } else {
+            if (!all && !mem->dirty_scanlines[y + page * 192])
+                continue;
+            mem->dirty_scanlines[y + page * 192] = 0;
+            if ((mode & SW_DHIRES) && (mode & SW_80COL))
+                draw_dhr_row(y, page);
+            else
+                draw_hires_row(y, page);
+        }
+        drawn_rows[y] = 1;
+    }
+    // a row drawn from the other page, or not as text, is redrawn anyway
+    // when it next shows this text page
+    memset(mem->dirty_text, 0, 2 * 24);
+    mem->scan_line = 0;
+    imgok          = true;
+}
+void Cpu::draw_hires_row(int y, int page)
+{
+    int src = (page ? 0x4000 : 0x2000) + mem->scanline_to_offset[y];
+    int dst = y * 1120;
+    int idx = 0;
+
+    for (int x = 0; x < 40; x++) {
+        size_t c = mem->ram[src++];
+        for (int i = 0; i < 7 * 8; i += 4) {
+            int r = mem->color_lut[c][i];
+            int g = mem->color_lut[c][i + 1];
+            int b = mem->color_lut[c][i + 2];
+            set_img_data(r, g, b, dst + idx);
+            set_img_data(r, g, b, dst + 560 + idx);
+            idx++;
+        }
+    }
+}
+// 80 bytes a row, aux and main alternating, 7 dots each; every 4 dots are
+// one of 140 coloured pixels.
+void Cpu::draw_dhr_row(int y, int page)
+{
+    int       src = (page ? 0x4000 : 0x2000) + mem->scanline_to_offset[y];
+    uint32_t *dst = imgdata + y * 1120;
 
-        int src = src0 + mem->scanline_to_offset[y];
-        int dst = y * 1120;
-        int idx = 0;
+    for (int x = 0; x < 40; x += 2, src += 2) {
+        uint32_t dots = (mem->aux[src] & 0x7f) | (mem->ram[src] & 0x7f) << 7 | (mem->aux[src + 1] & 0x7f) << 14 |
+                        (mem->ram[src + 1] & 0x7f) << 21;
+        for (int i = 0; i < 28; i += 4) {
+            uint32_t c = dhr.color[(dots >> i) & 15];
+            for (int j = 0; j < 4; j++) {
+                dst[j]       = c;
+                dst[560 + j] = c;
+            }
+            dst += 4;
+        }
+    }
+}
+// Text rows take their dots from the glyph table, 14 pixels a character in
+// 40 columns and 7 in 80 columns, where aux holds the even columns. Lo-res
+// rows show the low nibble in the top four lines of a block.
+void Cpu::draw_text_row(int y, int page, bool lores, bool col80)
+{
+    int       src  = (page ? 0x800 : 0x400) + mem->text_row_to_offset[y / 8];
+    int       line = y & 7;
+    uint32_t *dst  = imgdata + y * 1120;
 
-        for (int x = 0; x < 40; x++) {
-            size_t c = mem->get(src++);
-            for (int i = 0; i < 7 * 8; i += 4) {
-                int r = mem->color_lut[c][i];
-                int g = mem->color_lut[c][i + 1];
-                int b = mem->color_lut[c][i + 2];
-                set_img_data(r, g, b, dst + idx);
-                set_img_data(r, g, b, dst + 560 + idx);
-                idx++;
+    for (int x = 0; x < 40; x++, src++) {
+        if (lores) {
+            uint32_t c = lores_color[line < 4 ? mem->ram[src] & 15 : mem->ram[src] >> 4];
+            for (int j = 0; j < 14; j++) {
+                dst[j]       = c;
+                dst[560 + j] = c;
+            }
+            dst += 14;
+        } else if (col80) {
+            uint8_t glyphs[2] = {mem->text_glyph[mem->aux[src]][line], mem->text_glyph[mem->ram[src]][line]};
+            for (uint8_t dots : glyphs) {
+                for (int i = 0; i < 7; i++) {
+                    uint32_t c = dots >> i & 1 ? 0xff00ff00 : 0xff000000;
+                    dst[i]       = c;
+                    dst[560 + i] = c;
+                }
+                dst += 7;
+            }
+        } else {
+            uint8_t dots = mem->text_glyph[mem->ram[src]][line];
+            for (int i = 0; i < 7; i++) {
+                uint32_t c = dots >> i & 1 ? 0xff00ff00 : 0xff000000;
+                dst[0] = dst[1] = c;
+                dst[560] = dst[561] = c;
+                dst += 2;
             }
         }
     }
-    imgok = true;
 }
 bool Cpu::get_img_status()
 {
@@ -109,6 +812,8 @@ void Cpu::clear_img()
 }
 uint32_t *Cpu::get_img_data()
 {
+    if (imgdata == nullptr)
+        imgdata = new uint32_t[560 * 2 * 192]{};
     return imgdata;
 }
 void Cpu::set_img_data(uint8_t r, uint8_t g, uint8_t b, int idx)
@@ -118,21 +823,34 @@ void Cpu::set_img_data(uint8_t r, uint8_t g, uint8_t b, int idx)
 }
 int Cpu::run(bool cputest)
 {
-    std::string istr = "";    // irq->check_interrupt(interrupt);
-    if (istr == "nmi") {
-        // irq->clear_nmi();
-        exec_nmi();
-    } else if (istr == "irq") {
-        // irq->clear_irq();
-        exec_irq();
+    if (variant == CPU_CMOS)
+        return run_variant<CPU_CMOS>(cputest);
+    return run_variant<CPU_NMOS>(cputest);
+}
+template <CpuVariant V> inline int Cpu::run_variant(bool cputest)
+{
+    cycles = 0;
+    if (pending != 0) {
+        check_interrupts<V>();
     }
 
+#ifdef CPU_TRACE
+    if (tracer != nullptr) {
+        uint8_t *ram = mem->ram;
+        tracer->record(totalcycle, pc, ram[pc], ram[(uint16_t)(pc + 1)], ram[(uint16_t)(pc + 2)], a, x, y, getp(false),
+                       sp);
+    }
+#endif
     uint16_t prepc    = pc;
     uint8_t  instr    = mem->get(pc++);
-    auto     optobj   = opcodes[instr];
+    auto    &optobj   = V == CPU_CMOS ? opcodes_c02[instr] : opcodes[instr];
     auto     optcycle = optobj.cycle;
     auto     op       = optobj.op;
-    auto     adrm     = get_addr(optobj.adm);
+    auto     adrm     = get_addr<V>(optobj.adm);
+#ifdef MEM_HEATMAP
+    if (mem->heat != nullptr)
+        mem->heat->fetch(prepc, (uint16_t)(pc - prepc));
+#endif
 
     if (cputest) {
         show_test_state(prepc, op, adrm);
@@ -140,26 +858,51 @@ int Cpu::run(bool cputest)
     if (false) {
         show_state(prepc, op, adrm);
     }
-    if (steps == 127632) {
-        printf(" ");
-    }
-    exe_instruction(optobj.opcode, adrm);
+    exe_instruction<V>(optobj.opcode, adrm);
+    cycles += optcycle;
+#ifdef CPU_PROFILER
+    if (prof != nullptr)
+        prof->sample(prepc, instr, adrm, cycles);
+#endif
     steps++;
-    return optcycle;
+    cpuclock += cycles;
+    totalcycle += cycles;
+    if (totalcycle >= events.next)
+        events.fire(totalcycle);
+    return cycles;
 }
 void Cpu::clear_cpucycle()
 {
     cpuclock = 0;
 }
-void Cpu::show_state(uint16_t pc, string op, uint16_t adrm)
+// Identifies the machine state: main and aux RAM, registers, flags, keyboard
+// latch, soft switches, video page and interrupt lines. Constant time when
+// built with MEM_HASH, a full RAM scan otherwise. Cycle and instruction
+// counters are left out so equal states reached along different paths
+// compare equal.
+uint64_t Cpu::state_hash()
+{
+#ifdef MEM_HASH
+    uint64_t h = mem->ram_hash;
+#else
+    uint64_t h = mem->hash_ram();
+#endif
+    uint64_t regs = a | x << 8 | y << 16 | (uint64_t)sp << 24 | (uint64_t)getp(false) << 32 | (uint64_t)pc << 40 |
+                    (uint64_t)mem->key << 56;
+    uint64_t lines = (uint64_t)irq_lines | (uint64_t)nmi_lines << 32;
+    h ^= Mem::mix(regs + 0x2545f4914f6cdd1dull);
+    h ^= Mem::mix(Mem::mix(lines) + (mem->page_2 | (uint64_t)mem->switches << 1));
+    return h;
+}
+void Cpu::show_state(uint16_t pc, const char *op, uint16_t adrm)
 {
     auto p = getp(false);
     printf("\n");
     printf("pc         : %04X\n", pc);
-    printf("opcode     : %s\n", op.c_str());
+    printf("opcode     : %s\n", op);
     printf("regs       : A:%02X X:%02X Y:%02X P:%02X SP:%02X\n", a, x, y, p, sp);
 }
-void Cpu::show_test_state(uint16_t pc, string op, uint16_t adrm)
+void Cpu::show_test_state(uint16_t pc, const char *op, uint16_t adrm)
 {
     // auto p = getp(false);
     // char testchar[200];
@@ -186,7 +929,91 @@ void Cpu::show_test_state(uint16_t pc, string op, uint16_t adrm)
     //     exit(1);
     // }
 }
-uint16_t Cpu::get_addr(int adm)
+const Opcode &Cpu::opcode_info(uint8_t opcode)
+{
+    return variant == CPU_CMOS ? opcodes_c02[opcode] : opcodes[opcode];
+}
+int Cpu::oplen(uint8_t opcode)
+{
+    switch (opcode_info(opcode).adm) {
+        case IMP:
+            return 1;
+        case ABS:
+        case ABX:
+        case ABXr:
+        case ABY:
+        case ABYr:
+        case IND:
+        case IAX:
+            return 3;
+    }
+    return 2;
+}
+int Cpu::disasm(uint16_t addr, const uint8_t *bytes, char *buf, size_t len)
+{
+    auto       &opc = opcode_info(bytes[0]);
+    const char *op  = opc.op;
+    uint16_t    zp  = bytes[1];
+    uint16_t    abs = bytes[1] | (bytes[2] << 8);
+
+    switch (opc.adm) {
+        case IMP:
+            snprintf(buf, len, "%s", op);
+            break;
+        case IMM:
+            snprintf(buf, len, "%s #$%02X", op, zp);
+            break;
+        case ZP:
+            snprintf(buf, len, "%s $%02X", op, zp);
+            break;
+        case ZPX:
+            snprintf(buf, len, "%s $%02X,X", op, zp);
+            break;
+        case ZPY:
+            snprintf(buf, len, "%s $%02X,Y", op, zp);
+            break;
+        case IZX:
+            snprintf(buf, len, "%s ($%02X,X)", op, zp);
+            break;
+        case IZY:
+        case IZYr:
+            snprintf(buf, len, "%s ($%02X),Y", op, zp);
+            break;
+        case ABS:
+            snprintf(buf, len, "%s $%04X", op, abs);
+            break;
+        case ABX:
+        case ABXr:
+            snprintf(buf, len, "%s $%04X,X", op, abs);
+            break;
+        case ABY:
+        case ABYr:
+            snprintf(buf, len, "%s $%04X,Y", op, abs);
+            break;
+        case IND:
+            snprintf(buf, len, "%s ($%04X)", op, abs);
+            break;
+        case IZP:
+            snprintf(buf, len, "%s ($%02X)", op, zp);
+            break;
+        case IAX:
+            snprintf(buf, len, "%s ($%04X,X)", op, abs);
+            break;
+        case REL:
+            snprintf(buf, len, "%s $%04X", op, (uint16_t)(addr + 2 + (int8_t)zp));
+            break;
+    }
+    return oplen(bytes[0]);
+}
+int Cpu::disasm(uint16_t addr, char *buf, size_t len)
+{
+    uint8_t bytes[3];
+    for (int i = 0; i < 3; i++) {
+        bytes[i] = mem->ram[(uint16_t)(addr + i)];
+    }
+    return disasm(addr, bytes, buf, len);
+}
+template <CpuVariant V> uint16_t Cpu::get_addr(int adm)
 {
     switch (adm) {
         case IMP: {
@@ -223,9 +1050,8 @@ uint16_t Cpu::get_addr(int adm)
             uint16_t hval = mem->get((adr + 1) & 0xff);
             uint32_t radr = mem->get(adr) | (hval << 8);
             uint32_t aaa  = radr + y;
-            uint32_t bbb  = (aaa >> 8);
-            if ((radr >> 8) < (bbb) >> 8) {
-                cpuclock += 1;
+            if ((radr >> 8) != (aaa >> 8)) {
+                cycles += 1;
             }
             return ((radr + y) & 0xffff);
         } break;
@@ -246,7 +1072,7 @@ uint16_t Cpu::get_addr(int adm)
             uint16_t val = mem->get(pc++);
             adr |= val << 8;
             if (adr >> 8 < (adr + x) >> 8) {
-                cpuclock += 1;
+                cycles += 1;
             }
             return (adr + x) & 0xffff;
         } break;
@@ -261,7 +1087,7 @@ uint16_t Cpu::get_addr(int adm)
             uint16_t val = mem->get(pc++);
             adr |= val << 8;
             if (adr >> 8 < (adr + y) >> 8) {
-                cpuclock += 1;
+                cycles += 1;
             }
             return (adr + y) & 0xffff;
         } break;
@@ -269,20 +1095,36 @@ uint16_t Cpu::get_addr(int adm)
             uint16_t adrl = mem->get(pc++);
             uint16_t adrh = mem->get(pc++);
             uint16_t radr = mem->get(adrl | (adrh << 8));
-            uint16_t val  = mem->get(((adrl + 1) & 0xff) | (adrh << 8));
+            uint16_t val;
+            if constexpr (V == CPU_CMOS) {
+                val = mem->get((uint16_t)((adrl | (adrh << 8)) + 1));
+            } else {
+                val = mem->get(((adrl + 1) & 0xff) | (adrh << 8));
+            }
             radr |= val << 8;
             return radr;
         } break;
         case REL: {
             return mem->get(pc++);
         } break;
+        case IZP: {
+            uint16_t adr = mem->get(pc++);
+            uint16_t val = mem->get((adr + 1) & 0xff);
+            return mem->get(adr) | (val << 8);
+        } break;
+        case IAX: {
+            uint16_t adr = mem->get(pc++);
+            uint16_t val = mem->get(pc++);
+            adr          = (adr | (val << 8)) + x;
+            return mem->get(adr) | (mem->get((uint16_t)(adr + 1)) << 8);
+        } break;
 
         default:
             printf("unimplemented addr");
     }
     return 0;
 }
-void Cpu::exe_instruction(size_t opint, uint16_t addr)
+template <CpuVariant V> void Cpu::exe_instruction(size_t opint, uint16_t addr)
 {
     switch (opint) {
         case UNI: {
@@ -302,7 +1144,15 @@ void Cpu::exe_instruction(size_t opint, uint16_t addr)
             set_zero_and_ng(a);
         } break;
         case ADC: {
-            uint16_t value  = mem->get(addr);
+            uint16_t value = mem->get(addr);
+            if (decimal) {
+                set_bcd_result(Bcd::adc(a, value, carry));
+                if constexpr (V == CPU_CMOS) {
+                    set_zero_and_ng(a);
+                    cycles += 1;
+                }
+                break;
+            }
             uint16_t result = a + value + (carry ? 1 : 0);
             carry           = result > 0xff;
             overflow        = (a & 0x80) == (value & 0x80) && (value & 0x80) != (result & 0x80);
@@ -310,7 +1160,15 @@ void Cpu::exe_instruction(size_t opint, uint16_t addr)
             set_zero_and_ng(a);
         } break;
         case SBC: {
-            uint16_t value  = mem->get(addr) ^ 0xff;
+            uint16_t value = mem->get(addr) ^ 0xff;
+            if (decimal) {
+                set_bcd_result(Bcd::sbc(a, value ^ 0xff, carry));
+                if constexpr (V == CPU_CMOS) {
+                    set_zero_and_ng(a);
+                    cycles += 1;
+                }
+                break;
+            }
             uint16_t result = a + value + (carry ? 1 : 0);
             carry           = result > 0xff;
             overflow        = (a & 0x80) == (value & 0x80) && (value & 0x80) != (result & 0x80);
@@ -541,7 +1399,9 @@ void Cpu::exe_instruction(size_t opint, uint16_t addr)
             mem->set(adr3, data);
 
             interrupt = true;
-            pc        = mem->get(0xfffe) | ((mem->get(0xffff)) << 8);
+            if constexpr (V == CPU_CMOS)
+                decimal = false;
+            pc = mem->get(0xfffe) | ((mem->get(0xffff)) << 8);
         } break;
         case RTI: {
             ++sp;
@@ -619,20 +1479,22 @@ void Cpu::exe_instruction(size_t opint, uint16_t addr)
         case IRQ: {
             uint16_t pushpc = pc;
 
-            uint16_t adr  = 0x100 + sp++;
+            uint16_t adr  = 0x100 + sp--;
             uint16_t data = pushpc >> 8;
             mem->set(adr, data);
 
-            uint16_t adr2  = 0x100 + sp++;
+            uint16_t adr2  = 0x100 + sp--;
             uint16_t data2 = pushpc & 0xff;
             mem->set(adr2, data2);
 
-            uint16_t adr3  = 0x100 + sp++;
+            uint16_t adr3  = 0x100 + sp--;
             uint16_t data3 = getp(false);
             mem->set(adr3, data3);
 
             interrupt = true;
-            pc        = mem->get(0xfffe) | ((mem->get(0xffff)) << 8);
+            if constexpr (V == CPU_CMOS)
+                decimal = false;
+            pc = mem->get(0xfffe) | ((mem->get(0xffff)) << 8);
         } break;
         case NMI: {
             uint16_t pushpc = pc;
@@ -650,7 +1512,9 @@ void Cpu::exe_instruction(size_t opint, uint16_t addr)
             mem->set(adr3, data3);
 
             interrupt = true;
-            pc        = mem->get(0xfffa) | ((mem->get(0xfffb)) << 8);
+            if constexpr (V == CPU_CMOS)
+                decimal = false;
+            pc = mem->get(0xfffa) | ((mem->get(0xfffb)) << 8);
         } break;
         // undocumented opcodes
         case KIL: {
@@ -687,6 +1551,10 @@ void Cpu::exe_instruction(size_t opint, uint16_t addr)
             uint16_t _carry = value & 0x1;
             uint16_t result = (value >> 1) | ((carry ? 1 : 0) << 7);
             mem->set(addr, result);
+            if (decimal) {
+                set_bcd_result(Bcd::adc(a, result, _carry));
+                break;
+            }
             uint16_t data = a + result + _carry;
             carry         = data > 0xff;
             overflow      = (a & 0x80) == (result & 0x80) && (result & 0x80) != (data & 0x80);
@@ -724,6 +1592,10 @@ void Cpu::exe_instruction(size_t opint, uint16_t addr)
             }
             uint16_t value = dat & 0xff;
             mem->set(addr, value);
+            if (decimal) {
+                set_bcd_result(Bcd::sbc(a, value, carry));
+                break;
+            }
             value ^= 0xff;
 
             uint16_t result = a + value + (carry ? 1 : 0);
@@ -763,6 +1635,48 @@ void Cpu::exe_instruction(size_t opint, uint16_t addr)
             x               = result;
             set_zero_and_ng(x);
         } break;
+        // 65C02
+        case BRA: {
+            doBranch(true, addr);
+        } break;
+        case PHX: {
+            mem->set(0x100 + sp--, x);
+        } break;
+        case PHY: {
+            mem->set(0x100 + sp--, y);
+        } break;
+        case PLX: {
+            x = mem->get(0x100 + ++sp);
+            set_zero_and_ng(x);
+        } break;
+        case PLY: {
+            y = mem->get(0x100 + ++sp);
+            set_zero_and_ng(y);
+        } break;
+        case STZ: {
+            mem->set(addr, 0);
+        } break;
+        case TSB: {
+            uint8_t value = mem->get(addr);
+            zero          = (a & value) == 0;
+            mem->set(addr, value | a);
+        } break;
+        case TRB: {
+            uint8_t value = mem->get(addr);
+            zero          = (a & value) == 0;
+            mem->set(addr, value & ~a);
+        } break;
+        case BITI: {
+            zero = (a & mem->get(addr)) == 0;
+        } break;
+        case INCA: {
+            a += 1;
+            set_zero_and_ng(a);
+        } break;
+        case DECA: {
+            a -= 1;
+            set_zero_and_ng(a);
+        } break;
         default:
             printf("unimplemented opcode");
             exit(1);
@@ -774,6 +1688,14 @@ void Cpu::set_zero_and_ng(uint8_t rval)
     zero     = val == 0;
     negative = val > 0x7f;
 }
+void Cpu::set_bcd_result(const BcdResult &r)
+{
+    a        = r.value;
+    negative = r.flags & BCD_N;
+    overflow = r.flags & BCD_V;
+    zero     = r.flags & BCD_Z;
+    carry    = r.flags & BCD_C;
+}
 void Cpu::setp(uint8_t value)
 {
     negative  = (value & 0x80) > 0;
@@ -799,7 +1721,7 @@ uint8_t Cpu::getp(bool bFlag)
 void Cpu::doBranch(bool test, uint16_t reladr)
 {
     if (test) {
-        cpuclock += 1;
+        cycles += 1;
 
         uint16_t u8val  = reladr;
         uint32_t relval = 0;
@@ -813,273 +1735,90 @@ void Cpu::doBranch(bool test, uint16_t reladr)
         }
 
         if (pc >> 8 != adr >> 8) {
-            cpuclock += 1;
+            cycles += 1;
+        }
+        if (adr < pc && idle_skip) {
+            idle_loop(adr);
         }
         pc = adr;
     }
 }
-void Cpu::create_opcode(size_t opcode, size_t opint, string hex, string op, size_t adm, size_t cycle)
+// Called on every taken backward branch. A loop whose iteration came back
+// to the same registers without writing memory or touching volatile I/O
+// will spin identically until an interrupt or the end of the frame, so the
+// whole iterations that fit before then are skipped and only their cycles
+// and instruction counts are charged. Counter loops (DEX/DEY/INX/INY or
+// SBC #1 followed by BNE) are fast-forwarded arithmetically.
+void Cpu::idle_loop(uint16_t head)
 {
-    opcodes[opint] = Opcode{.opcode = opcode, .opint = opint, .hex = hex, .op = op, .adm = adm, .cycle = cycle};
+    int avail = frame_left - (2 + cycles) - 1;
+    if (events.next != SIZE_MAX && (int64_t)(events.next - totalcycle) < frame_left)
+        avail = events.next - totalcycle - (2 + cycles) - 1;
+    if (avail <= 0 || (pending != 0 && !(pending == INT_IRQ && interrupt)))
+        return;
+    if (counter_loop(head, avail))
+        return;
+
+    uint8_t p       = getp(false);
+    size_t  skipped = 0;
+    if (idle.valid && idle.head == head && idle.writes == mem->writes && idle.io_reads == mem->io_reads &&
+        idle.a == a && idle.x == x && idle.y == y && idle.sp == sp && idle.p == p) {
+        size_t iter = totalcycle - idle.cycle;
+        size_t k    = avail / iter;
+        skipped     = k * iter;
+        cycles += skipped;
+        steps += k * (steps - idle.steps);
+        idle_cycles += skipped;
+    }
+    idle = IdleLoop{true, head, a, x, y, sp, p, mem->writes, mem->io_reads, totalcycle + skipped, steps};
 }
-void Cpu::create_opcodes()
+bool Cpu::counter_loop(uint16_t head, int avail)
 {
-    create_opcode(BRK, 0, "0", "BRK", IMP, 7);
-    create_opcode(ORA, 1, "1", "ORA", IZX, 6);
-    create_opcode(KIL, 2, "2", "KIL", IMP, 2);
-    create_opcode(SLO, 3, "3", "SLO", IZX, 8);
-    create_opcode(NOP, 4, "4", "NOP", ZP, 3);
-    create_opcode(ORA, 5, "5", "ORA", ZP, 3);
-    create_opcode(ASL, 6, "6", "ASL", ZP, 5);
-    create_opcode(SLO, 7, "7", "SLO", ZP, 5);
-    create_opcode(PHP, 8, "8", "PHP", IMP, 3);
-    create_opcode(ORA, 9, "9", "ORA", IMM, 2);
-    create_opcode(ASLA, 10, "a", "ASLA", IMP, 2);
-    create_opcode(ANC, 11, "b", "ANC", IMM, 2);
-    create_opcode(NOP, 12, "c", "NOP", ABS, 4);
-    create_opcode(ORA, 13, "d", "ORA", ABS, 4);
-    create_opcode(ASL, 14, "e", "ASL", ABS, 6);
-    create_opcode(SLO, 15, "f", "SLO", ABS, 6);
-    create_opcode(BPL, 16, "10", "BPL", REL, 2);
-    create_opcode(ORA, 17, "11", "ORA", IZYr, 5);
-    create_opcode(KIL, 18, "12", "KIL", IMP, 2);
-    create_opcode(SLO, 19, "13", "SLO", IZY, 8);
-    create_opcode(NOP, 20, "14", "NOP", ZPX, 4);
-    create_opcode(ORA, 21, "15", "ORA", ZPX, 4);
-    create_opcode(ASL, 22, "16", "ASL", ZPX, 6);
-    create_opcode(SLO, 23, "17", "SLO", ZPX, 6);
-    create_opcode(CLC, 24, "18", "CLC", IMP, 2);
-    create_opcode(ORA, 25, "19", "ORA", ABYr, 4);
-    create_opcode(NOP, 26, "1a", "NOP", IMP, 2);
-    create_opcode(SLO, 27, "1b", "SLO", ABY, 7);
-    create_opcode(NOP, 28, "1c", "NOP", ABXr, 4);
-    create_opcode(ORA, 29, "1d", "ORA", ABXr, 4);
-    create_opcode(ASL, 30, "1e", "ASL", ABX, 7);
-    create_opcode(SLO, 31, "1f", "SLO", ABX, 7);
-    create_opcode(JSR, 32, "20", "JSR", ABS, 6);
-    create_opcode(AND, 33, "21", "AND", IZX, 6);
-    create_opcode(KIL, 34, "22", "KIL", IMP, 2);
-    create_opcode(RLA, 35, "23", "RLA", IZX, 8);
-    create_opcode(BIT, 36, "24", "BIT", ZP, 3);
-    create_opcode(AND, 37, "25", "AND", ZP, 3);
-    create_opcode(ROL, 38, "26", "ROL", ZP, 5);
-    create_opcode(RLA, 39, "27", "RLA", ZP, 5);
-    create_opcode(PLP, 40, "28", "PLP", IMP, 4);
-    create_opcode(AND, 41, "29", "AND", IMM, 2);
-    create_opcode(ROLA, 42, "2a", "ROLA", IMP, 2);
-    create_opcode(ANC, 43, "2b", "ANC", IMM, 2);
-    create_opcode(BIT, 44, "2c", "BIT", ABS, 4);
-    create_opcode(AND, 45, "2d", "AND", ABS, 4);
-    create_opcode(ROL, 46, "2e", "ROL", ABS, 6);
-    create_opcode(RLA, 47, "2f", "RLA", ABS, 6);
-    create_opcode(BMI, 48, "30", "BMI", REL, 2);
-    create_opcode(AND, 49, "31", "AND", IZYr, 5);
-    create_opcode(KIL, 50, "32", "KIL", IMP, 2);
-    create_opcode(RLA, 51, "33", "RLA", IZY, 8);
-    create_opcode(NOP, 52, "34", "NOP", ZPX, 4);
-    create_opcode(AND, 53, "35", "AND", ZPX, 4);
-    create_opcode(ROL, 54, "36", "ROL", ZPX, 6);
-    create_opcode(RLA, 55, "37", "RLA", ZPX, 6);
-    create_opcode(SEC, 56, "38", "SEC", IMP, 2);
-    create_opcode(AND, 57, "39", "AND", ABYr, 4);
-    create_opcode(NOP, 58, "3a", "NOP", IMP, 2);
-    create_opcode(RLA, 59, "3b", "RLA", ABY, 7);
-    create_opcode(NOP, 60, "3c", "NOP", ABXr, 4);
-    create_opcode(AND, 61, "3d", "AND", ABXr, 4);
-    create_opcode(ROL, 62, "3e", "ROL", ABX, 7);
-    create_opcode(RLA, 63, "3f", "RLA", ABX, 7);
-    create_opcode(RTI, 64, "40", "RTI", IMP, 6);
-    create_opcode(EOR, 65, "41", "EOR", IZX, 6);
-    create_opcode(KIL, 66, "42", "KIL", IMP, 2);
-    create_opcode(SRE, 67, "43", "SRE", IZX, 8);
-    create_opcode(NOP, 68, "44", "NOP", ZP, 3);
-    create_opcode(EOR, 69, "45", "EOR", ZP, 3);
-    create_opcode(LSR, 70, "46", "LSR", ZP, 5);
-    create_opcode(SRE, 71, "47", "SRE", ZP, 5);
-    create_opcode(PHA, 72, "48", "PHA", IMP, 3);
-    create_opcode(EOR, 73, "49", "EOR", IMM, 2);
-    create_opcode(LSRA, 74, "4a", "LSRA", IMP, 2);
-    create_opcode(ALR, 75, "4b", "ALR", IMM, 2);
-    create_opcode(JMP, 76, "4c", "JMP", ABS, 3);
-    create_opcode(EOR, 77, "4d", "EOR", ABS, 4);
-    create_opcode(LSR, 78, "4e", "LSR", ABS, 6);
-    create_opcode(SRE, 79, "4f", "SRE", ABS, 6);
-    create_opcode(BVC, 80, "50", "BVC", REL, 2);
-    create_opcode(EOR, 81, "51", "EOR", IZYr, 5);
-    create_opcode(KIL, 82, "52", "KIL", IMP, 2);
-    create_opcode(SRE, 83, "53", "SRE", IZY, 8);
-    create_opcode(NOP, 84, "54", "NOP", ZPX, 4);
-    create_opcode(EOR, 85, "55", "EOR", ZPX, 4);
-    create_opcode(LSR, 86, "56", "LSR", ZPX, 6);
-    create_opcode(SRE, 87, "57", "SRE", ZPX, 6);
-    create_opcode(CLI, 88, "58", "CLI", IMP, 2);
-    create_opcode(EOR, 89, "59", "EOR", ABYr, 4);
-    create_opcode(NOP, 90, "5a", "NOP", IMP, 2);
-    create_opcode(SRE, 91, "5b", "SRE", ABY, 7);
-    create_opcode(NOP, 92, "5c", "NOP", ABXr, 4);
-    create_opcode(EOR, 93, "5d", "EOR", ABXr, 4);
-    create_opcode(LSR, 94, "5e", "LSR", ABX, 7);
-    create_opcode(SRE, 95, "5f", "SRE", ABX, 7);
-    create_opcode(RTS, 96, "60", "RTS", IMP, 6);
-    create_opcode(ADC, 97, "61", "ADC", IZX, 6);
-    create_opcode(KIL, 98, "62", "KIL", IMP, 2);
-    create_opcode(RRA, 99, "63", "RRA", IZX, 8);
-    create_opcode(NOP, 100, "64", "NOP", ZP, 3);
-    create_opcode(ADC, 101, "65", "ADC", ZP, 3);
-    create_opcode(ROR, 102, "66", "ROR", ZP, 5);
-    create_opcode(RRA, 103, "67", "RRA", ZP, 5);
-    create_opcode(PLA, 104, "68", "PLA", IMP, 4);
-    create_opcode(ADC, 105, "69", "ADC", IMM, 2);
-    create_opcode(RORA, 106, "6a", "RORA", IMP, 2);
-    create_opcode(ARR, 107, "6b", "ARR", IMM, 2);
-    create_opcode(JMP, 108, "6c", "JMP", IND, 5);
-    create_opcode(ADC, 109, "6d", "ADC", ABS, 4);
-    create_opcode(ROR, 110, "6e", "ROR", ABS, 6);
-    create_opcode(RRA, 111, "6f", "RRA", ABS, 6);
-    create_opcode(BVS, 112, "70", "BVS", REL, 2);
-    create_opcode(ADC, 113, "71", "ADC", IZYr, 5);
-    create_opcode(KIL, 114, "72", "KIL", IMP, 2);
-    create_opcode(RRA, 115, "73", "RRA", IZY, 8);
-    create_opcode(NOP, 116, "74", "NOP", ZPX, 4);
-    create_opcode(ADC, 117, "75", "ADC", ZPX, 4);
-    create_opcode(ROR, 118, "76", "ROR", ZPX, 6);
-    create_opcode(RRA, 119, "77", "RRA", ZPX, 6);
-    create_opcode(SEI, 120, "78", "SEI", IMP, 2);
-    create_opcode(ADC, 121, "79", "ADC", ABYr, 4);
-    create_opcode(NOP, 122, "7a", "NOP", IMP, 2);
-    create_opcode(RRA, 123, "7b", "RRA", ABY, 7);
-    create_opcode(NOP, 124, "7c", "NOP", ABXr, 4);
-    create_opcode(ADC, 125, "7d", "ADC", ABXr, 4);
-    create_opcode(ROR, 126, "7e", "ROR", ABX, 7);
-    create_opcode(RRA, 127, "7f", "RRA", ABX, 7);
-    create_opcode(NOP, 128, "80", "NOP", IMM, 2);
-    create_opcode(STA, 129, "81", "STA", IZX, 6);
-    create_opcode(NOP, 130, "82", "NOP", IMM, 2);
-    create_opcode(SAX, 131, "83", "SAX", IZX, 6);
-    create_opcode(STY, 132, "84", "STY", ZP, 3);
-    create_opcode(STA, 133, "85", "STA", ZP, 3);
-    create_opcode(STX, 134, "86", "STX", ZP, 3);
-    create_opcode(SAX, 135, "87", "SAX", ZP, 3);
-    create_opcode(DEY, 136, "88", "DEY", IMP, 2);
-    create_opcode(NOP, 137, "89", "NOP", IMM, 2);
-    create_opcode(TXA, 138, "8a", "TXA", IMP, 2);
-    create_opcode(UNI, 139, "8b", "UNI", IMM, 2);
-    create_opcode(STY, 140, "8c", "STY", ABS, 4);
-    create_opcode(STA, 141, "8d", "STA", ABS, 4);
-    create_opcode(STX, 142, "8e", "STX", ABS, 4);
-    create_opcode(SAX, 143, "8f", "SAX", ABS, 4);
-    create_opcode(BCC, 144, "90", "BCC", REL, 2);
-    create_opcode(STA, 145, "91", "STA", IZY, 6);
-    create_opcode(KIL, 146, "92", "KIL", IMP, 2);
-    create_opcode(UNI, 147, "93", "UNI", IZY, 6);
-    create_opcode(STY, 148, "94", "STY", ZPX, 4);
-    create_opcode(STA, 149, "95", "STA", ZPX, 4);
-    create_opcode(STX, 150, "96", "STX", ZPY, 4);
-    create_opcode(SAX, 151, "97", "SAX", ZPY, 4);
-    create_opcode(TYA, 152, "98", "TYA", IMP, 2);
-    create_opcode(STA, 153, "99", "STA", ABY, 5);
-    create_opcode(TXS, 154, "9a", "TXS", IMP, 2);
-    create_opcode(UNI, 155, "9b", "UNI", ABY, 5);
-    create_opcode(UNI, 156, "9c", "UNI", ABX, 5);
-    create_opcode(STA, 157, "9d", "STA", ABX, 5);
-    create_opcode(UNI, 158, "9e", "UNI", ABY, 5);
-    create_opcode(UNI, 159, "9f", "UNI", ABY, 5);
-    create_opcode(LDY, 160, "a0", "LDY", IMM, 2);
-    create_opcode(LDA, 161, "a1", "LDA", IZX, 6);
-    create_opcode(LDX, 162, "a2", "LDX", IMM, 2);
-    create_opcode(LAX, 163, "a3", "LAX", IZX, 6);
-    create_opcode(LDY, 164, "a4", "LDY", ZP, 3);
-    create_opcode(LDA, 165, "a5", "LDA", ZP, 3);
-    create_opcode(LDX, 166, "a6", "LDX", ZP, 3);
-    create_opcode(LAX, 167, "a7", "LAX", ZP, 3);
-    create_opcode(TAY, 168, "a8", "TAY", IMP, 2);
-    create_opcode(LDA, 169, "a9", "LDA", IMM, 2);
-    create_opcode(TAX, 170, "aa", "TAX", IMP, 2);
-    create_opcode(UNI, 171, "ab", "UNI", IMM, 2);
-    create_opcode(LDY, 172, "ac", "LDY", ABS, 4);
-    create_opcode(LDA, 173, "ad", "LDA", ABS, 4);
-    create_opcode(LDX, 174, "ae", "LDX", ABS, 4);
-    create_opcode(LAX, 175, "af", "LAX", ABS, 4);
-    create_opcode(BCS, 176, "b0", "BCS", REL, 2);
-    create_opcode(LDA, 177, "b1", "LDA", IZYr, 5);
-    create_opcode(KIL, 178, "b2", "KIL", IMP, 2);
-    create_opcode(LAX, 179, "b3", "LAX", IZYr, 5);
-    create_opcode(LDY, 180, "b4", "LDY", ZPX, 4);
-    create_opcode(LDA, 181, "b5", "LDA", ZPX, 4);
-    create_opcode(LDX, 182, "b6", "LDX", ZPY, 4);
-    create_opcode(LAX, 183, "b7", "LAX", ZPY, 4);
-    create_opcode(CLV, 184, "b8", "CLV", IMP, 2);
-    create_opcode(LDA, 185, "b9", "LDA", ABYr, 4);
-    create_opcode(TSX, 186, "ba", "TSX", IMP, 2);
-    create_opcode(UNI, 187, "bb", "UNI", ABYr, 4);
-    create_opcode(LDY, 188, "bc", "LDY", ABXr, 4);
-    create_opcode(LDA, 189, "bd", "LDA", ABXr, 4);
-    create_opcode(LDX, 190, "be", "LDX", ABYr, 4);
-    create_opcode(LAX, 191, "bf", "LAX", ABYr, 4);
-    create_opcode(CPY, 192, "c0", "CPY", IMM, 2);
-    create_opcode(CMP, 193, "c1", "CMP", IZX, 6);
-    create_opcode(NOP, 194, "c2", "NOP", IMM, 2);
-    create_opcode(DCP, 195, "c3", "DCP", IZX, 8);
-    create_opcode(CPY, 196, "c4", "CPY", ZP, 3);
-    create_opcode(CMP, 197, "c5", "CMP", ZP, 3);
-    create_opcode(DEC, 198, "c6", "DEC", ZP, 5);
-    create_opcode(DCP, 199, "c7", "DCP", ZP, 5);
-    create_opcode(INY, 200, "c8", "INY", IMP, 2);
-    create_opcode(CMP, 201, "c9", "CMP", IMM, 2);
-    create_opcode(DEX, 202, "ca", "DEX", IMP, 2);
-    create_opcode(AXS, 203, "cb", "AXS", IMM, 2);
-    create_opcode(CPY, 204, "cc", "CPY", ABS, 4);
-    create_opcode(CMP, 205, "cd", "CMP", ABS, 4);
-    create_opcode(DEC, 206, "ce", "DEC", ABS, 6);
-    create_opcode(DCP, 207, "cf", "DCP", ABS, 6);
-    create_opcode(BNE, 208, "d0", "BNE", REL, 2);
-    create_opcode(CMP, 209, "d1", "CMP", IZYr, 5);
-    create_opcode(KIL, 210, "d2", "KIL", IMP, 2);
-    create_opcode(DCP, 211, "d3", "DCP", IZY, 8);
-    create_opcode(NOP, 212, "d4", "NOP", ZPX, 4);
-    create_opcode(CMP, 213, "d5", "CMP", ZPX, 4);
-    create_opcode(DEC, 214, "d6", "DEC", ZPX, 6);
-    create_opcode(DCP, 215, "d7", "DCP", ZPX, 6);
-    create_opcode(CLD, 216, "d8", "CLD", IMP, 2);
-    create_opcode(CMP, 217, "d9", "CMP", ABYr, 4);
-    create_opcode(NOP, 218, "da", "NOP", IMP, 2);
-    create_opcode(DCP, 219, "db", "DCP", ABY, 7);
-    create_opcode(NOP, 220, "dc", "NOP", ABXr, 4);
-    create_opcode(CMP, 221, "dd", "CMP", ABXr, 4);
-    create_opcode(DEC, 222, "de", "DEC", ABX, 7);
-    create_opcode(DCP, 223, "df", "DCP", ABX, 7);
-    create_opcode(CPX, 224, "e0", "CPX", IMM, 2);
-    create_opcode(SBC, 225, "e1", "SBC", IZX, 6);
-    create_opcode(NOP, 226, "e2", "NOP", IMM, 2);
-    create_opcode(ISC, 227, "e3", "ISC", IZX, 8);
-    create_opcode(CPX, 228, "e4", "CPX", ZP, 3);
-    create_opcode(SBC, 229, "e5", "SBC", ZP, 3);
-    create_opcode(INC, 230, "e6", "INC", ZP, 5);
-    create_opcode(ISC, 231, "e7", "ISC", ZP, 5);
-    create_opcode(INX, 232, "e8", "INX", IMP, 2);
-    create_opcode(SBC, 233, "e9", "SBC", IMM, 2);
-    create_opcode(NOP, 234, "ea", "NOP", IMP, 2);
-    create_opcode(SBC, 235, "eb", "SBC", IMM, 2);
-    create_opcode(CPX, 236, "ec", "CPX", ABS, 4);
-    create_opcode(SBC, 237, "ed", "SBC", ABS, 4);
-    create_opcode(INC, 238, "ee", "INC", ABS, 6);
-    create_opcode(ISC, 239, "ef", "ISC", ABS, 6);
-    create_opcode(BEQ, 240, "f0", "BEQ", REL, 2);
-    create_opcode(SBC, 241, "f1", "SBC", IZYr, 5);
-    create_opcode(KIL, 242, "f2", "KIL", IMP, 2);
-    create_opcode(ISC, 243, "f3", "ISC", IZY, 8);
-    create_opcode(NOP, 244, "f4", "NOP", ZPX, 4);
-    create_opcode(SBC, 245, "f5", "SBC", ZPX, 4);
-    create_opcode(INC, 246, "f6", "INC", ZPX, 6);
-    create_opcode(ISC, 247, "f7", "ISC", ZPX, 6);
-    create_opcode(SED, 248, "f8", "SED", IMP, 2);
-    create_opcode(SBC, 249, "f9", "SBC", ABYr, 4);
-    create_opcode(NOP, 250, "fa", "NOP", IMP, 2);
-    create_opcode(ISC, 251, "fb", "ISC", ABY, 7);
-    create_opcode(NOP, 252, "fc", "NOP", ABXr, 4);
-    create_opcode(SBC, 253, "fd", "SBC", ABXr, 4);
-    create_opcode(INC, 254, "fe", "INC", ABX, 7);
-    create_opcode(ISC, 255, "ff", "ISC", ABX, 7);
-    create_opcode(NMI, 256, "100", "NMI", NMI, 0);
-    create_opcode(IRQ, 257, "101", "IRQ", IRQ, 0);
-};
+    uint8_t *ram  = mem->ram;
+    int      len  = pc - head;
+    int      iter = 2 + 3 + ((pc >> 8) != (head >> 8));
+    uint8_t *reg  = nullptr;
+    int      dir  = -1;
+
+    if (len == 3) {
+        switch (ram[head]) {
+            case 0xca:
+                reg = &x;
+                break;
+            case 0x88:
+                reg = &y;
+                break;
+            case 0xe8:
+                reg = &x;
+                dir = 1;
+                break;
+            case 0xc8:
+                reg = &y;
+                dir = 1;
+                break;
+        }
+    } else if (len == 4 && ram[head] == 0xe9 && ram[head + 1] == 0x01 && carry && !decimal) {
+        reg = &a;
+    }
+    if (reg == nullptr || ram[pc - 2] != 0xd0)
+        return false;
+
+    int left = dir < 0 ? *reg - 1 : 0xff - *reg;
+    int k    = avail / iter;
+    if (k > left)
+        k = left;
+    if (k <= 0)
+        return true;
+
+    *reg += dir * k;
+    negative = *reg & 0x80;
+    if (reg == &a)
+        overflow = *reg == 0x7f;
+    cycles += k * iter;
+    steps += 2 * k;
+    idle_cycles += k * iter;
+    return true;
+}
+
+template uint16_t Cpu::get_addr<CPU_NMOS>(int adm);
+template uint16_t Cpu::get_addr<CPU_CMOS>(int adm);
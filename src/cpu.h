@@ -1,23 +1,60 @@
 #ifndef _H_CPU
 #define _H_CPU
 #include "mem.h"
+#include "bcd.h"
+#include "profiler.h"
+#include "trace.h"
+#include "metrics.h"
 #include <string>
 using namespace std;
 
+#define INT_IRQ 0x1
+#define INT_NMI 0x2
+
+enum CpuVariant
+{
+    CPU_NMOS,
+    CPU_CMOS
+};
+
 struct Opcode
 {
-    size_t opcode;
-    size_t opint;
-    string hex;
-    string op;
-    size_t adm;
-    size_t cycle;
+    size_t      opcode;
+    size_t      opint;
+    const char *hex;
+    const char *op;
+    size_t      adm;
+    size_t      cycle;
+};
+
+// Register and bus state at a backward branch, used to recognise loops that
+// return to the same state without writing memory.
+struct IdleLoop
+{
+    bool     valid;
+    uint16_t head;
+    uint8_t  a;
+    uint8_t  x;
+    uint8_t  y;
+    uint8_t  sp;
+    uint8_t  p;
+    size_t   writes;
+    size_t   io_reads;
+    size_t   cycle;
+    size_t   steps;
 };
 
 class Cpu {
+    friend class LaneCpu;
+
   public:
-    uint32_t imgdata[560 * 2 * 192]{};
-    bool     imgok = false;
+    uint32_t *imgdata = nullptr;
+    bool      imgok   = false;
+
+    // the display mode each row was last drawn in
+    uint32_t row_mode[192]{};
+    // set by draw_frame for each row it redraws, cleared by whoever copies them
+    uint8_t drawn_rows[192]{};
 
     uint8_t  a;
     uint8_t  x;
@@ -33,18 +70,37 @@ class Cpu {
     bool carry;
 
     uint8_t toirq;
+
+    uint32_t irq_lines = 0;
+    uint32_t nmi_lines = 0;
+    uint32_t pending   = 0;
+
     size_t  cpuclock;
     size_t  cycles;
     size_t  total;
 
     size_t steps;
-    size_t totalcycle;
+    size_t totalcycle = 0;
     Mem   *mem;
 
-    bool cpu_running = false;
+    bool       cpu_running = false;
+    CpuVariant variant     = CPU_NMOS;
+
+    bool   idle_skip   = true;
+    size_t idle_cycles = 0;
+    int    frame_left  = 0;
+
+    Profiler *prof    = nullptr;
+    Tracer   *tracer  = nullptr;
+    Metrics  *metrics = nullptr;
+
+    Scheduler events;
 
   private:
-    Opcode opcodes[258];
+    static const Opcode opcodes[258];
+    static const Opcode opcodes_c02[258];
+
+    IdleLoop idle{};
 
   public:
     Cpu();
@@ -54,7 +110,14 @@ class Cpu {
     void exec_nmi();
     void exec_irq();
 
+    void assert_irq(uint32_t src);
+    void release_irq(uint32_t src);
+    void assert_nmi(uint32_t src);
+    void release_nmi(uint32_t src);
+
     void step();
+    void start_frame();
+    void run_frame();
     int  run(bool cputest);
 
     void      draw_frame();
@@ -66,20 +129,36 @@ class Cpu {
     void reset();
     void clear_cpucycle();
 
-  private:
-    void create_opcode(size_t opcode, size_t opint, string hex, string op, size_t adm, size_t cycle);
-    void create_opcodes();
+    uint64_t state_hash();
 
-    uint16_t get_addr(int mode);
-    void     exe_instruction(size_t opint, uint16_t addr);
+    int           oplen(uint8_t opcode);
+    const Opcode &opcode_info(uint8_t opcode);
+    int disasm(uint16_t addr, const uint8_t *bytes, char *buf, size_t len);
+    int disasm(uint16_t addr, char *buf, size_t len);
+
+  private:
+    // The decoder is instantiated once per variant; run() and run_frame()
+    // pick the instantiation, everything below them is resolved at compile
+    // time.
+    template <CpuVariant V> int      run_variant(bool cputest);
+    template <CpuVariant V> void     check_interrupts();
+    template <CpuVariant V> uint16_t get_addr(int mode);
+    template <CpuVariant V> void     exe_instruction(size_t opint, uint16_t addr);
 
     void    set_zero_and_ng(uint8_t rval);
+    void    set_bcd_result(const BcdResult &r);
     void    setp(uint8_t value);
     uint8_t getp(bool bFlag);
     void    doBranch(bool test, uint16_t reladr);
+    void    idle_loop(uint16_t head);
+    bool    counter_loop(uint16_t head, int avail);
+
+    void draw_hires_row(int y, int page);
+    void draw_dhr_row(int y, int page);
+    void draw_text_row(int y, int page, bool lores, bool col80);
 
-    void show_state(uint16_t pc, string op, uint16_t adrm);
-    void show_test_state(uint16_t pc, string op, uint16_t adrm);
+    void show_state(uint16_t pc, const char *op, uint16_t adrm);
+    void show_test_state(uint16_t pc, const char *op, uint16_t adrm);
 };
 
 #endif
@@ -15,7 +15,9 @@ enum AddressingModes
     ABY,
     ABYr,
     IND,
-    REL
+    REL,
+    IZP,
+    IAX
 };
 
 enum CpuInstruction
@@ -95,5 +97,17 @@ enum CpuInstruction
     ANC,
     ALR,
     ARR,
-    AXS
+    AXS,
+    // 65C02
+    BRA,
+    PHX,
+    PHY,
+    PLX,
+    PLY,
+    STZ,
+    TSB,
+    TRB,
+    BITI,
+    INCA,
+    DECA
 };
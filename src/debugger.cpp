@@ -0,0 +1,278 @@
+#include "debugger.h"
+#include "cpu_enum.h"
+#include <cstdlib>
+#include <cstring>
+
+#define BIT_GET(map, addr) ((map)[(addr) >> 3] & (1 << ((addr) & 7)))
+#define BIT_SET(map, addr) ((map)[(addr) >> 3] |= 1 << ((addr) & 7))
+#define BIT_CLR(map, addr) ((map)[(addr) >> 3] &= ~(1 << ((addr) & 7)))
+
+Debugger::Debugger(Cpu *cpu)
+{
+    this->cpu = cpu;
+}
+Debugger::~Debugger()
+{
+    clear_watches();
+}
+void Debugger::set_break(uint16_t addr)
+{
+    if (!BIT_GET(breaks, addr))
+        break_count++;
+    BIT_SET(breaks, addr);
+}
+void Debugger::clear_break(uint16_t addr)
+{
+    if (BIT_GET(breaks, addr))
+        break_count--;
+    BIT_CLR(breaks, addr);
+}
+void Debugger::clear_breaks()
+{
+    memset(breaks, 0, sizeof(breaks));
+    break_count = 0;
+}
+void Debugger::set_watch(uint16_t first, uint16_t last, bool read, bool write)
+{
+    for (size_t addr = first; addr <= last; addr++) {
+        if (read)
+            BIT_SET(watch_read, addr);
+        if (write)
+            BIT_SET(watch_write, addr);
+    }
+    update_pages();
+}
+void Debugger::clear_watches()
+{
+    memset(watch_read, 0, sizeof(watch_read));
+    memset(watch_write, 0, sizeof(watch_write));
+    update_pages();
+}
+// Redirects exactly the pages holding a watched address to Mem's trap path.
+void Debugger::update_pages()
+{
+    Mem *mem    = cpu->mem;
+    watch_count = 0;
+    for (int page = 0; page < 256; page++) {
+        bool watched = false;
+        for (int i = page * 32; i < page * 32 + 32; i++)
+            watched |= (watch_read[i] | watch_write[i]) != 0;
+        if (watched) {
+            mem->trap[page] |= TRAP_WATCH;
+            watch_count++;
+        } else {
+            mem->trap[page] &= ~TRAP_WATCH;
+        }
+    }
+    mem->watch_fn  = watch_count > 0 ? on_watch : nullptr;
+    mem->watch_ctx = watch_count > 0 ? this : nullptr;
+}
+void Debugger::on_watch(void *ctx, uint16_t addr, uint8_t data, bool write)
+{
+    Debugger *dbg = (Debugger *)ctx;
+    if (!BIT_GET(write ? dbg->watch_write : dbg->watch_read, addr) || dbg->watch_hit)
+        return;
+    dbg->watch_hit = true;
+    dbg->hit_addr  = addr;
+    dbg->hit_data  = data;
+    dbg->hit_write = write;
+}
+DebugStop Debugger::step(size_t count)
+{
+    return run(SIZE_MAX, count, -1, 0);
+}
+// Runs a JSR until it returns to the next instruction with the stack back
+// where it was, so recursion does not stop early; anything else is one step.
+DebugStop Debugger::step_over()
+{
+    if (cpu->opcode_info(cpu->mem->ram[cpu->pc]).opcode != JSR)
+        return step(1);
+    return run(SIZE_MAX, SIZE_MAX, (uint16_t)(cpu->pc + 3), cpu->sp);
+}
+DebugStop Debugger::run_to_cycle(size_t cycle)
+{
+    return run(cycle, SIZE_MAX, -1, 0);
+}
+DebugStop Debugger::run_frames(size_t frames)
+{
+    return run(cpu->totalcycle + frames * 12600, SIZE_MAX, -1, 0);
+}
+// Runs until `cycle`, `count` instructions, pc == until_pc with sp ==
+// until_sp, a breakpoint or a watchpoint. With nothing to check, whole
+// frames go through Cpu::run_frame; otherwise instructions are stepped one
+// at a time with idle-loop skipping off, so no breakpoint is jumped over.
+DebugStop Debugger::run(size_t cycle, size_t count, int until_pc, uint8_t until_sp)
+{
+    bool checks = break_count > 0 || watch_count > 0 || until_pc >= 0 || count != SIZE_MAX;
+    bool idle   = cpu->idle_skip;
+    bool first  = true;
+
+    DebugStop stop = STOP_DONE;
+    watch_hit      = false;
+    if (checks)
+        cpu->idle_skip = false;
+    while (cpu->totalcycle < cycle && count > 0) {
+        if (cpu->frame_left <= 0) {
+            if (!checks && cpu->totalcycle + 12600 <= cycle) {
+                cpu->run_frame();
+                continue;
+            }
+            cpu->start_frame();
+        }
+        uint16_t pc = cpu->pc;
+        if (!first && BIT_GET(breaks, pc)) {
+            stop = STOP_BREAK;
+            break;
+        }
+        if (pc == until_pc && cpu->sp == until_sp)
+            break;
+        first = false;
+        cpu->frame_left -= cpu->run(false);
+        count--;
+        if (watch_hit) {
+            stop = STOP_WATCH;
+            break;
+        }
+    }
+    cpu->idle_skip = idle;
+    return stop;
+}
+void Debugger::show(FILE *out)
+{
+    char text[32];
+    char flags[9];
+    cpu->disasm(cpu->pc, text, sizeof(text));
+    bool bits[8] = {cpu->negative, cpu->overflow, true, false, cpu->decimal, cpu->interrupt, cpu->zero, cpu->carry};
+    for (int i = 0; i < 8; i++)
+        flags[i] = bits[i] ? "NV-BDIZC"[i] : '.';
+    flags[8] = 0;
+    fprintf(out, "%04X  %-16s A:%02X X:%02X Y:%02X SP:%02X %s  cycle %zu\n", cpu->pc, text, cpu->a, cpu->x, cpu->y,
+            cpu->sp, flags, cpu->totalcycle);
+}
+static bool parse_addr(const char *s, uint16_t *addr)
+{
+    char *end = nullptr;
+    if (*s == '$')
+        s++;
+    unsigned long v = strtoul(s, &end, 16);
+    if (end == s || v > 0xffff)
+        return false;
+    *addr = v;
+    return true;
+}
+static void help(FILE *out)
+{
+    fprintf(out, "b addr            set a breakpoint       bc [addr]    clear one or all breakpoints\n");
+    fprintf(out, "w addr[-addr] [r|w|rw]  set a watchpoint  wc           clear all watchpoints\n");
+    fprintf(out, "s [n]             step n instructions    n            step over a JSR\n");
+    fprintf(out, "c                 continue to a break    g cycle      run to a cycle\n");
+    fprintf(out, "f [n]             run n frames           r            show registers\n");
+    fprintf(out, "m addr [len]      dump memory            u [addr] [n] disassemble\n");
+    fprintf(out, "k ascii           press a key            q            quit\n");
+    fprintf(out, "addresses are hex, counts and cycles decimal\n");
+}
+// Line-oriented console: one command per line, the machine state is shown
+// after every command that runs code.
+void Debugger::repl(FILE *in, FILE *out)
+{
+    char line[256];
+    show(out);
+    for (;;) {
+        fprintf(out, "> ");
+        fflush(out);
+        if (fgets(line, sizeof(line), in) == nullptr)
+            break;
+
+        char     cmd[16]  = "";
+        char     arg1[64] = "";
+        char     arg2[64] = "";
+        int      args     = sscanf(line, "%15s %63s %63s", cmd, arg1, arg2);
+        uint16_t addr     = 0;
+        bool     ran      = true;
+
+        if (args <= 0)
+            continue;
+        DebugStop stop = STOP_DONE;
+        string    c    = cmd;
+        if (c == "q") {
+            break;
+        } else if (c == "b" && args >= 2 && parse_addr(arg1, &addr)) {
+            set_break(addr);
+            ran = false;
+        } else if (c == "bc") {
+            if (args >= 2 && parse_addr(arg1, &addr))
+                clear_break(addr);
+            else
+                clear_breaks();
+            ran = false;
+        } else if (c == "w" && args >= 2) {
+            uint16_t    last  = 0;
+            const char *dash  = strchr(arg1, '-');
+            string      mode  = args >= 3 ? arg2 : "rw";
+            bool        valid = parse_addr(arg1, &addr) && (dash == nullptr || parse_addr(dash + 1, &last));
+            if (!valid || (mode != "r" && mode != "w" && mode != "rw")) {
+                help(out);
+                continue;
+            }
+            set_watch(addr, dash != nullptr ? last : addr, mode != "w", mode != "r");
+            ran = false;
+        } else if (c == "wc") {
+            clear_watches();
+            ran = false;
+        } else if (c == "s") {
+            stop = step(args >= 2 ? strtoull(arg1, nullptr, 10) : 1);
+        } else if (c == "n") {
+            stop = step_over();
+        } else if (c == "c") {
+            if (break_count == 0 && watch_count == 0) {
+                fprintf(out, "no breakpoints or watchpoints set\n");
+                continue;
+            }
+            stop = run(SIZE_MAX, SIZE_MAX, -1, 0);
+        } else if (c == "g" && args >= 2) {
+            stop = run_to_cycle(strtoull(arg1, nullptr, 10));
+        } else if (c == "f") {
+            stop = run_frames(args >= 2 ? strtoull(arg1, nullptr, 10) : 1);
+        } else if (c == "r") {
+        } else if (c == "m" && args >= 2 && parse_addr(arg1, &addr)) {
+            size_t len = args >= 3 ? strtoull(arg2, nullptr, 10) : 64;
+            for (size_t i = 0; i < len; i++) {
+                uint16_t a = addr + i;
+                if (i % 16 == 0)
+                    fprintf(out, "%s%04X:", i > 0 ? "\n" : "", a);
+                fprintf(out, " %02X", cpu->mem->ram[a]);
+            }
+            fprintf(out, "\n");
+            continue;
+        } else if (c == "u") {
+            addr     = cpu->pc;
+            size_t n = 10;
+            if (args >= 2 && !parse_addr(arg1, &addr)) {
+                help(out);
+                continue;
+            }
+            if (args >= 3)
+                n = strtoull(arg2, nullptr, 10);
+            char text[32];
+            for (size_t i = 0; i < n; i++) {
+                int len = cpu->disasm(addr, text, sizeof(text));
+                fprintf(out, "%c%04X  %s\n", BIT_GET(breaks, addr) ? '*' : ' ', addr, text);
+                addr += len;
+            }
+            continue;
+        } else if (c == "k" && args >= 2) {
+            cpu->mem->key_down(strtoul(arg1, nullptr, 10));
+            ran = false;
+        } else {
+            help(out);
+            continue;
+        }
+
+        if (stop == STOP_BREAK)
+            fprintf(out, "breakpoint at %04X\n", cpu->pc);
+        if (stop == STOP_WATCH)
+            fprintf(out, "watchpoint: %s %04X = %02X\n", hit_write ? "write" : "read", hit_addr, hit_data);
+        if (ran)
+            show(out);
+    }
+}
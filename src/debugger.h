@@ -0,0 +1,61 @@
+#ifndef _H_DEBUGGER
+#define _H_DEBUGGER
+#include "cpu.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+enum DebugStop
+{
+    STOP_DONE,
+    STOP_BREAK,
+    STOP_WATCH
+};
+
+// Breakpoints and watchpoints that cost nothing until they are used.
+// Breakpoints are bits in a 64K map that is only consulted by the
+// debugger's own stepping loop; with none set, frames run through
+// Cpu::run_frame untouched. Watchpoints mark their pages in Mem::trap, so
+// only accesses to watched pages take the checking path, and the exact
+// addresses are then looked up in per-address bitmaps.
+class Debugger {
+  public:
+    Cpu *cpu = nullptr;
+
+    uint16_t hit_addr  = 0;
+    uint8_t  hit_data  = 0;
+    bool     hit_write = false;
+
+  private:
+    uint8_t breaks[0x10000 / 8]{};
+    uint8_t watch_read[0x10000 / 8]{};
+    uint8_t watch_write[0x10000 / 8]{};
+    size_t  break_count = 0;
+    size_t  watch_count = 0;
+    bool    watch_hit   = false;
+
+  public:
+    Debugger(Cpu *cpu);
+    ~Debugger();
+
+    void set_break(uint16_t addr);
+    void clear_break(uint16_t addr);
+    void clear_breaks();
+    void set_watch(uint16_t first, uint16_t last, bool read, bool write);
+    void clear_watches();
+
+    DebugStop step(size_t count);
+    DebugStop step_over();
+    DebugStop run_to_cycle(size_t cycle);
+    DebugStop run_frames(size_t frames);
+
+    void show(FILE *out);
+    void repl(FILE *in, FILE *out);
+
+  private:
+    DebugStop run(size_t cycle, size_t count, int until_pc, uint8_t until_sp);
+    void      update_pages();
+
+    static void on_watch(void *ctx, uint16_t addr, uint8_t data, bool write);
+};
+#endif
@@ -0,0 +1,58 @@
+#include "env.h"
+#include "batch.h"
+
+struct a2_env
+{
+    BatchEnv batch;
+};
+
+a2_env *a2_env_create(const a2_env_config *config)
+{
+    BatchConfig cfg;
+    if (config->bios != nullptr)
+        cfg.bios = config->bios;
+    cfg.prg       = config->prg != nullptr ? config->prg : "";
+    cfg.count     = config->count;
+    cfg.threads   = config->threads;
+    cfg.frameskip = config->frameskip > 0 ? config->frameskip : 1;
+    cfg.warmup    = config->warmup;
+    cfg.ram_addr  = config->ram_addr;
+    cfg.ram_len   = config->ram_len;
+    cfg.scale     = config->scale;
+    if (config->script != nullptr)
+        cfg.script = config->script;
+    if (config->cache_dir != nullptr)
+        cfg.cache_dir = config->cache_dir;
+
+    a2_env *env = new a2_env();
+    if (!env->batch.init(cfg)) {
+        delete env;
+        return nullptr;
+    }
+    return env;
+}
+void a2_env_destroy(a2_env *env)
+{
+    delete env;
+}
+size_t a2_env_ram_size(a2_env *env)
+{
+    return env->batch.ram_size();
+}
+size_t a2_env_frame_size(a2_env *env)
+{
+    return env->batch.frame_size();
+}
+void a2_env_frame_dims(a2_env *env, size_t *width, size_t *height)
+{
+    *width  = env->batch.width;
+    *height = env->batch.height;
+}
+void a2_env_step(a2_env *env, const uint8_t *actions, uint8_t *ram, uint8_t *frames)
+{
+    env->batch.step(actions, ram, frames);
+}
+void a2_env_reset(a2_env *env, const uint8_t *mask, uint8_t *ram, uint8_t *frames)
+{
+    env->batch.reset(mask, ram, frames);
+}
@@ -0,0 +1,43 @@
+#ifndef _H_ENV
+#define _H_ENV
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// C interface to BatchEnv, built as the apple2env shared library.
+typedef struct a2_env a2_env;
+
+typedef struct
+{
+    const char *bios;         // NULL = rom/Apple2e.rom
+    const char *prg;
+    size_t      count;
+    size_t      threads;      // 0 = one per hardware thread
+    size_t      frameskip;    // frames per step, 0 = 1
+    size_t      warmup;       // frames run before the reset snapshot
+    uint16_t    ram_addr;
+    size_t      ram_len;
+    size_t      scale;        // frames are 280/scale x 192/scale, 0 = none
+    const char *script;       // keys pressed during warmup, "frame:ascii,..."
+    const char *cache_dir;    // directory for the warmed-up snapshot, NULL = none
+} a2_env_config;
+
+a2_env *a2_env_create(const a2_env_config *config);
+void    a2_env_destroy(a2_env *env);
+
+size_t a2_env_ram_size(a2_env *env);
+size_t a2_env_frame_size(a2_env *env);
+void   a2_env_frame_dims(a2_env *env, size_t *width, size_t *height);
+
+// actions[count] are ASCII keys (0 = none); ram and frames may be NULL
+void a2_env_step(a2_env *env, const uint8_t *actions, uint8_t *ram, uint8_t *frames);
+// mask[count] selects the machines to reset, NULL resets all of them
+void a2_env_reset(a2_env *env, const uint8_t *mask, uint8_t *ram, uint8_t *frames);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,345 @@
+#include "fuzz.h"
+#include "cpu_enum.h"
+#include "loader.h"
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <thread>
+
+static uint64_t next_random(uint64_t &s)
+{
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return s * 0x2545f4914f6cdd1dull;
+}
+
+Fuzzer::Fuzzer()
+{
+}
+Fuzzer::~Fuzzer()
+{
+    for (auto pc : machines)
+        delete pc;
+    delete snap;
+}
+bool Fuzzer::init(const FuzzConfig &config)
+{
+    cfg = config;
+    if (cfg.frames == 0) {
+        printf("fuzz: inputs must be at least one frame\n");
+        return false;
+    }
+    if (cfg.score_addr >= 0 && (cfg.score_len == 0 || cfg.score_len > 8 || cfg.score_addr + cfg.score_len > 0x10000)) {
+        printf("fuzz: score must be 1-8 bytes inside memory\n");
+        return false;
+    }
+    for (size_t pos = 0; pos < cfg.keys.size();) {
+        size_t end   = cfg.keys.find(',', pos);
+        string item  = cfg.keys.substr(pos, end == string::npos ? string::npos : end - pos);
+        char  *last  = nullptr;
+        size_t ascii = strtoul(item.c_str(), &last, 10);
+        if (last == item.c_str() || *last != 0 || ascii == 0 || ascii > 0x7f) {
+            printf("fuzz: bad key '%s'\n", item.c_str());
+            return false;
+        }
+        alphabet.push_back(ascii);
+        pos = end == string::npos ? cfg.keys.size() : end + 1;
+    }
+    if (alphabet.empty()) {
+        printf("fuzz: no keys to press\n");
+        return false;
+    }
+
+    PC *boot = new PC();
+    boot->cpu->init();
+    if (!boot->load_bios(cfg.bios) || !boot->load_prg(cfg.prg) ||
+        !boot->warm_boot(cfg.cache_dir, cfg.warmup, cfg.script)) {
+        delete boot;
+        return false;
+    }
+    snap = Snapshot::take(boot->cpu);
+    machines.push_back(boot);
+
+    size_t threads = cfg.threads > 0 ? cfg.threads : std::thread::hardware_concurrency();
+    cfg.threads    = threads > 0 ? threads : 1;
+    for (size_t i = 1; i < cfg.threads; i++) {
+        PC *pc = new PC();
+        pc->cpu->init();
+        if (!pc->load_bios(cfg.bios) || !pc->load_prg(cfg.prg)) {
+            delete pc;
+            return false;
+        }
+        machines.push_back(pc);
+    }
+
+    if (!cfg.out_dir.empty()) {
+        mkdir(cfg.out_dir.c_str(), 0755);
+        mkdir((cfg.out_dir + "/corpus").c_str(), 0755);
+        mkdir((cfg.out_dir + "/crashes").c_str(), 0755);
+        load_corpus();
+    }
+    return true;
+}
+PC *Fuzzer::machine(size_t i)
+{
+    return machines[i];
+}
+const char *Fuzzer::crash_name(FuzzCrash crash)
+{
+    switch (crash) {
+        case FUZZ_NONE:
+            return "none";
+        case FUZZ_KIL:
+            return "kil";
+        case FUZZ_UNI:
+            return "uni";
+        case FUZZ_STACK:
+            return "stack";
+        case FUZZ_IO:
+            return "io";
+    }
+    return "?";
+}
+// An input file is the key of each frame, one byte per frame, 0 for none.
+bool Fuzzer::load_input(const string &path, vector<uint8_t> &keys)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+        printf("fuzz: cannot open %s\n", path.c_str());
+        return false;
+    }
+    keys.clear();
+    uint8_t buf[4096];
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;)
+        keys.insert(keys.end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+bool Fuzzer::save_input(const string &path, const vector<uint8_t> &keys)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    if (f == nullptr) {
+        printf("fuzz: cannot write %s\n", path.c_str());
+        return false;
+    }
+    bool ok = fwrite(keys.data(), 1, keys.size(), f) == keys.size();
+    if (fclose(f) != 0 || !ok) {
+        printf("fuzz: cannot write %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+// Inputs from an earlier session; run() replays them to rebuild the
+// coverage before mutating.
+void Fuzzer::load_corpus()
+{
+    string dir = cfg.out_dir + "/corpus";
+    DIR   *d   = opendir(dir.c_str());
+    if (d == nullptr)
+        return;
+    for (struct dirent *e; (e = readdir(d)) != nullptr;) {
+        string name = e->d_name;
+        if (name.size() < 6 || name.compare(name.size() - 5, 5, ".keys") != 0)
+            continue;
+        FuzzInput in;
+        if (load_input(dir + "/" + name, in.keys)) {
+            in.keys.resize(cfg.frames);
+            corpus.push_back(in);
+        }
+    }
+    closedir(d);
+}
+// Runs one input from the start snapshot, recording every PC about to
+// execute in cov[0x10000]. Each instruction is checked before it runs for
+// a PC in the soft switches and for KIL or unimplemented opcodes, and after
+// it runs for S wrapping around (TXS excepted).
+FuzzResult Fuzzer::execute(PC *pc, const vector<uint8_t> &keys, uint8_t *cov)
+{
+    Cpu *cpu = pc->cpu;
+    Mem *mem = cpu->mem;
+    snap->restore(cpu);
+    memset(cov, 0, 0x10000);
+
+    FuzzResult r;
+    size_t     f = 0;
+    for (; f < keys.size() && r.crash == FUZZ_NONE; f++) {
+        if (keys[f] != 0)
+            pc->key_down(keys[f]);
+        cpu->start_frame();
+        while (cpu->frame_left > 0) {
+            uint16_t at = cpu->pc;
+            uint8_t  op = mem->ram[at];
+            uint8_t  sp = cpu->sp;
+            size_t   in = cpu->opcode_info(op).opcode;
+            cov[at]     = 1;
+            if (at >= 0xc000 && at < 0xc100) {
+                r.crash = FUZZ_IO;
+            } else if (in == KIL) {
+                r.crash = FUZZ_KIL;
+            } else if (in == UNI) {
+                r.crash = FUZZ_UNI;
+            } else {
+                cpu->frame_left -= cpu->run(false);
+                int moved = cpu->sp - sp;
+                if (op != 0x9a && (moved > 0x80 || moved < -0x80))
+                    r.crash = FUZZ_STACK;
+            }
+            if (r.crash != FUZZ_NONE) {
+                r.pc = at;
+                break;
+            }
+        }
+        if (cfg.score_addr >= 0) {
+            uint64_t v = 0;
+            for (size_t k = 0; k < cfg.score_len; k++)
+                v = v << 8 | mem->ram[cfg.score_addr + k];
+            r.score = v > r.score ? v : r.score;
+        }
+    }
+    r.frame = r.crash != FUZZ_NONE ? f - 1 : f;
+    for (size_t i = 0; i < 0x10000; i++)
+        r.coverage += cov[i];
+    return r;
+}
+// Merges the coverage of a finished input and keeps the input if it found a
+// new PC or a higher score, or crashed in a way not seen before. Returns
+// whether it was kept.
+bool Fuzzer::submit(const vector<uint8_t> &keys, const FuzzResult &r, const uint8_t *cov)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    size_t                      fresh = 0;
+    for (size_t i = 0; i < 0x10000; i += 8) {
+        uint64_t c, s;
+        memcpy(&c, cov + i, 8);
+        memcpy(&s, seen + i, 8);
+        if ((c & ~s) == 0)
+            continue;
+        for (size_t k = i; k < i + 8; k++) {
+            fresh += cov[k] & ~seen[k] & 1;
+            seen[k] |= cov[k];
+        }
+    }
+    covered += fresh;
+    bool better = cfg.score_addr >= 0 && r.score > best_score;
+    if (better)
+        best_score = r.score;
+
+    char name[64];
+    if (r.crash != FUZZ_NONE) {
+        for (auto &c : crashes) {
+            if (c.result.crash == r.crash && c.result.pc == r.pc)
+                return false;
+        }
+        crashes.push_back(FuzzInput{keys, r});
+        snprintf(name, sizeof(name), "/crashes/%s-%04x.keys", crash_name(r.crash), r.pc);
+    } else if (fresh > 0 || better) {
+        corpus.push_back(FuzzInput{keys, r});
+        snprintf(name, sizeof(name), "/corpus/%016llx.keys",
+                 (unsigned long long)Loader::hash(keys.data(), keys.size()));
+    } else {
+        return false;
+    }
+    if (!cfg.out_dir.empty())
+        save_input(cfg.out_dir + name, keys);
+    return true;
+}
+// Between one and eight edits: press a key, release one, hold a key for a
+// run of frames, splice in frames of another corpus entry, or shift the
+// tail of the input by a frame either way.
+void Fuzzer::mutate(vector<uint8_t> &keys, const vector<uint8_t> &donor, uint64_t &rng)
+{
+    size_t n     = keys.size();
+    int    edits = 1 + next_random(rng) % 8;
+    for (int e = 0; e < edits; e++) {
+        size_t at  = next_random(rng) % n;
+        size_t len = 1 + next_random(rng) % (n - at < 32 ? n - at : 32);
+        switch (next_random(rng) % 5) {
+            case 0:
+                keys[at] = alphabet[next_random(rng) % alphabet.size()];
+                break;
+            case 1:
+                keys[at] = 0;
+                break;
+            case 2:
+                memset(&keys[at], alphabet[next_random(rng) % alphabet.size()], len);
+                break;
+            case 3:
+                memcpy(&keys[at], &donor[at], len);
+                break;
+            case 4:
+                if (next_random(rng) & 1) {
+                    memmove(&keys[at + 1], &keys[at], n - at - 1);
+                    keys[at] = 0;
+                } else {
+                    memmove(&keys[at], &keys[at + 1], n - at - 1);
+                    keys[n - 1] = 0;
+                }
+                break;
+        }
+    }
+}
+void Fuzzer::worker(size_t index, size_t limit, double seconds)
+{
+    PC             *pc    = machines[index];
+    uint64_t        rng   = (cfg.seed + index) * 0x9e3779b97f4a7c15ull | 1;
+    auto            start = std::chrono::steady_clock::now();
+    vector<uint8_t> cov(0x10000);
+    vector<uint8_t> keys;
+    vector<uint8_t> donor;
+    while (started.fetch_add(1) < limit) {
+        if (seconds > 0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > seconds)
+            break;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            keys  = corpus[next_random(rng) % corpus.size()].keys;
+            donor = corpus[next_random(rng) % corpus.size()].keys;
+        }
+        mutate(keys, donor, rng);
+        FuzzResult r = execute(pc, keys, cov.data());
+        submit(keys, r, cov.data());
+        execs++;
+    }
+    active--;
+}
+// Replays the corpus (or an empty input) to seed the coverage, then mutates
+// on cfg.threads threads until `limit` inputs ran or `seconds` passed (0 =
+// no time limit), printing progress to log every second.
+void Fuzzer::run(size_t limit, double seconds, FILE *log)
+{
+    vector<uint8_t>   cov(0x10000);
+    vector<FuzzInput> seeds;
+    seeds.swap(corpus);
+    if (seeds.empty())
+        seeds.push_back(FuzzInput{vector<uint8_t>(cfg.frames), FuzzResult{}});
+    for (auto &s : seeds) {
+        FuzzResult r = execute(machines[0], s.keys, cov.data());
+        submit(s.keys, r, cov.data());
+    }
+    if (corpus.empty())
+        corpus.push_back(seeds[0]);
+
+    started = 0;
+    active  = cfg.threads;
+    vector<std::thread> threads;
+    for (size_t i = 0; i < cfg.threads; i++)
+        threads.emplace_back(&Fuzzer::worker, this, i, limit, seconds);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t tick = 1; log != nullptr && active > 0;) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (secs < tick)
+            continue;
+        tick++;
+        std::lock_guard<std::mutex> guard(lock);
+        fprintf(log, "%6.0fs  execs %zu  %.1f/s  corpus %zu  pcs %zu  crashes %zu", secs, execs.load(),
+                execs / secs, corpus.size(), covered, crashes.size());
+        if (cfg.score_addr >= 0)
+            fprintf(log, "  score %llu", (unsigned long long)best_score);
+        fprintf(log, "\n");
+        fflush(log);
+    }
+    for (auto &t : threads)
+        t.join();
+}
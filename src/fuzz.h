@@ -0,0 +1,102 @@
+#ifndef _H_FUZZ
+#define _H_FUZZ
+#include "PC.h"
+#include "snapshot.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+enum FuzzCrash
+{
+    FUZZ_NONE,
+    FUZZ_KIL,      // KIL opcode, the CPU jams
+    FUZZ_UNI,      // opcode the core does not implement
+    FUZZ_STACK,    // S wrapped around, stack overflow or underflow
+    FUZZ_IO,       // PC in the $C000-$C0FF soft switches
+};
+
+struct FuzzConfig
+{
+    string   bios       = "rom/Apple2e.rom";
+    string   prg        = "";
+    size_t   threads    = 0;      // 0 = one per hardware thread
+    size_t   frames     = 600;    // length of an input, one key (or none) per frame
+    size_t   warmup     = 0;      // frames run before the start snapshot
+    string   script     = "";     // keys pressed during warmup, see PC::warm_boot
+    string   cache_dir  = "";     // keep the start snapshot here across runs
+    string   out_dir    = "";     // corpus/ and crashes/ are kept here, "" = memory only
+    string   keys       = "8,21,11,10,13,32,65,90,73,74,75,76,77";
+    uint64_t seed       = 1;
+    int      score_addr = -1;     // RAM bytes whose peak value is fed back, -1 = none
+    size_t   score_len  = 1;      // most significant byte first
+};
+
+struct FuzzResult
+{
+    FuzzCrash crash    = FUZZ_NONE;
+    uint16_t  pc       = 0;    // of the crashing instruction
+    size_t    frame    = 0;    // the crash happened in, or frames run
+    size_t    coverage = 0;    // distinct PCs executed
+    uint64_t  score    = 0;    // peak of the score bytes at frame ends
+};
+
+struct FuzzInput
+{
+    vector<uint8_t> keys;
+    FuzzResult      result;
+};
+
+// Coverage-guided search over key sequences. Every candidate starts from the
+// same snapshot (restored, never rebooted) and runs for cfg.frames frames
+// with one key per frame while the executed PCs are recorded in a 64K byte
+// map and each instruction is checked for a crash. Candidates that execute
+// a PC never seen before, or raise the score, join the corpus; crashes are
+// kept once per kind and PC. Worker threads each own a machine and mutate
+// corpus entries independently.
+class Fuzzer {
+  public:
+    FuzzConfig        cfg;
+    vector<FuzzInput> corpus;
+    vector<FuzzInput> crashes;
+    size_t            covered    = 0;
+    uint64_t          best_score = 0;
+
+    std::atomic<size_t> execs{0};
+
+  private:
+    std::atomic<size_t> started{0};
+    std::atomic<size_t> active{0};
+
+    vector<PC *>    machines;
+    vector<uint8_t> alphabet;
+    Snapshot       *snap = nullptr;
+    std::mutex      lock;
+    uint8_t         seen[0x10000]{};
+
+  public:
+    Fuzzer();
+    ~Fuzzer();
+
+    bool init(const FuzzConfig &config);
+    void run(size_t limit, double seconds, FILE *log);
+
+    FuzzResult execute(PC *pc, const vector<uint8_t> &keys, uint8_t *cov);
+    PC        *machine(size_t i);
+    bool       submit(const vector<uint8_t> &keys, const FuzzResult &r, const uint8_t *cov);
+
+    static const char *crash_name(FuzzCrash crash);
+    static bool        load_input(const string &path, vector<uint8_t> &keys);
+    static bool        save_input(const string &path, const vector<uint8_t> &keys);
+
+  private:
+    void worker(size_t index, size_t limit, double seconds);
+    void mutate(vector<uint8_t> &keys, const vector<uint8_t> &donor, uint64_t &rng);
+    void load_corpus();
+};
+#endif
@@ -0,0 +1,77 @@
+#include "heatmap.h"
+#include <cmath>
+#include <cstring>
+
+void Heatmap::clear()
+{
+    memset(reads, 0, sizeof(reads));
+    memset(writes, 0, sizeof(writes));
+    memset(fetches, 0, sizeof(fetches));
+    memset(smc, 0, sizeof(smc));
+    memset(flags, 0, sizeof(flags));
+}
+// One line per page that saw any traffic: access totals, how many distinct
+// bytes were touched and executed, and the self-modifying writes.
+void Heatmap::report(FILE *out)
+{
+    uint64_t total[4] = {0, 0, 0, 0};
+    size_t   smc_bytes = 0;
+
+    fprintf(out, "page        reads     writes    fetches  touched  code  smc-bytes  smc-writes\n");
+    for (int page = 0; page < 256; page++) {
+        uint64_t r = 0, w = 0, f = 0, s = 0;
+        int      touched = 0, code = 0, smc_page = 0;
+        for (int addr = page << 8; addr < (page + 1) << 8; addr++) {
+            r += reads[addr];
+            w += writes[addr];
+            f += fetches[addr];
+            s += smc[addr];
+            touched += reads[addr] > 0 || writes[addr] > 0;
+            code += (flags[addr] & HEAT_EXECUTED) != 0;
+            smc_page += (flags[addr] & HEAT_SMC) != 0;
+        }
+        if (touched == 0)
+            continue;
+        fprintf(out, "$%02X00  %10llu %10llu %10llu      %3d   %3d        %3d  %10llu\n", page, (unsigned long long)r,
+                (unsigned long long)w, (unsigned long long)f, touched, code, smc_page, (unsigned long long)s);
+        total[0] += r;
+        total[1] += w;
+        total[2] += f;
+        total[3] += s;
+        smc_bytes += smc_page;
+    }
+    fprintf(out, "total  %10llu %10llu %10llu                    %5zu  %10llu\n", (unsigned long long)total[0],
+            (unsigned long long)total[1], (unsigned long long)total[2], smc_bytes, (unsigned long long)total[3]);
+}
+// 256x256 binary PPM, one pixel per address with the page as the row: red is
+// writes, green reads, blue fetches, each on a log scale against the busiest
+// address; self-modified code bytes are white.
+bool Heatmap::save_ppm(string path)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    if (f == nullptr) {
+        printf("heatmap: cannot write %s\n", path.c_str());
+        return false;
+    }
+    uint32_t peak[3] = {1, 1, 1};
+    for (size_t addr = 0; addr < 0x10000; addr++) {
+        peak[0] = writes[addr] > peak[0] ? writes[addr] : peak[0];
+        peak[1] = reads[addr] > peak[1] ? reads[addr] : peak[1];
+        peak[2] = fetches[addr] > peak[2] ? fetches[addr] : peak[2];
+    }
+    uint8_t *img = new uint8_t[0x10000 * 3];
+    for (size_t addr = 0; addr < 0x10000; addr++) {
+        uint32_t v[3] = {writes[addr], reads[addr], fetches[addr]};
+        for (int c = 0; c < 3; c++)
+            img[addr * 3 + c] = v[c] == 0 ? 0 : 64 + 191 * log1p(v[c]) / log1p(peak[c]);
+        if (flags[addr] & HEAT_SMC)
+            memset(&img[addr * 3], 0xff, 3);
+    }
+    fprintf(f, "P6\n256 256\n255\n");
+    bool ok = fwrite(img, 3, 0x10000, f) == 0x10000;
+    ok &= fclose(f) == 0;
+    delete[] img;
+    if (!ok)
+        printf("heatmap: cannot write %s\n", path.c_str());
+    return ok;
+}
@@ -0,0 +1,55 @@
+#ifndef _H_HEATMAP
+#define _H_HEATMAP
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+using namespace std;
+
+#define HEAT_EXECUTED 0x1
+#define HEAT_SMC      0x2
+
+// Per-address bus counters for working out how a program uses memory.
+// `reads` counts every read through Mem::get (instruction bytes included),
+// `writes` every Mem::set and `fetches` the instructions starting at an
+// address. A write to a byte that was executed before marks it HEAT_SMC and
+// counts in `smc`. Counters saturate instead of wrapping. The hooks are only
+// compiled in with MEM_HEATMAP.
+class Heatmap {
+  public:
+    uint32_t reads[0x10000]{};
+    uint32_t writes[0x10000]{};
+    uint32_t fetches[0x10000]{};
+    uint32_t smc[0x10000]{};
+    uint8_t  flags[0x10000]{};
+
+  public:
+    static inline void bump(uint32_t &counter)
+    {
+        counter += counter != UINT32_MAX;
+    }
+    inline void read(uint16_t addr)
+    {
+        bump(reads[addr]);
+    }
+    inline void write(uint16_t addr)
+    {
+        bump(writes[addr]);
+        if (flags[addr] & HEAT_EXECUTED) {
+            flags[addr] |= HEAT_SMC;
+            bump(smc[addr]);
+        }
+    }
+    inline void fetch(uint16_t pc, int len)
+    {
+        bump(fetches[pc]);
+        for (int i = 0; i < len; i++)
+            flags[(uint16_t)(pc + i)] |= HEAT_EXECUTED;
+    }
+
+    void clear();
+    void report(FILE *out);
+    bool save_ppm(string path);
+};
+#endif
@@ -0,0 +1,425 @@
+#include "lanes.h"
+#include "cpu_enum.h"
+#include <cstdio>
+
+// Helpers are macros so no vector type crosses a (non-inlined) call
+// boundary, where passing 32-byte vectors would depend on the target ISA.
+#define sel(m, t, f) (((t) & (m)) | ((f) & ~(m)))
+#define is_zero(v)   ((lane_t)((v) == 0) & 1)
+#define set_nz(l, m, val)                                                                                           \
+    do {                                                                                                           \
+        lane_t r_ = (val);                                                                                         \
+        l->n      = sel(m, (r_ >> 7) & 1, l->n);                                                                   \
+        l->z      = sel(m, is_zero(r_ & 0xff), l->z);                                                              \
+    } while (0)
+
+// The vector half of a lockstep instruction: register, flag and result
+// updates for every lane in `m` at once. Built for AVX2 and baseline x86-64,
+// the right one is picked at load time.
+__attribute__((target_clones("avx2", "default"))) static void lane_alu(LaneCpu *l, size_t kind, const lane_t *mp,
+                                                                       const lane_t *valp, lane_t *out)
+{
+    lane_t m   = *mp;
+    lane_t val = *valp;
+    lane_t t;
+
+    switch (kind) {
+        case LDA:
+            l->a = sel(m, val, l->a);
+            set_nz(l, m, val);
+            break;
+        case LDX:
+            l->x = sel(m, val, l->x);
+            set_nz(l, m, val);
+            break;
+        case LDY:
+            l->y = sel(m, val, l->y);
+            set_nz(l, m, val);
+            break;
+        case STA:
+            *out = l->a;
+            break;
+        case STX:
+            *out = l->x;
+            break;
+        case STY:
+            *out = l->y;
+            break;
+        case ORA:
+            l->a = sel(m, l->a | val, l->a);
+            set_nz(l, m, l->a);
+            break;
+        case AND:
+            l->a = sel(m, l->a & val, l->a);
+            set_nz(l, m, l->a);
+            break;
+        case EOR:
+            l->a = sel(m, l->a ^ val, l->a);
+            set_nz(l, m, l->a);
+            break;
+        case SBC:
+            val ^= 0xff;
+            // fall through
+        case ADC:
+            t    = l->a + val + l->c;
+            l->v = sel(m, ((~(l->a ^ val) & (l->a ^ t)) >> 7) & 1, l->v);
+            l->c = sel(m, t >> 8, l->c);
+            l->a = sel(m, t & 0xff, l->a);
+            set_nz(l, m, l->a);
+            break;
+        case CMP:
+        case CPX:
+        case CPY:
+            t    = (kind == CMP ? l->a : kind == CPX ? l->x : l->y) + (val ^ 0xff) + 1;
+            l->c = sel(m, t >> 8, l->c);
+            set_nz(l, m, t);
+            break;
+        case BIT:
+            l->n = sel(m, (val >> 7) & 1, l->n);
+            l->v = sel(m, (val >> 6) & 1, l->v);
+            l->z = sel(m, is_zero(l->a & val), l->z);
+            break;
+        case INC:
+            *out = (val + 1) & 0xff;
+            set_nz(l, m, *out);
+            break;
+        case DEC:
+            *out = (val - 1) & 0xff;
+            set_nz(l, m, *out);
+            break;
+        case INX:
+            l->x = sel(m, (l->x + 1) & 0xff, l->x);
+            set_nz(l, m, l->x);
+            break;
+        case INY:
+            l->y = sel(m, (l->y + 1) & 0xff, l->y);
+            set_nz(l, m, l->y);
+            break;
+        case DEX:
+            l->x = sel(m, (l->x - 1) & 0xff, l->x);
+            set_nz(l, m, l->x);
+            break;
+        case DEY:
+            l->y = sel(m, (l->y - 1) & 0xff, l->y);
+            set_nz(l, m, l->y);
+            break;
+        case TAX:
+            l->x = sel(m, l->a, l->x);
+            set_nz(l, m, l->x);
+            break;
+        case TXA:
+            l->a = sel(m, l->x, l->a);
+            set_nz(l, m, l->a);
+            break;
+        case TAY:
+            l->y = sel(m, l->a, l->y);
+            set_nz(l, m, l->y);
+            break;
+        case TYA:
+            l->a = sel(m, l->y, l->a);
+            set_nz(l, m, l->a);
+            break;
+        case ASLA:
+            t    = l->a << 1;
+            l->c = sel(m, t >> 8, l->c);
+            l->a = sel(m, t & 0xff, l->a);
+            set_nz(l, m, l->a);
+            break;
+        case LSRA:
+            l->c = sel(m, l->a & 1, l->c);
+            l->a = sel(m, l->a >> 1, l->a);
+            set_nz(l, m, l->a);
+            break;
+        case ROLA:
+            t    = (l->a << 1) | l->c;
+            l->c = sel(m, t >> 8, l->c);
+            l->a = sel(m, t & 0xff, l->a);
+            set_nz(l, m, l->a);
+            break;
+        case RORA:
+            t    = (l->a >> 1) | (l->c << 7);
+            l->c = sel(m, l->a & 1, l->c);
+            l->a = sel(m, t, l->a);
+            set_nz(l, m, l->a);
+            break;
+        case CLC:
+            l->c &= ~m;
+            break;
+        case SEC:
+            l->c = sel(m, m & 1, l->c);
+            break;
+        case CLD:
+            l->d &= ~m;
+            break;
+        case SED:
+            l->d = sel(m, m & 1, l->d);
+            break;
+        case CLI:
+            l->i &= ~m;
+            break;
+        case SEI:
+            l->i = sel(m, m & 1, l->i);
+            break;
+        case CLV:
+            l->v &= ~m;
+            break;
+        case BPL:
+            *out = l->n ^ 1;
+            break;
+        case BMI:
+            *out = l->n;
+            break;
+        case BVC:
+            *out = l->v ^ 1;
+            break;
+        case BVS:
+            *out = l->v;
+            break;
+        case BCC:
+            *out = l->c ^ 1;
+            break;
+        case BCS:
+            *out = l->c;
+            break;
+        case BNE:
+            *out = l->z ^ 1;
+            break;
+        case BEQ:
+            *out = l->z;
+            break;
+    }
+}
+
+LaneCpu::LaneCpu()
+{
+    cpu            = new Cpu();
+    own            = cpu->mem;
+    cpu->idle_skip = false;
+}
+LaneCpu::~LaneCpu()
+{
+    cpu->mem = own;
+    delete cpu;
+}
+// All lanes decode with one opcode table, so a machine is refused if its
+// variant differs from the lanes already loaded.
+bool LaneCpu::load(int lane, Cpu *src)
+{
+    if (src != cpu) {
+        bool others = false;
+        for (int l = 0; l < LANES; l++)
+            others |= l != lane && mem[l] != nullptr;
+        if (others && src->variant != cpu->variant) {
+            printf("lanes: lane %d is not the same CPU variant as the other lanes\n", lane);
+            return false;
+        }
+        cpu->variant = src->variant;
+    }
+    a[lane]          = src->a;
+    x[lane]          = src->x;
+    y[lane]          = src->y;
+    sp[lane]         = src->sp;
+    n[lane]          = src->negative;
+    v[lane]          = src->overflow;
+    d[lane]          = src->decimal;
+    i[lane]          = src->interrupt;
+    z[lane]          = src->zero;
+    c[lane]          = src->carry;
+    pc[lane]         = src->pc;
+    mem[lane]        = src->mem;
+    mem[lane]->clock = &totalcycle[lane];
+    pending[lane]    = src->pending;
+    irq_lines[lane]  = src->irq_lines;
+    nmi_lines[lane]  = src->nmi_lines;
+    steps[lane]      = src->steps;
+    totalcycle[lane] = src->totalcycle;
+    return true;
+}
+void LaneCpu::store(int lane, Cpu *dst)
+{
+    dst->a          = a[lane];
+    dst->x          = x[lane];
+    dst->y          = y[lane];
+    dst->sp         = sp[lane];
+    dst->negative   = n[lane];
+    dst->overflow   = v[lane];
+    dst->decimal    = d[lane];
+    dst->interrupt  = i[lane];
+    dst->zero       = z[lane];
+    dst->carry      = c[lane];
+    dst->pc         = pc[lane];
+    dst->pending    = pending[lane];
+    dst->irq_lines  = irq_lines[lane];
+    dst->nmi_lines  = nmi_lines[lane];
+    dst->steps      = steps[lane];
+    dst->totalcycle = totalcycle[lane];
+    if (dst->mem == mem[lane])
+        mem[lane]->clock = &dst->totalcycle;
+}
+void LaneCpu::step()
+{
+    run_cycles(FRAME_CYCLES);
+}
+void LaneCpu::run_cycles(int cycles)
+{
+    for (int l = 0; l < LANES; l++) {
+        frame_left[l] = mem[l] != nullptr ? cycles : 0;
+        if (mem[l] != nullptr)
+            mem[l]->start_frame(totalcycle[l]);
+    }
+    for (;;) {
+        int lead = -1;
+        for (int l = 0; l < LANES; l++) {
+            if (frame_left[l] > 0 && (lead < 0 || totalcycle[l] < totalcycle[lead]))
+                lead = l;
+        }
+        if (lead < 0)
+            return;
+
+        uint16_t at = pc[lead];
+        uint8_t  op = mem[lead]->ram[at];
+        if (pending[lead] != 0 || (at & 0xff00) == 0xc000) {
+            exec_scalar(lead);
+            continue;
+        }
+
+        uint32_t mask = 0;
+        for (int l = 0; l < LANES; l++) {
+            if (frame_left[l] > 0 && pc[l] == at && pending[l] == 0 && mem[l]->ram[at] == op)
+                mask |= 1u << l;
+        }
+        if (__builtin_popcount(mask) > 1 && vectorized(op, mask)) {
+            exec_lockstep(mask, op);
+            continue;
+        }
+        for (int l = 0; l < LANES; l++) {
+            if (mask & (1u << l))
+                exec_scalar(l);
+        }
+    }
+}
+bool LaneCpu::vectorized(uint8_t opcode, uint32_t mask)
+{
+    switch (cpu->opcode_info(opcode).opcode) {
+        case ADC:
+        case SBC:
+            for (int l = 0; l < LANES; l++) {
+                if ((mask & (1u << l)) && d[l])
+                    return false;
+            }
+            return true;
+        case LDA:
+        case LDX:
+        case LDY:
+        case STA:
+        case STX:
+        case STY:
+        case ORA:
+        case AND:
+        case EOR:
+        case CMP:
+        case CPX:
+        case CPY:
+        case BIT:
+        case INC:
+        case DEC:
+        case INX:
+        case INY:
+        case DEX:
+        case DEY:
+        case TAX:
+        case TXA:
+        case TAY:
+        case TYA:
+        case ASLA:
+        case LSRA:
+        case ROLA:
+        case RORA:
+        case CLC:
+        case SEC:
+        case CLD:
+        case SED:
+        case CLI:
+        case SEI:
+        case CLV:
+        case NOP:
+        case JMP:
+        case BPL:
+        case BMI:
+        case BVC:
+        case BVS:
+        case BCC:
+        case BCS:
+        case BNE:
+        case BEQ:
+            return true;
+    }
+    return false;
+}
+void LaneCpu::exec_scalar(int lane)
+{
+    store(lane, cpu);
+    cpu->mem        = mem[lane];
+    cpu->frame_left = frame_left[lane];
+
+    int cycles = cpu->run(false);
+
+    load(lane, cpu);
+    frame_left[lane] -= cycles;
+    scalar_steps++;
+}
+void LaneCpu::exec_lockstep(uint32_t mask, uint8_t opcode)
+{
+    const Opcode &opc      = cpu->opcode_info(opcode);
+    size_t        kind     = opc.opcode;
+    auto          get_addr = cpu->variant == CPU_CMOS ? &Cpu::get_addr<CPU_CMOS> : &Cpu::get_addr<CPU_NMOS>;
+    uint16_t      addr[LANES];
+    int           cycles[LANES];
+    lane_t        m{};
+    lane_t        val{};
+    lane_t        out{};
+
+    bool reads = kind != STA && kind != STX && kind != STY && kind != JMP && kind != NOP && opc.adm != IMP &&
+                 opc.adm != REL;
+    bool writes = kind == STA || kind == STX || kind == STY || kind == INC || kind == DEC;
+
+    for (int l = 0; l < LANES; l++) {
+        if (!(mask & (1u << l)))
+            continue;
+        m[l] = 0xffff;
+
+        cpu->mem    = mem[l];
+        cpu->pc     = pc[l] + 1;
+        cpu->x      = x[l];
+        cpu->y      = y[l];
+        cpu->cycles = 0;
+        addr[l]     = (cpu->*get_addr)(opc.adm);
+        pc[l]       = cpu->pc;
+        cycles[l]   = opc.cycle + cpu->cycles;
+        if (reads) {
+            val[l] = mem[l]->get(addr[l]);
+        } else if (opc.adm == REL) {
+            val[l] = addr[l];
+        }
+    }
+
+    lane_alu(this, kind, &m, &val, &out);
+
+    for (int l = 0; l < LANES; l++) {
+        if (!(mask & (1u << l)))
+            continue;
+        if (writes) {
+            mem[l]->set(addr[l], out[l]);
+        } else if (kind == JMP) {
+            pc[l] = addr[l];
+        } else if (opc.adm == REL && out[l]) {
+            uint16_t target = pc[l] + (int8_t)val[l];
+            cycles[l] += 1 + ((pc[l] >> 8) != (target >> 8));
+            pc[l] = target;
+        }
+        totalcycle[l] += cycles[l];
+        frame_left[l] -= cycles[l];
+        steps[l]++;
+    }
+    lockstep_steps += __builtin_popcount(mask);
+}
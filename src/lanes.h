@@ -0,0 +1,55 @@
+#ifndef _H_LANES
+#define _H_LANES
+#include "cpu.h"
+#include <cstddef>
+#include <cstdint>
+
+#define LANES 16
+
+typedef uint16_t lane_t __attribute__((vector_size(2 * LANES)));
+
+// Lockstep interpreter for LANES copies of the same program. Registers and
+// flags are kept as structure-of-arrays vectors (one 16-bit slot per lane,
+// flags as 0/1), each lane has its own 64K Mem. Every step picks the lane
+// furthest behind in emulated time and runs all lanes sitting at the same PC
+// together: addresses and bus accesses are done per lane, the ALU and flag
+// work for common instructions is done once over the whole vector (AVX2 when
+// the host has it). Other instructions, decimal mode arithmetic and lanes
+// with pending interrupts fall back to the scalar Cpu, one lane at a time.
+class LaneCpu {
+  public:
+    lane_t a{}, x{}, y{}, sp{};
+    lane_t n{}, v{}, d{}, i{}, z{}, c{};
+
+    uint16_t pc[LANES]{};
+    Mem     *mem[LANES]{};
+    uint32_t pending[LANES]{};
+    uint32_t irq_lines[LANES]{};
+    uint32_t nmi_lines[LANES]{};
+    size_t   steps[LANES]{};
+    size_t   totalcycle[LANES]{};
+    int      frame_left[LANES]{};
+
+    size_t lockstep_steps = 0;
+    size_t scalar_steps   = 0;
+
+  private:
+    Cpu *cpu = nullptr;
+    Mem *own = nullptr;
+
+  public:
+    LaneCpu();
+    ~LaneCpu();
+
+    bool load(int lane, Cpu *src);
+    void store(int lane, Cpu *dst);
+
+    void step();
+    void run_cycles(int cycles);
+
+  private:
+    void exec_scalar(int lane);
+    void exec_lockstep(uint32_t mask, uint8_t opcode);
+    bool vectorized(uint8_t opcode, uint32_t mask);
+};
+#endif
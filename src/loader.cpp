@@ -0,0 +1,114 @@
+#include "loader.h"
+#include <cstdio>
+#include <mutex>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static std::mutex                              cache_lock;
+static std::unordered_map<uint64_t, RomImage *> cache[2];
+
+const RomImage *Loader::load_bios(string path)
+{
+    return load(path, true);
+}
+const RomImage *Loader::load_prg(string path)
+{
+    return load(path, false);
+}
+uint64_t Loader::hash(const uint8_t *data, size_t len, uint64_t seed)
+{
+    uint64_t h = seed;
+    for (size_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+size_t Loader::cached_images()
+{
+    std::lock_guard<std::mutex> lk(cache_lock);
+    return cache[0].size() + cache[1].size();
+}
+const RomImage *Loader::load(string path, bool bios)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        printf("loader: cannot open %s\n", path.c_str());
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        printf("loader: %s is empty\n", path.c_str());
+        close(fd);
+        return nullptr;
+    }
+    size_t size = st.st_size;
+    void  *map  = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        printf("loader: cannot map %s\n", path.c_str());
+        return nullptr;
+    }
+
+    auto    *buf = (const uint8_t *)map;
+    uint64_t h   = hash(buf, size);
+
+    std::lock_guard<std::mutex> lk(cache_lock);
+    auto                        it = cache[bios].find(h);
+    if (it != cache[bios].end()) {
+        munmap(map, size);
+        return it->second;
+    }
+
+    RomImage *img = new RomImage();
+    img->hash     = h;
+    img->bios     = bios;
+    img->map      = map;
+    img->map_len  = size;
+    if (!parse(img, buf, size, path)) {
+        munmap(map, size);
+        delete img;
+        return nullptr;
+    }
+    cache[bios][h] = img;
+    return img;
+}
+bool Loader::parse(RomImage *img, const uint8_t *buf, size_t size, const string &path)
+{
+    if (img->bios) {
+        if (size > BIOS_MAX) {
+            printf("loader: %s: bios is %zu bytes, max %zu\n", path.c_str(), size, BIOS_MAX);
+            return false;
+        }
+        img->data      = buf;
+        img->len       = size;
+        img->load_addr = BIOS_ADDR;
+        return true;
+    }
+
+    if (size < 4) {
+        printf("loader: %s: missing program header\n", path.c_str());
+        return false;
+    }
+    size_t addr = buf[0] | (buf[1] << 8);
+    size_t len  = buf[2] | (buf[3] << 8);
+    if (len == 0) {
+        printf("loader: %s: empty program\n", path.c_str());
+        return false;
+    }
+    if (len > size - 4) {
+        printf("loader: %s: header length %04zX exceeds file size %zu\n", path.c_str(), len, size);
+        return false;
+    }
+    if (addr + len > PRG_LIMIT) {
+        printf("loader: %s: %04zX-%04zX overlaps I/O and rom space\n", path.c_str(), addr, addr + len - 1);
+        return false;
+    }
+    img->data      = buf + 4;
+    img->len       = len;
+    img->load_addr = addr;
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef _H_LOADER
+#define _H_LOADER
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+// A validated, read-only ROM or program image. Images are memory-mapped and
+// cached by content hash, so every instance loading the same file shares one copy.
+struct RomImage
+{
+    const uint8_t *data      = nullptr;    // payload, header stripped
+    size_t         len       = 0;
+    uint16_t       load_addr = 0;
+    uint64_t       hash      = 0;
+    bool           bios      = false;
+
+    void  *map     = nullptr;
+    size_t map_len = 0;
+};
+
+class Loader {
+  public:
+    static const size_t BIOS_ADDR = 0xc000;
+    static const size_t BIOS_MAX  = 0x4000;
+    static const size_t PRG_LIMIT = 0xc000;
+
+  public:
+    static const RomImage *load_bios(string path);
+    static const RomImage *load_prg(string path);
+
+    static uint64_t hash(const uint8_t *data, size_t len, uint64_t seed = 0xcbf29ce484222325ULL);
+    static size_t   cached_images();
+
+  private:
+    static const RomImage *load(string path, bool bios);
+    static bool            parse(RomImage *img, const uint8_t *buf, size_t size, const string &path);
+};
+#endif
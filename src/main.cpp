@@ -1,11 +1,22 @@
 #define SDL_MAIN_HANDLED
 #include "PC.h"
+#include "metrics.h"
+#include "shm.h"
 #include <SDL2/SDL.h>
+#include <cctype>
+#include <csignal>
 #include <cstdio>
 #include <time.h>
 
 const int width = 560, height = 384;
 
+static volatile sig_atomic_t dump_requested = 0;
+
+static void on_sigusr1(int)
+{
+    dump_requested = 1;
+}
+
 void UpdateTexture(SDL_Texture *texture, uint32_t *imgdata)
 {
     size_t     imgidx = 0;
@@ -25,11 +36,56 @@ void UpdateTexture(SDL_Texture *texture, uint32_t *imgdata)
     }
     SDL_UnlockTexture(texture);
 }
+int KeyToAscii(int sym)
+{
+    switch (sym) {
+        case SDLK_RETURN:
+            return 0x0d;
+        case SDLK_ESCAPE:
+            return 0x1b;
+        case SDLK_BACKSPACE:
+        case SDLK_LEFT:
+            return 0x08;
+        case SDLK_RIGHT:
+            return 0x15;
+        case SDLK_UP:
+            return 0x0b;
+        case SDLK_DOWN:
+            return 0x0a;
+    }
+    if (sym >= 0x20 && sym < 0x7f)
+        return toupper(sym);
+    return -1;
+}
 int main(int ArgCount, char **Args)
 {
-    int Running = 1;
-    PC *pc      = new PC();
-    pc->init();
+    int        Running = 1;
+    PC        *pc      = new PC();
+    ShmExport *shm     = nullptr;
+    Metrics   *metrics = nullptr;
+    string     stats   = "";
+    if (!pc->init()) {
+        delete pc;
+        return 1;
+    }
+    for (int i = 1; i + 1 < ArgCount; i += 2) {
+        string arg = Args[i];
+        if (arg == "-s" && shm == nullptr) {
+            shm = new ShmExport(Args[i + 1]);
+            if (!shm->ok()) {
+                delete shm;
+                delete pc;
+                return 1;
+            }
+        } else if (arg == "-M") {
+            stats = Args[i + 1];
+        }
+    }
+    if (!stats.empty()) {
+        metrics          = new Metrics();
+        pc->cpu->metrics = metrics;
+        signal(SIGUSR1, on_sigusr1);
+    }
 
     SDL_Window *window =
         SDL_CreateWindow("", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width * 1, height * 1, SDL_WINDOW_OPENGL);
@@ -37,32 +93,63 @@ int main(int ArgCount, char **Args)
     SDL_Renderer *render = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
     SDL_RenderSetScale(render, 1, 1);
     MooseTexture = SDL_CreateTexture(render, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
-    pc->load_prg("rom/starblazer.bin");
+    if (!pc->load_prg("rom/starblazer.bin")) {
+        delete pc;
+        return 1;
+    }
     pc->start();
 
     while (Running) {
         pc->tick();
+        if (shm != nullptr)
+            shm->publish(pc->cpu);
         if (pc->cpu->get_img_status()) {
             Uint64 start   = SDL_GetPerformanceCounter();
             auto   imgdata = pc->cpu->get_img_data();
             pc->cpu->clear_img();
+            uint64_t t0 = Metrics::now();
             UpdateTexture(MooseTexture, imgdata);
+            uint64_t t1 = Metrics::now();
             SDL_RenderClear(render);
             SDL_RenderCopy(render, MooseTexture, NULL, NULL);
             SDL_RenderPresent(render);
+            uint64_t t2 = Metrics::now();
 
             Uint64 end       = SDL_GetPerformanceCounter();
             float  elapsedMS = (end - start) / (float)SDL_GetPerformanceFrequency() * 1000.0f;
             if (16.666f > elapsedMS)
                 SDL_Delay(floor(16.666f - elapsedMS));
+            if (metrics != nullptr) {
+                metrics->observe(M_UPDATE_TEXTURE, t1 - t0);
+                metrics->observe(M_RENDER_PRESENT, t2 - t1);
+                if (16.666f > elapsedMS)
+                    metrics->observe(M_SLEEP, Metrics::now() - t2);
+                else
+                    metrics->add(M_FRAMES_DROPPED, 1);
+            }
+        }
+        if (dump_requested) {
+            dump_requested = 0;
+            metrics->dump(stats.c_str());
         }
 
         SDL_Event Event;
         while (SDL_PollEvent(&Event)) {
             if (Event.type == SDL_QUIT)
                 Running = 0;
+            if (Event.type == SDL_KEYDOWN) {
+                int key = KeyToAscii(Event.key.keysym.sym);
+                if (key >= 0)
+                    pc->key_down(key);
+            }
         }
     }
+    if (metrics != nullptr) {
+        metrics->dump(stats.c_str());
+        pc->cpu->metrics = nullptr;
+        delete metrics;
+    }
+    delete shm;
     delete pc;
     return 0;
 }
@@ -2,78 +2,507 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 
-Mem::Mem()
+// 5x7 dots per character, ASCII $20-$7F, one row per byte with the leftmost
+// dot in bit 4.
+static constexpr uint8_t font[96][7] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, {0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04},
+    {0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00}, {0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a},
+    {0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04}, {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03},
+    {0x08, 0x14, 0x14, 0x08, 0x15, 0x12, 0x0d}, {0x04, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00},
+    {0x04, 0x08, 0x10, 0x10, 0x10, 0x08, 0x04}, {0x04, 0x02, 0x01, 0x01, 0x01, 0x02, 0x04},
+    {0x04, 0x15, 0x0e, 0x04, 0x0e, 0x15, 0x04}, {0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00},
+    {0x00, 0x00, 0x00, 0x00, 0x04, 0x04, 0x08}, {0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00},
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04}, {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00},
+    {0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e}, {0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e},
+    {0x0e, 0x11, 0x01, 0x06, 0x08, 0x10, 0x1f}, {0x1f, 0x01, 0x02, 0x06, 0x01, 0x11, 0x0e},
+    {0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02}, {0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e},
+    {0x07, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e}, {0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08},
+    {0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e}, {0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x1c},
+    {0x00, 0x00, 0x04, 0x00, 0x04, 0x00, 0x00}, {0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x08},
+    {0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02}, {0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00},
+    {0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08}, {0x0e, 0x11, 0x02, 0x04, 0x04, 0x00, 0x04},
+    {0x0e, 0x11, 0x15, 0x17, 0x16, 0x10, 0x0f}, {0x04, 0x0a, 0x11, 0x11, 0x1f, 0x11, 0x11},
+    {0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e}, {0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e},
+    {0x1e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x1e}, {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f},
+    {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10}, {0x0f, 0x10, 0x10, 0x13, 0x11, 0x11, 0x0f},
+    {0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11}, {0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e},
+    {0x01, 0x01, 0x01, 0x01, 0x01, 0x11, 0x0e}, {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11},
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f}, {0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11},
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}, {0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e},
+    {0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10}, {0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d},
+    {0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11}, {0x0e, 0x11, 0x10, 0x0e, 0x01, 0x11, 0x0e},
+    {0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e},
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04}, {0x11, 0x11, 0x11, 0x15, 0x15, 0x1b, 0x11},
+    {0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11}, {0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04},
+    {0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f}, {0x1f, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1f},
+    {0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00}, {0x1f, 0x03, 0x03, 0x03, 0x03, 0x03, 0x1f},
+    {0x00, 0x00, 0x04, 0x0a, 0x11, 0x00, 0x00}, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f},
+    {0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x0e, 0x01, 0x0f, 0x11, 0x0f},
+    {0x10, 0x10, 0x1e, 0x11, 0x11, 0x11, 0x1e}, {0x00, 0x00, 0x0f, 0x10, 0x10, 0x10, 0x0f},
+    {0x01, 0x01, 0x0f, 0x11, 0x11, 0x11, 0x0f}, {0x00, 0x00, 0x0e, 0x11, 0x1f, 0x10, 0x0f},
+    {0x06, 0x09, 0x08, 0x1c, 0x08, 0x08, 0x08}, {0x00, 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x0e},
+    {0x10, 0x10, 0x1e, 0x11, 0x11, 0x11, 0x11}, {0x04, 0x00, 0x0c, 0x04, 0x04, 0x04, 0x0e},
+    {0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0c}, {0x10, 0x10, 0x11, 0x12, 0x1c, 0x12, 0x11},
+    {0x0c, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e}, {0x00, 0x00, 0x1b, 0x15, 0x15, 0x15, 0x11},
+    {0x00, 0x00, 0x1e, 0x11, 0x11, 0x11, 0x11}, {0x00, 0x00, 0x0e, 0x11, 0x11, 0x11, 0x0e},
+    {0x00, 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10}, {0x00, 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x01},
+    {0x00, 0x00, 0x17, 0x18, 0x10, 0x10, 0x10}, {0x00, 0x00, 0x0f, 0x10, 0x0e, 0x01, 0x1e},
+    {0x08, 0x08, 0x1c, 0x08, 0x08, 0x09, 0x06}, {0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0d},
+    {0x00, 0x00, 0x11, 0x11, 0x11, 0x0a, 0x04}, {0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0a},
+    {0x00, 0x00, 0x11, 0x0a, 0x04, 0x0a, 0x11}, {0x00, 0x11, 0x11, 0x11, 0x0f, 0x01, 0x0e},
+    {0x00, 0x00, 0x1f, 0x02, 0x04, 0x08, 0x1f}, {0x07, 0x0c, 0x0c, 0x18, 0x0c, 0x0c, 0x07},
+    {0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, {0x1c, 0x06, 0x06, 0x03, 0x06, 0x06, 0x1c},
+    {0x0d, 0x16, 0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x15, 0x0a, 0x15, 0x0a, 0x15, 0x00},
+};
+
+static constexpr VideoTables make_video_tables()
 {
-    for (int i = 0; i < 256; i++) {
-        color_lut[i] = new uint8_t[4 * 7 * 2]{};
+    VideoTables t{};
+    for (int c = 0; c < 256; c++) {
+        int dst = 0;
+        for (int i = 0; i < 7; i++) {
+            uint8_t p             = ((c >> i) & 1) ? 0xff : 00;
+            t.color_lut[c][dst++] = 0x00;
+            t.color_lut[c][dst++] = p;
+            t.color_lut[c][dst++] = 0x00;
+            t.color_lut[c][dst++] = 0xff;
+            t.color_lut[c][dst++] = 0x00;
+            t.color_lut[c][dst++] = p;
+            t.color_lut[c][dst++] = 0x00;
+            t.color_lut[c][dst++] = 0xff;
+        }
+    }
+    for (int row = 0; row < 192; row++) {
+        int src = ((row & 7) * 0x400) + (((row >> 3) & 0x07) * 0x80) + (((row >> 6) & 0x7) * 0x28);
+
+        t.scanline_to_offset[row] = src;
+        for (int x = 0; x < 40; x++) {
+            t.offset_to_scanline[src + x]          = row;
+            t.offset_to_scanline[0x2000 + src + x] = row + 192;
+        }
+    }
+    // text and lo-res rows; the unused bytes between rows map to a spare flag
+    for (int i = 0; i < 0x800; i++)
+        t.offset_to_text_row[i] = 2 * 24;
+    for (int row = 0; row < 24; row++) {
+        int src = (row & 7) * 0x80 + (row >> 3) * 0x28;
+
+        t.text_row_to_offset[row] = src;
+        for (int x = 0; x < 40; x++) {
+            t.offset_to_text_row[src + x]         = row;
+            t.offset_to_text_row[0x400 + src + x] = row + 24;
+        }
+    }
+    // Screen codes $00-$3F are inverse, $40-$7F flashing (drawn inverse),
+    // $80-$FF normal; codes below $20 of each group show @A-Z[\]^_.
+    for (int c = 0; c < 256; c++) {
+        int  code    = c < 0x80 ? c & 0x3f : c & 0x7f;
+        int  ascii   = code < 0x20 ? code + 0x40 : code;
+        bool inverse = c < 0x80;
+        for (int line = 0; line < 8; line++) {
+            uint8_t dots = 0;
+            for (int i = 0; i < 5 && line < 7; i++) {
+                if ((font[ascii - 0x20][line] >> (4 - i)) & 1)
+                    dots |= 1 << (i + 1);
+            }
+            t.text_glyph[c][line] = inverse ? dots ^ 0x7f : dots;
+        }
     }
-    make_color_lut();
+    return t;
 }
-Mem::~Mem()
+static constexpr VideoTables video = make_video_tables();
+
+const uint8_t (&Mem::color_lut)[256][4 * 7 * 2]      = video.color_lut;
+const uint16_t (&Mem::offset_to_scanline)[0x2000 * 2] = video.offset_to_scanline;
+const uint16_t (&Mem::scanline_to_offset)[192]       = video.scanline_to_offset;
+const uint8_t (&Mem::offset_to_text_row)[0x800]      = video.offset_to_text_row;
+const uint16_t (&Mem::text_row_to_offset)[24]        = video.text_row_to_offset;
+const uint8_t (&Mem::text_glyph)[256][8]             = video.text_glyph;
+
+uint8_t Mem::no_aux[0xc000];
+
+// Built-in soft switches: keyboard, strobe, the IIe display and memory
+// switches and their status bits. Everything else in $C0xx, the switches
+// included, reads the byte the video scanner is fetching and ignores writes.
+static uint8_t float_read(void *ctx, uint16_t addr)
+{
+    return ((Mem *)ctx)->floating_bus();
+}
+static void ram_write(void *ctx, uint16_t addr, uint8_t data)
+{
+}
+static uint8_t open_read(void *ctx, uint16_t addr)
+{
+    return 0;
+}
+static uint8_t key_read(void *ctx, uint16_t addr)
+{
+    return ((Mem *)ctx)->key;
+}
+static uint8_t strobe_read(void *ctx, uint16_t addr)
+{
+    Mem *mem = (Mem *)ctx;
+    mem->key &= 0x7f;
+    return mem->key;
+}
+static void strobe_write(void *ctx, uint16_t addr, uint8_t data)
 {
-    for (int i = 0; i < 256; i++) {
-        delete[] color_lut[i];
+    ((Mem *)ctx)->key &= 0x7f;
+}
+static uint8_t page2_status(void *ctx, uint16_t addr)
+{
+    return ((Mem *)ctx)->page_2;
+}
+static uint8_t switch_read(void *ctx, uint16_t addr)
+{
+    Mem *mem = (Mem *)ctx;
+    mem->set_switch(addr);
+    return mem->floating_bus();
+}
+static void switch_write(void *ctx, uint16_t addr, uint8_t data)
+{
+    ((Mem *)ctx)->set_switch(addr);
+}
+// Buttons and paddle timers report in bit 7, which stays low with nothing
+// plugged in.
+static uint8_t input_read(void *ctx, uint16_t addr)
+{
+    return ((Mem *)ctx)->floating_bus() & 0x7f;
+}
+static uint8_t vbl_status(void *ctx, uint16_t addr)
+{
+    Mem *mem = (Mem *)ctx;
+    return (mem->beam_cycle() < 192 * VIDEO_LINE_CYCLES ? 0x80 : 0) | (mem->key & 0x7f);
+}
+static uint8_t status_read(void *ctx, uint16_t addr)
+{
+    Mem     *mem = (Mem *)ctx;
+    uint32_t bit = 0;
+    switch (addr & 0xff) {
+        case 0x13:
+            bit = SW_RAMRD;
+            break;
+        case 0x14:
+            bit = SW_RAMWRT;
+            break;
+        case 0x18:
+            bit = SW_80STORE;
+            break;
+        case 0x1a:
+            bit = SW_TEXT;
+            break;
+        case 0x1b:
+            bit = SW_MIXED;
+            break;
+        case 0x1d:
+            bit = SW_HIRES;
+            break;
+        case 0x1f:
+            bit = SW_80COL;
+            break;
+        case 0x7f:
+            bit = SW_DHIRES;
+            break;
     }
+    return (mem->switches & bit ? 0x80 : 0) | (mem->key & 0x7f);
+}
+
+Mem::Mem()
+{
+    for (int i = 0; i < 256; i++)
+        io[i] = IoHandler{i < 0x10 ? key_read : float_read, ram_write, this};
+    for (int i = 0; i < 0x10; i++)
+        io[i].write = switch_write;
+    for (int i = 0x50; i < 0x58; i++)
+        io[i] = IoHandler{switch_read, switch_write, this};
+    for (int i = 0x60; i < 0x80; i++)
+        io[i] = IoHandler{input_read, ram_write, this};
+    for (int i = 0x11; i < 0x20; i++)
+        io[i] = IoHandler{status_read, ram_write, this};
+    io[0x7f] = IoHandler{status_read, ram_write, this};
+    io[0x10] = IoHandler{strobe_read, strobe_write, this};
+    io[0x1c] = IoHandler{page2_status, ram_write, this};
+    io[0x19] = IoHandler{vbl_status, ram_write, this};
+    io[0x5e] = IoHandler{switch_read, switch_write, this};
+    io[0x5f] = IoHandler{switch_read, switch_write, this};
+    for (int page = 0xc0; page < 0xd0; page++)
+        trap[page] = TRAP_IO;
+}
+Mem::~Mem()
+{
     clear_bios();
     clear_prg();
+    set_aux(nullptr);
 }
 void Mem::init()
 {
     reset();
 }
-void Mem::make_color_lut()
+uint8_t Mem::get(uint16_t addr)
 {
-    for (int c = 0; c < 256; c++) {
-        int dst = 0;
-        for (int i = 0; i < 7; i++) {
-            uint8_t p           = ((c >> i) & 1) ? 0xff : 00;
-            color_lut[c][dst++] = 0x00;
-            color_lut[c][dst++] = p;
-            color_lut[c][dst++] = 0x00;
-            color_lut[c][dst++] = 0xff;
-            color_lut[c][dst++] = 0x00;
-            color_lut[c][dst++] = p;
-            color_lut[c][dst++] = 0x00;
-            color_lut[c][dst++] = 0xff;
+#ifdef MEM_HEATMAP
+    if (heat != nullptr)
+        heat->read(addr);
+#endif
+    if (trap[addr >> 8])
+        return trap_get(addr);
+    return ram[addr];
+}
+void Mem::set(uint16_t addr, uint8_t data)
+{
+    writes++;
+#ifdef MEM_HEATMAP
+    if (heat != nullptr)
+        heat->write(addr);
+#endif
+    if (addr >= 0x400 && addr < 0x6000) {
+        if (addr >= 0x2000) {
+            int scanline              = offset_to_scanline[addr - 0x2000];
+            dirty_scanlines[scanline] = 1;
+            video_writes++;
+        } else if (addr < 0xc00) {
+            dirty_text[offset_to_text_row[addr - 0x400]] = 1;
+            video_writes++;
         }
     }
+    if (trap[addr >> 8]) {
+        trap_set(addr, data);
+        return;
+    }
+    store(addr, data);
 }
-uint8_t Mem::get(uint16_t addr)
+uint8_t Mem::trap_get(uint16_t addr)
 {
-    if (addr > 0xc000) {
-        switch (addr) {
-            case 0xc01c:
-                return page_2;
-
-            case 0xc054:
-                page_2 = 0;
-                break;
-
-            case 0xc055:
-                page_2 = 1;
-                break;
+    uint8_t data = bank[addr >> 8] & BANK_READ ? aux[addr] : ram[addr];
+    if ((addr & 0xf000) == 0xc000) {
+        if (addr >= 0xc100) {
+            data = slot_get(addr);
+        } else {
+            io_reads += addr >= 0xc010;
+            IoHandler &h = io[addr & 0xff];
+            data         = h.read(h.ctx, addr);
         }
     }
-    return ram[addr];
+    if (trap[addr >> 8] & TRAP_WATCH)
+        watch_fn(watch_ctx, addr, data, false);
+    return data;
 }
-void Mem::set(uint16_t addr, uint8_t data)
+void Mem::trap_set(uint16_t addr, uint8_t data)
 {
-    if (addr >= 0x2000 && addr < 0x6000) {
-        int scanline              = offset_to_scanline[addr - 0x2000];
-        dirty_scanlines[scanline] = 1;
-    } else if (addr > 0xc000) {
-        switch (addr) {
-            case 0xc054:
-                page_2 = 0;
-                break;
-
-            case 0xc055:
-                page_2 = 1;
-                break;
+    if (trap[addr >> 8] & TRAP_WATCH)
+        watch_fn(watch_ctx, addr, data, true);
+    if ((addr & 0xf000) == 0xc000) {
+        if (addr >= 0xc100) {
+            slot_set(addr, data);
+        } else {
+            IoHandler &h = io[addr & 0xff];
+            h.write(h.ctx, addr, data);
         }
     }
-    ram[addr] = data;
+    if (bank[addr >> 8] & BANK_WRITE) {
+        store_aux(addr, data);
+        return;
+    }
+    store(addr, data);
+}
+// $Cn00 pages select slot n's expansion ROM, reading $CFFF releases it.
+// A card may map registers there (the Mockingboard's 6522s), so reads that
+// reach a handler count as volatile I/O for idle loop detection.
+uint8_t Mem::slot_get(uint16_t addr)
+{
+    int n = (addr >> 8) & 0xf;
+    if (n < 8) {
+        if (slot_rom[n].read == nullptr)
+            return ram[addr];
+        c8_slot = n;
+        io_reads++;
+        return slot_rom[n].read(slot_rom[n].ctx, addr);
+    }
+    if (addr == 0xcfff)
+        c8_slot = 0;
+    IoHandler &h = slot_c8[c8_slot];
+    if (h.read == nullptr)
+        return ram[addr];
+    io_reads++;
+    return h.read(h.ctx, addr);
+}
+void Mem::slot_set(uint16_t addr, uint8_t data)
+{
+    int n = (addr >> 8) & 0xf;
+    if (n < 8) {
+        if (slot_rom[n].read != nullptr)
+            c8_slot = n;
+        if (slot_rom[n].write != nullptr)
+            slot_rom[n].write(slot_rom[n].ctx, addr, data);
+        return;
+    }
+    if (addr == 0xcfff)
+        c8_slot = 0;
+    IoHandler &h = slot_c8[c8_slot];
+    if (h.write != nullptr)
+        h.write(h.ctx, addr, data);
+}
+bool Mem::insert_card(int slot, const Card &card)
+{
+    if (slot < 1 || slot > 7) {
+        printf("slot %d: cards go in slots 1-7\n", slot);
+        return false;
+    }
+    IoHandler h = IoHandler{float_read, ram_write, this};
+    if (card.io.read != nullptr || card.io.write != nullptr) {
+        h.read  = card.io.read != nullptr ? card.io.read : open_read;
+        h.write = card.io.write != nullptr ? card.io.write : ram_write;
+        h.ctx   = card.io.ctx;
+    }
+    for (int i = 0; i < 16; i++)
+        io[0x80 + slot * 16 + i] = h;
+    slot_rom[slot] = card.rom;
+    slot_c8[slot]  = card.c8;
+    return true;
+}
+void Mem::remove_card(int slot)
+{
+    insert_card(slot, Card{});
+    if (c8_slot == slot)
+        c8_slot = 0;
+}
+// XOR of the Zobrist keys of every main and aux byte. With MEM_HASH this is
+// kept in ram_hash by set(); anything writing ram[] or aux[] directly must
+// call rehash().
+uint64_t Mem::hash_ram()
+{
+    uint64_t h = 0;
+    for (size_t addr = 0; addr < 0x10000; addr++)
+        h ^= zobrist(addr, ram[addr]);
+    for (size_t addr = 0; addr < 0xc000; addr++)
+        h ^= zobrist(0x10000 + addr, aux[addr]);
+    return h;
+}
+void Mem::rehash()
+{
+#ifdef MEM_HASH
+    ram_hash = hash_ram();
+#endif
+}
+void Mem::key_down(uint8_t ascii)
+{
+    key = ascii | 0x80;
+}
+// $C000-$C00F (writes) and $C050-$C05F: odd addresses turn a switch on,
+// except annunciator 3 at $C05E/$C05F, which is double hi-res when low.
+void Mem::set_switch(uint16_t addr)
+{
+    uint32_t mode = display_mode();
+    uint32_t old  = switches;
+    bool     on  = addr & 1;
+    uint32_t bit = 0;
+    switch (addr & 0xfe) {
+        case 0x00:
+            bit = SW_80STORE;
+            break;
+        case 0x02:
+            bit = SW_RAMRD;
+            break;
+        case 0x04:
+            bit = SW_RAMWRT;
+            break;
+        case 0x0c:
+            bit = SW_80COL;
+            break;
+        case 0x50:
+            bit = SW_TEXT;
+            break;
+        case 0x52:
+            bit = SW_MIXED;
+            break;
+        case 0x54:
+            page_2 = on;
+            if (switches & SW_80STORE)
+                update_banks();
+            break;
+        case 0x56:
+            bit = SW_HIRES;
+            break;
+        case 0x5e:
+            bit = SW_DHIRES;
+            on  = !on;
+            break;
+        default:
+            return;
+    }
+    switches = on ? switches | bit : switches & ~bit;
+    if ((old ^ switches) & (SW_80STORE | SW_RAMRD | SW_RAMWRT | SW_HIRES))
+        update_banks();
+    if (display_mode() != mode)
+        split(mode);
+}
+// The lines the beam has already drawn this frame keep the mode they were
+// drawn in.
+void Mem::split(uint32_t mode)
+{
+    int line = beam_cycle() / VIDEO_LINE_CYCLES;
+    for (; scan_line < line && scan_line < 192; scan_line++)
+        line_mode[scan_line] = mode;
+}
+void Mem::start_frame(size_t cycle)
+{
+    frame_start = cycle;
+    scan_line   = 0;
+}
+// The byte the video scanner fetches at the current beam position, which is
+// what reads of unconnected I/O addresses see. The address is built from the
+// horizontal and vertical counters as on the real board: in blanking it runs
+// on through the bytes before the line and the screen holes.
+uint8_t Mem::floating_bus()
+{
+    int cycle = beam_cycle();
+    int h     = cycle % VIDEO_LINE_CYCLES;
+    int v     = cycle / VIDEO_LINE_CYCLES;
+    int vc    = v < 256 ? v : v - 6;    // $100-$1FF, then $FA-$FF
+    int hc    = h == 0 ? 0 : h - 1;     // low bits of 0, $40-$7F; visible from 24
+    int third = vc >> 6;
+    int low   = ((13 + (hc >> 3) + third * 5) & 15) << 3 | (hc & 7);
+
+    uint32_t mode = display_mode();
+    bool     text = (mode & SW_TEXT) || !(mode & SW_HIRES) || ((mode & SW_MIXED) && (vc & 0xa0) == 0xa0);
+    int      page = mode >> 8;
+    if (text)
+        return ram[(page ? 0x800 : 0x400) | (vc >> 3 & 7) << 7 | low];
+    return ram[(page ? 0x4000 : 0x2000) | (vc & 7) << 10 | (vc >> 3 & 7) << 7 | low];
+}
+// RAMRD and RAMWRT move $0200-$BFFF to aux memory; 80STORE overrides them for
+// the text page, and the hi-res page when HIRES is on, with PAGE2.
+void Mem::update_banks()
+{
+    banked = false;
+    for (int page = 0x02; page < 0xc0; page++) {
+        bool read  = switches & SW_RAMRD;
+        bool write = switches & SW_RAMWRT;
+        bool video = (page >= 0x04 && page < 0x08) || ((switches & SW_HIRES) && page >= 0x20 && page < 0x40);
+        if ((switches & SW_80STORE) && video)
+            read = write = page_2;
+        bank[page] = (read ? BANK_READ : 0) | (write ? BANK_WRITE : 0);
+        trap[page] = bank[page] ? trap[page] | TRAP_AUX : trap[page] & ~TRAP_AUX;
+        banked     = banked || bank[page];
+    }
+    if (banked && !has_aux())
+        aux = new uint8_t[0xc000]{};
+}
+// Replaces aux memory with a copy of data, or drops it when data is null so
+// the machine reads zeros there again. Callers rehash.
+void Mem::set_aux(const uint8_t *data)
+{
+    if (data == nullptr) {
+        if (has_aux())
+            delete[] aux;
+        aux = no_aux;
+        return;
+    }
+    if (!has_aux())
+        aux = new uint8_t[0xc000];
+    memcpy(aux, data, 0xc000);
 }
 uint16_t Mem::get16(uint16_t addr)
 {
@@ -82,77 +511,62 @@ uint16_t Mem::get16(uint16_t addr)
     uint16_t r = l | (h << 8);
     return r;
 }
-void Mem::set_bin(string filename, bool bios)
+bool Mem::set_bin(string filename, bool bios)
 {
-
-    FILE *f = fopen(filename.c_str(), "rb");
-    fseek(f, 0, SEEK_END);
-    int size = ftell(f);
-    fseek(f, 0, SEEK_SET);
+    const RomImage *img = bios ? Loader::load_bios(filename) : Loader::load_prg(filename);
+    if (img == nullptr)
+        return false;
 
     if (bios) {
-        bios_len = size;
-        bios_rom = new uint8_t[bios_len];
-        auto _   = fread(bios_rom, bios_len, 1, f);
+        bios_rom = img;
+        bios_len = img->len;
         load_bios();
     } else {
-        prg_len = size;
-        prg_rom = new uint8_t[prg_len];
-        auto _  = fread(prg_rom, prg_len, 1, f);
+        prg_rom    = img;
+        prg_offset = img->load_addr;
+        prg_len    = img->len;
         load_prg();
     }
-    fclose(f);
+    return true;
 }
 void Mem::load_bios()
 {
-    clear_bios();
-    for (int i = 0; i < bios_len; i++) {
-        ram[0xc000 + i] = bios_rom[i] & 0xff;
-    }
+    memcpy(&ram[bios_rom->load_addr], bios_rom->data, bios_len);
+    rehash();
 }
 void Mem::clear_bios()
 {
-    if (bios_rom != nullptr)
-        delete bios_rom;
+    bios_rom = nullptr;
+    bios_len = 0;
 }
 void Mem::load_prg()
 {
-    clear_prg();
-    prg_offset = ((prg_rom[0] & 0xff) | ((prg_rom[1] & 0xff) << 8));
-    prg_len    = ((prg_rom[2] & 0xff) | ((prg_rom[3] & 0xff) << 8));
-    int ptr    = prg_offset;
-
-    for (size_t i = 4; i < prg_len + 4; i++) {
-        ram[ptr++] = prg_rom[i] & 0xff;
-    }
+    memcpy(&ram[prg_offset], prg_rom->data, prg_len);
+    rehash();
 }
 void Mem::clear_prg()
 {
-    if (prg_rom != nullptr)
-        delete prg_rom;
+    prg_rom    = nullptr;
+    prg_offset = 0;
+    prg_len    = 0;
 }
 void Mem::reset()
 {
     clear_bios();
     clear_prg();
-    for (size_t i = 0; i < 0xffff; i++) {
-        ram[i] = 0;
-    }
-
-    for (size_t i = 0; i < 0x2000 * 2; i++) {
-        offset_to_scanline[i] = 0;
-    }
-
-    for (size_t row = 0; row < 192; row++) {
-        size_t src = ((row & 7) * 0x400) + (((row >> 3) & 0x07) * 0x80) + (((row >> 6) & 0x7) * 0x28);
-
-        for (size_t x = 0; x < 40; x++) {
-            offset_to_scanline[src + x]          = row;
-            offset_to_scanline[0x2000 + src + x] = (row + 192);
-        }
-    }
-
-    for (size_t i = 0; i < 2 * 192; i++) {
-        dirty_scanlines[i] = 1;
-    }
+    key       = 0;
+    writes    = 0;
+    io_reads  = 0;
+    c8_slot   = 0;
+    switches  = SW_HIRES;
+    scan_line = 0;
+    memset(ram, 0, sizeof(ram));
+    set_aux(nullptr);
+#ifdef MEM_HASH
+    ram_hash = 0;
+#endif
+    memset(dirty_scanlines, 1, sizeof(dirty_scanlines));
+    memset(dirty_text, 1, sizeof(dirty_text));
+    video_writes++;
+    update_banks();
 }
@@ -2,53 +2,160 @@
 #define _H_HEAD1_
 #include <cstddef>
 #include <cstdint>
-#include <vector>
 #include <string>
+#include "heatmap.h"
+#include "loader.h"
+#include "slot.h"
 
 using namespace std;
 
+#define TRAP_IO    0x1
+#define TRAP_WATCH 0x2
+#define TRAP_AUX   0x4
+
+// IIe soft switches, kept as bits in Mem::switches. PAGE2 stays in page_2.
+#define SW_TEXT    0x01
+#define SW_MIXED   0x02
+#define SW_HIRES   0x04
+#define SW_80COL   0x08
+#define SW_DHIRES  0x10
+#define SW_80STORE 0x20
+#define SW_RAMRD   0x40
+#define SW_RAMWRT  0x80
+
+#define BANK_READ  0x1
+#define BANK_WRITE 0x2
+
+// A frame here is FRAME_CYCLES CPU cycles; the beam position scales it onto
+// the 262 lines of 65 cycles of a real frame, lines 192-261 being blanking.
+#define FRAME_CYCLES      12600
+#define VIDEO_LINE_CYCLES 65
+#define VIDEO_LINES       262
+
+typedef void (*WatchFn)(void *ctx, uint16_t addr, uint8_t data, bool write);
+
+// Hi-res lookup tables. They only depend on the video layout, so they are
+// computed at compile time and shared by every Mem.
+struct VideoTables
+{
+    uint8_t  color_lut[256][4 * 7 * 2];
+    uint16_t offset_to_scanline[0x2000 * 2];
+    uint16_t scanline_to_offset[192];
+    uint8_t  offset_to_text_row[0x800];
+    uint16_t text_row_to_offset[24];
+    uint8_t  text_glyph[256][8];
+};
+
 class Mem {
   public:
-    uint8_t *bios_rom = nullptr;
-    size_t   bios_len = 0;
+    const RomImage *bios_rom = nullptr;
+    size_t          bios_len = 0;
+
+    const RomImage *prg_rom    = nullptr;
+    size_t          prg_offset = 0;
+    size_t          prg_len    = 0;
+
+    int      page_2   = 0;
+    uint32_t switches = SW_HIRES;
+    uint8_t  key      = 0;
 
-    uint8_t *prg_rom    = nullptr;
-    size_t   prg_offset = 0;
-    size_t   prg_len    = 0;
+    size_t writes       = 0;
+    size_t video_writes = 0;
+    size_t io_reads     = 0;
 
-    int     page_2 = 0;
-    uint8_t ram[0xffff]{};
+#ifdef MEM_HASH
+    uint64_t ram_hash = 0;
+#endif
+    Heatmap *heat = nullptr;
+
+    uint8_t ram[0x10000]{};
     uint8_t dirty_scanlines[2 * 192]{};
-    uint8_t offset_to_scanline[0x2000 * 2]{};
-
-    uint8_t              *color_lut[256]{};
-    std::vector<uint16_t> scanline_to_offset = {
-        0x0000, 0x0400, 0x0800, 0x0c00, 0x1000, 0x1400, 0x1800, 0x1c00, 0x0080, 0x0480, 0x0880, 0x0c80, 0x1080, 0x1480,
-        0x1880, 0x1c80, 0x0100, 0x0500, 0x0900, 0x0d00, 0x1100, 0x1500, 0x1900, 0x1d00, 0x0180, 0x0580, 0x0980, 0x0d80,
-        0x1180, 0x1580, 0x1980, 0x1d80, 0x0200, 0x0600, 0x0a00, 0x0e00, 0x1200, 0x1600, 0x1a00, 0x1e00, 0x0280, 0x0680,
-        0x0a80, 0x0e80, 0x1280, 0x1680, 0x1a80, 0x1e80, 0x0300, 0x0700, 0x0b00, 0x0f00, 0x1300, 0x1700, 0x1b00, 0x1f00,
-        0x0380, 0x0780, 0x0b80, 0x0f80, 0x1380, 0x1780, 0x1b80, 0x1f80, 0x0028, 0x0428, 0x0828, 0x0c28, 0x1028, 0x1428,
-        0x1828, 0x1c28, 0x00a8, 0x04a8, 0x08a8, 0x0ca8, 0x10a8, 0x14a8, 0x18a8, 0x1ca8, 0x0128, 0x0528, 0x0928, 0x0d28,
-        0x1128, 0x1528, 0x1928, 0x1d28, 0x01a8, 0x05a8, 0x09a8, 0x0da8, 0x11a8, 0x15a8, 0x19a8, 0x1da8, 0x0228, 0x0628,
-        0x0a28, 0x0e28, 0x1228, 0x1628, 0x1a28, 0x1e28, 0x02a8, 0x06a8, 0x0aa8, 0x0ea8, 0x12a8, 0x16a8, 0x1aa8, 0x1ea8,
-        0x0328, 0x0728, 0x0b28, 0x0f28, 0x1328, 0x1728, 0x1b28, 0x1f28, 0x03a8, 0x07a8, 0x0ba8, 0x0fa8, 0x13a8, 0x17a8,
-        0x1ba8, 0x1fa8, 0x0050, 0x0450, 0x0850, 0x0c50, 0x1050, 0x1450, 0x1850, 0x1c50, 0x00d0, 0x04d0, 0x08d0, 0x0cd0,
-        0x10d0, 0x14d0, 0x18d0, 0x1cd0, 0x0150, 0x0550, 0x0950, 0x0d50, 0x1150, 0x1550, 0x1950, 0x1d50, 0x01d0, 0x05d0,
-        0x09d0, 0x0dd0, 0x11d0, 0x15d0, 0x19d0, 0x1dd0, 0x0250, 0x0650, 0x0a50, 0x0e50, 0x1250, 0x1650, 0x1a50, 0x1e50,
-        0x02d0, 0x06d0, 0x0ad0, 0x0ed0, 0x12d0, 0x16d0, 0x1ad0, 0x1ed0, 0x0350, 0x0750, 0x0b50, 0x0f50, 0x1350, 0x1750,
-        0x1b50, 0x1f50, 0x03d0, 0x07d0, 0x0bd0, 0x0fd0, 0x13d0, 0x17d0, 0x1bd0, 0x1fd0};
+    uint8_t dirty_text[2 * 24 + 1]{};
+
+    // The beam is derived on demand from the cycle counter the Cpu points
+    // clock at and the cycle its current frame started.
+    const size_t *clock       = nullptr;
+    size_t        frame_start = 0;
+
+    // Display mode of each line the beam has passed, filled in only when the
+    // mode or page changes mid-frame; lines from scan_line on use the current
+    // mode. draw_frame() consumes and resets them.
+    uint32_t line_mode[192]{};
+    int      scan_line = 0;
+
+    // $C000-$C0FF by low byte, then the $Cn00 pages and $C800 space per slot
+    IoHandler io[256];
+    IoHandler slot_rom[8]{};
+    IoHandler slot_c8[8]{};
+    int       c8_slot = 0;
+
+    // Pages whose accesses leave the plain RAM path: the I/O and slot pages,
+    // and pages with a watchpoint, which call watch_fn on every access.
+    uint8_t trap[256]{};
+    WatchFn watch_fn  = nullptr;
+    void   *watch_ctx = nullptr;
+
+    // Per page, whether reads and writes go to aux memory (BANK_READ and
+    // BANK_WRITE); such pages are also marked TRAP_AUX. The 48K of aux memory
+    // is allocated the first time a page is banked in; until then aux points
+    // at a shared block of zeros, which is never written.
+    uint8_t  bank[256]{};
+    bool     banked = false;    // some page is banked to aux
+    uint8_t *aux    = no_aux;
+
+    static uint8_t no_aux[0xc000];
+
+    static const uint8_t (&color_lut)[256][4 * 7 * 2];
+    static const uint16_t (&offset_to_scanline)[0x2000 * 2];
+    static const uint16_t (&scanline_to_offset)[192];
+    static const uint8_t (&offset_to_text_row)[0x800];
+    static const uint16_t (&text_row_to_offset)[24];
+    static const uint8_t (&text_glyph)[256][8];
 
   public:
     Mem();
     ~Mem();
     void init();
-    void make_color_lut();
 
     uint8_t  get(uint16_t addr);
     void     set(uint16_t addr, uint8_t data);
+    uint64_t hash_ram();
+    void     rehash();
     uint16_t get16(uint16_t addr);
+    void     key_down(uint8_t ascii);
+    void     set_switch(uint16_t addr);
+    void     update_banks();
+    void     set_aux(const uint8_t *data);
+    void     start_frame(size_t cycle);
+    uint8_t  floating_bus();
 
-    void set_bin(string filename, bool bios);
+    inline bool has_aux()
+    {
+        return aux != no_aux;
+    }
+    // With 80STORE on, PAGE2 selects aux display memory instead of page 2.
+    inline int display_page()
+    {
+        return page_2 && !(switches & SW_80STORE);
+    }
+    // The switches that change what is displayed, and the display page in
+    // bit 8.
+    inline uint32_t display_mode()
+    {
+        return (switches & (SW_TEXT | SW_MIXED | SW_HIRES | SW_80COL | SW_DHIRES)) | display_page() << 8;
+    }
+    // Cycle within the frame on the real 65 x 262 timing; line is cycle / 65.
+    inline int beam_cycle()
+    {
+        if (clock == nullptr)
+            return 0;
+        return (*clock - frame_start) % FRAME_CYCLES * (VIDEO_LINE_CYCLES * VIDEO_LINES) / FRAME_CYCLES;
+    }
+
+    bool insert_card(int slot, const Card &card);
+    void remove_card(int slot);
+
+    bool set_bin(string filename, bool bios);
     void load_bios();
     void clear_bios();
 
@@ -56,5 +163,42 @@ class Mem {
     void clear_prg();
 
     void reset();
+
+    static inline uint64_t mix(uint64_t v)
+    {
+        v ^= v >> 30;
+        v *= 0xbf58476d1ce4e5b9ull;
+        v ^= v >> 27;
+        v *= 0x94d049bb133111ebull;
+        v ^= v >> 31;
+        return v;
+    }
+    // Zobrist key of one RAM byte; zero bytes hash to 0 so cleared RAM does too.
+    // Aux bytes use the keys of addresses from $10000 up.
+    static inline uint64_t zobrist(uint32_t addr, uint8_t value)
+    {
+        return value != 0 ? mix(((uint64_t)addr << 8 | value) + 0x9e3779b97f4a7c15ull) : 0;
+    }
+
+  private:
+    inline void store(uint16_t addr, uint8_t data)
+    {
+#ifdef MEM_HASH
+        ram_hash ^= zobrist(addr, ram[addr]) ^ zobrist(addr, data);
+#endif
+        ram[addr] = data;
+    }
+    inline void store_aux(uint16_t addr, uint8_t data)
+    {
+#ifdef MEM_HASH
+        ram_hash ^= zobrist(0x10000 + addr, aux[addr]) ^ zobrist(0x10000 + addr, data);
+#endif
+        aux[addr] = data;
+    }
+    void    split(uint32_t mode);
+    uint8_t trap_get(uint16_t addr);
+    void    trap_set(uint16_t addr, uint8_t data);
+    uint8_t slot_get(uint16_t addr);
+    void    slot_set(uint16_t addr, uint8_t data);
 };
 #endif
@@ -0,0 +1,160 @@
+#include "metrics.h"
+#include <cstring>
+#include <string>
+
+const Metrics::Info Metrics::info[METRIC_COUNT] = {
+    {"apple2_cpu_step_seconds", "Cpu::step, one emulated frame including draw_frame", true},
+    {"apple2_draw_frame_seconds", "Cpu::draw_frame", true},
+    {"apple2_update_texture_seconds", "copying the frame into the SDL texture", true},
+    {"apple2_render_present_seconds", "SDL_RenderClear, SDL_RenderCopy and SDL_RenderPresent", true},
+    {"apple2_sleep_seconds", "sleeping to pace frames", true},
+    {"apple2_instructions_total", "6502 instructions executed", false},
+    {"apple2_frames_total", "frames emulated", false},
+    {"apple2_frames_dropped_total", "frames that finished after their deadline", false},
+};
+
+std::atomic<uint64_t>      Metrics::serials{1};
+thread_local uint64_t      Metrics::owner = 0;
+thread_local MetricsShard *Metrics::local = nullptr;
+
+Metrics::Metrics()
+{
+    serial = serials.fetch_add(1);
+}
+Metrics::~Metrics()
+{
+    for (MetricsShard *s : shards)
+        delete s;
+}
+void Metrics::attach()
+{
+    std::lock_guard<std::mutex> lk(lock);
+    MetricsShard               *found = nullptr;
+    for (MetricsShard *s : shards) {
+        if (s->thread == std::this_thread::get_id())
+            found = s;
+    }
+    if (found == nullptr) {
+        found         = new MetricsShard{};
+        found->thread = std::this_thread::get_id();
+        for (int id = 0; id < METRIC_COUNT; id++)
+            found->min[id] = UINT64_MAX;
+        shards.push_back(found);
+    }
+    owner = serial;
+    local = found;
+}
+uint64_t Metrics::bucket_low(int i)
+{
+    if (i < HIST_SUB)
+        return i;
+    int e = i / HIST_SUB + 3;
+    return (uint64_t)(HIST_SUB + i % HIST_SUB) << (e - 4);
+}
+void Metrics::merge(MetricId id, uint64_t *buckets, uint64_t *count, uint64_t *sum, uint64_t *min, uint64_t *max)
+{
+    std::lock_guard<std::mutex> lk(lock);
+    *count = *sum = *max = 0;
+    *min               = UINT64_MAX;
+    if (buckets != nullptr)
+        memset(buckets, 0, HIST_BUCKETS * sizeof(uint64_t));
+    for (MetricsShard *s : shards) {
+        *count += s->value[id].load(std::memory_order_relaxed);
+        *sum += s->sum[id].load(std::memory_order_relaxed);
+        uint64_t lo = s->min[id].load(std::memory_order_relaxed);
+        uint64_t hi = s->max[id].load(std::memory_order_relaxed);
+        *min        = lo < *min ? lo : *min;
+        *max        = hi > *max ? hi : *max;
+        for (int i = 0; buckets != nullptr && i < HIST_BUCKETS; i++)
+            buckets[i] += s->buckets[id][i].load(std::memory_order_relaxed);
+    }
+}
+uint64_t Metrics::value(MetricId id)
+{
+    uint64_t count, sum, min, max;
+    merge(id, nullptr, &count, &sum, &min, &max);
+    return count;
+}
+// The low edge of the bucket holding the q-th value, so within 1/16 below it.
+uint64_t Metrics::quantile(MetricId id, double q)
+{
+    uint64_t buckets[HIST_BUCKETS];
+    uint64_t count, sum, min, max;
+    merge(id, buckets, &count, &sum, &min, &max);
+    if (count == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(q * (count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint64_t v = bucket_low(i);
+            return v < min ? min : v > max ? max : v;
+        }
+    }
+    return max;
+}
+// Prometheus histograms get one cumulative bucket per power of two between
+// the smallest and largest value seen; JSON gets count, sum, min, max and
+// quantiles in nanoseconds.
+bool Metrics::dump(FILE *out, bool json)
+{
+    uint64_t buckets[HIST_BUCKETS];
+    if (json)
+        fprintf(out, "{\n");
+    for (int id = 0; id < METRIC_COUNT; id++) {
+        const Info &m = info[id];
+        uint64_t    count, sum, min, max;
+        merge((MetricId)id, m.histogram ? buckets : nullptr, &count, &sum, &min, &max);
+        const char *sep = id + 1 < METRIC_COUNT ? "," : "";
+
+        if (json && !m.histogram) {
+            fprintf(out, "  \"%s\": %llu%s\n", m.name, (unsigned long long)count, sep);
+        } else if (json) {
+            fprintf(out,
+                    "  \"%s\": {\"count\": %llu, \"sum_ns\": %llu, \"min_ns\": %llu, \"max_ns\": %llu, \"p50_ns\": "
+                    "%llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu}%s\n",
+                    m.name, (unsigned long long)count, (unsigned long long)sum,
+                    (unsigned long long)(count ? min : 0), (unsigned long long)max,
+                    (unsigned long long)quantile((MetricId)id, 0.5), (unsigned long long)quantile((MetricId)id, 0.9),
+                    (unsigned long long)quantile((MetricId)id, 0.99), (unsigned long long)quantile((MetricId)id, 0.999),
+                    sep);
+        } else if (!m.histogram) {
+            fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", m.name, m.help, m.name, m.name,
+                    (unsigned long long)count);
+        } else {
+            fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", m.name, m.help, m.name);
+            uint64_t seen = 0;
+            int      i    = 0;
+            for (int e = count ? 63 - __builtin_clzll(min | 1) : 64; e < 64; e++) {
+                uint64_t edge = 2ull << e;
+                while (i < HIST_BUCKETS && bucket_low(i) < edge)
+                    seen += buckets[i++];
+                fprintf(out, "%s_bucket{le=\"%.9g\"} %llu\n", m.name, edge * 1e-9, (unsigned long long)seen);
+                if (seen == count)
+                    break;
+            }
+            fprintf(out, "%s_bucket{le=\"+Inf\"} %llu\n", m.name, (unsigned long long)count);
+            fprintf(out, "%s_sum %.9f\n%s_count %llu\n", m.name, sum * 1e-9, m.name, (unsigned long long)count);
+        }
+    }
+    if (json)
+        fprintf(out, "}\n");
+    return ferror(out) == 0;
+}
+// "-" is stdout; a name ending in .json gets JSON, anything else Prometheus.
+bool Metrics::dump(const char *path)
+{
+    string p    = path;
+    bool   json = p.size() > 5 && p.compare(p.size() - 5, 5, ".json") == 0;
+    if (p == "-")
+        return dump(stdout, false);
+    FILE *out = fopen(path, "w");
+    if (out == nullptr) {
+        printf("metrics: cannot write %s\n", path);
+        return false;
+    }
+    bool ok = dump(out, json);
+    fclose(out);
+    return ok;
+}
@@ -0,0 +1,119 @@
+#ifndef _H_METRICS
+#define _H_METRICS
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+enum MetricId
+{
+    M_CPU_STEP,
+    M_DRAW_FRAME,
+    M_UPDATE_TEXTURE,
+    M_RENDER_PRESENT,
+    M_SLEEP,
+    M_INSTRUCTIONS,
+    M_FRAMES,
+    M_FRAMES_DROPPED,
+    METRIC_COUNT
+};
+
+// Log-linear buckets: values below 16 exactly, then 16 buckets per power of
+// two, so every bucket is within 1/16 of its value. Values are nanoseconds.
+#define HIST_SUB     16
+#define HIST_BUCKETS (61 * HIST_SUB)
+
+// One thread's copy of every metric. Only the owning thread writes, so
+// updates are relaxed load/store pairs; the atomics only make the reads from
+// dump() well defined.
+struct MetricsShard
+{
+    std::thread::id       thread;
+    std::atomic<uint64_t> value[METRIC_COUNT];
+    std::atomic<uint64_t> sum[METRIC_COUNT];
+    std::atomic<uint64_t> min[METRIC_COUNT];
+    std::atomic<uint64_t> max[METRIC_COUNT];
+    std::atomic<uint64_t> buckets[METRIC_COUNT][HIST_BUCKETS];
+};
+
+// Counters and latency histograms for the frame loop. Each thread records
+// into its own shard, found through a thread_local cache; dump() merges the
+// shards and writes Prometheus text or JSON.
+class Metrics {
+  public:
+    struct Info
+    {
+        const char *name;
+        const char *help;
+        bool        histogram;
+    };
+    static const Info info[METRIC_COUNT];
+
+  private:
+    uint64_t                    serial;
+    std::mutex                  lock;
+    std::vector<MetricsShard *> shards;
+
+    static std::atomic<uint64_t>      serials;
+    static thread_local uint64_t      owner;
+    static thread_local MetricsShard *local;
+
+  public:
+    Metrics();
+    ~Metrics();
+
+    static inline uint64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+    inline void add(MetricId id, uint64_t n)
+    {
+        MetricsShard *s = shard();
+        s->value[id].store(s->value[id].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    inline void observe(MetricId id, uint64_t ns)
+    {
+        MetricsShard *s = shard();
+        auto         &b = s->buckets[id][bucket(ns)];
+        b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        s->value[id].store(s->value[id].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        s->sum[id].store(s->sum[id].load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+        if (ns < s->min[id].load(std::memory_order_relaxed))
+            s->min[id].store(ns, std::memory_order_relaxed);
+        if (ns > s->max[id].load(std::memory_order_relaxed))
+            s->max[id].store(ns, std::memory_order_relaxed);
+    }
+
+    static inline int bucket(uint64_t v)
+    {
+        if (v < HIST_SUB)
+            return v;
+        int e = 63 - __builtin_clzll(v);
+        return (e - 3) * HIST_SUB + ((v >> (e - 4)) & (HIST_SUB - 1));
+    }
+    static uint64_t bucket_low(int i);
+
+    uint64_t value(MetricId id);
+    uint64_t quantile(MetricId id, double q);
+    bool     dump(FILE *out, bool json);
+    bool     dump(const char *path);
+
+  private:
+    inline MetricsShard *shard()
+    {
+        if (owner != serial)
+            attach();
+        return local;
+    }
+    void attach();
+    void merge(MetricId id, uint64_t *buckets, uint64_t *count, uint64_t *sum, uint64_t *min, uint64_t *max);
+};
+#endif
@@ -0,0 +1,426 @@
+#include "mockingboard.h"
+#include <cstring>
+
+// Output level of each 4-bit amplitude, roughly 3dB a step, scaled so that
+// three channels at full volume fit in 16 bits.
+static const int32_t levels[16] = {
+    0, 116, 164, 242, 350, 509, 726, 1135, 1351, 2169, 3061, 3875, 5136, 6586, 8224, 10922,
+};
+static const uint8_t reg_mask[16] = {
+    0xff, 0x0f, 0xff, 0x0f, 0xff, 0x0f, 0x1f, 0xff, 0x1f, 0x1f, 0x1f, 0xff, 0xff, 0x0f, 0xff, 0xff,
+};
+
+void Ay8910::reset(size_t cycle)
+{
+    latch = 0;
+    for (int r = 0; r < 16; r++) {
+        regs[r] = 0;
+        log.push_back(AyWrite{cycle, (uint8_t)r, 0});
+    }
+}
+void Ay8910::write(size_t cycle, uint8_t value)
+{
+    value       = value & reg_mask[latch];
+    regs[latch] = value;
+    log.push_back(AyWrite{cycle, latch, value});
+}
+uint8_t Ay8910::read()
+{
+    return regs[latch];
+}
+void Ay8910::apply(const AyWrite &w)
+{
+    state[w.reg] = w.value;
+    if (w.reg == 13) {
+        env_pos  = 0;
+        env_inv  = w.value & 4 ? 0 : 15;
+        env_hold = false;
+        env_acc  = 0;
+    }
+}
+// Shape bits: 8 continue, 4 attack, 2 alternate, 1 hold.
+void Ay8910::env_step()
+{
+    if (env_hold || ++env_pos < 16)
+        return;
+    uint8_t shape = state[13];
+    if (!(shape & 8)) {
+        env_hold = true;
+        env_pos  = env_inv;
+    } else if (shape & 1) {
+        env_hold = true;
+        env_pos  = shape & 2 ? 0 : 15;
+    } else {
+        env_inv ^= shape & 2 ? 15 : 0;
+        env_pos = 0;
+    }
+}
+// Noise and envelope are stepped sample by sample into small buffers; the
+// tone channels are then mixed in loops without branches or carried state,
+// which the compiler vectorises.
+void Ay8910::render(int16_t *out, int stride, size_t n, int rate)
+{
+    uint32_t tone_step[3];
+    for (int c = 0; c < 3; c++) {
+        uint32_t tp  = state[c * 2] | state[c * 2 + 1] << 8;
+        tone_step[c] = (uint32_t)(((uint64_t)MB_CLOCK << 32) / ((uint64_t)16 * (tp ? tp : 1) * rate));
+    }
+    uint32_t np        = state[6] ? state[6] : 1;
+    uint32_t ep        = state[11] | state[12] << 8;
+    uint64_t noise_inc = ((uint64_t)MB_CLOCK << 32) / ((uint64_t)32 * np * rate);
+    uint64_t env_inc   = ((uint64_t)MB_CLOCK << 32) / ((uint64_t)16 * (ep ? ep : 1) * rate);
+    uint8_t  mixer     = state[7];
+
+    uint8_t noise[MB_CHUNK];
+    uint8_t env[MB_CHUNK];
+    int32_t mix[MB_CHUNK];
+    for (size_t done = 0; done < n;) {
+        uint32_t m = n - done < MB_CHUNK ? n - done : MB_CHUNK;
+        for (uint32_t i = 0; i < m; i++) {
+            for (noise_acc += noise_inc; noise_acc >> 32; noise_acc -= 1ull << 32)
+                lfsr = lfsr >> 1 | ((lfsr ^ lfsr >> 3) & 1) << 16;
+            noise[i] = lfsr & 1;
+            for (env_acc += env_inc; env_acc >> 32; env_acc -= 1ull << 32)
+                env_step();
+            env[i] = env_pos ^ env_inv;
+        }
+        memset(mix, 0, m * sizeof(int32_t));
+        for (int c = 0; c < 3; c++) {
+            uint8_t  amp  = state[8 + c];
+            uint32_t toff = mixer >> c & 1;
+            uint32_t noff = mixer >> (3 + c) & 1;
+            uint32_t ph   = tone_phase[c];
+            uint32_t st   = tone_step[c];
+            if (amp & 0x10) {
+                for (uint32_t i = 0; i < m; i++)
+                    mix[i] += levels[env[i]] * (((ph + st * i) >> 31 | toff) & (noise[i] | noff));
+            } else if (levels[amp] != 0) {
+                int32_t v = levels[amp];
+                for (uint32_t i = 0; i < m; i++)
+                    mix[i] += v * (((ph + st * i) >> 31 | toff) & (noise[i] | noff));
+            }
+            tone_phase[c] = ph + st * m;
+        }
+        for (uint32_t i = 0; i < m; i++)
+            out[(done + i) * stride] = mix[i];
+        done += m;
+    }
+}
+
+static uint8_t mb_read(void *ctx, uint16_t addr)
+{
+    return ((Mockingboard *)ctx)->read(addr);
+}
+static void mb_write(void *ctx, uint16_t addr, uint8_t data)
+{
+    ((Mockingboard *)ctx)->write(addr, data);
+}
+static void t1_due(void *ctx, size_t cycle)
+{
+    Via6522 *v = (Via6522 *)ctx;
+    v->board->timer(*v, VIA_T1, cycle);
+}
+static void t2_due(void *ctx, size_t cycle)
+{
+    Via6522 *v = (Via6522 *)ctx;
+    v->board->timer(*v, VIA_T2, cycle);
+}
+static void board_moved(void *ctx, size_t from, size_t to)
+{
+    ((Via6522 *)ctx)->board->moved(from, to);
+}
+
+Mockingboard::Mockingboard(Cpu *cpu, int slot, int rate)
+{
+    this->cpu  = cpu;
+    this->slot = slot;
+    this->rate = rate;
+    origin     = cpu->totalcycle;
+    for (int n = 0; n < 2; n++) {
+        via[n].board    = this;
+        via[n].index    = n;
+        via[n].t1_zero  = SIZE_MAX;
+        via[n].t2_zero  = SIZE_MAX;
+        via[n].t1_event = cpu->events.add(t1_due, &via[n], n == 0 ? board_moved : nullptr);
+        via[n].t2_event = cpu->events.add(t2_due, &via[n]);
+        ay[n].reset(origin);
+    }
+    if (!ok() || !cpu->mem->insert_card(slot, Card{{}, {mb_read, mb_write, this}, {}}))
+        this->slot = 0;
+}
+Mockingboard::~Mockingboard()
+{
+    for (int n = 0; n < 2; n++) {
+        if (via[n].t1_event >= 0)
+            cpu->events.remove(via[n].t1_event);
+        if (via[n].t2_event >= 0)
+            cpu->events.remove(via[n].t2_event);
+        cpu->release_irq(MB_IRQ << n);
+    }
+    if (slot != 0)
+        cpu->mem->remove_card(slot);
+}
+bool Mockingboard::ok()
+{
+    return slot != 0 && via[0].t1_event >= 0 && via[0].t2_event >= 0 && via[1].t1_event >= 0 &&
+           via[1].t2_event >= 0;
+}
+uint8_t Mockingboard::read(uint16_t addr)
+{
+    int      n   = addr >> 7 & 1;
+    Via6522 &v   = via[n];
+    size_t   now = cpu->totalcycle;
+    uint16_t t1  = v.t1_zero - 1 - now;
+    uint16_t t2  = v.t2_zero - 1 - now;
+    switch (addr & 0x0f) {
+        case 0x0:
+            return (v.orb & v.ddrb) | ~v.ddrb;
+        case 0x1:
+        case 0xf: {
+            uint8_t pins = ((v.orb | ~v.ddrb) & 7) == 5 ? ay[n].read() : 0xff;
+            return (v.ora & v.ddra) | (pins & ~v.ddra);
+        }
+        case 0x2:
+            return v.ddrb;
+        case 0x3:
+            return v.ddra;
+        case 0x4:
+            v.ifr &= ~VIA_T1;
+            update_irq(n);
+            return t1;
+        case 0x5:
+            return t1 >> 8;
+        case 0x6:
+            return v.t1_latch;
+        case 0x7:
+            return v.t1_latch >> 8;
+        case 0x8:
+            v.ifr &= ~VIA_T2;
+            update_irq(n);
+            return t2;
+        case 0x9:
+            return t2 >> 8;
+        case 0xa:
+            return v.sr;
+        case 0xb:
+            return v.acr;
+        case 0xc:
+            return v.pcr;
+        case 0xd:
+            return v.ifr | (v.ifr & v.ier & 0x7f ? 0x80 : 0);
+        case 0xe:
+            return v.ier | 0x80;
+    }
+    return 0;
+}
+void Mockingboard::write(uint16_t addr, uint8_t data)
+{
+    int      n   = addr >> 7 & 1;
+    Via6522 &v   = via[n];
+    size_t   now = cpu->totalcycle;
+    switch (addr & 0x0f) {
+        case 0x0:
+            v.orb = data;
+            control(n);
+            break;
+        case 0x1:
+        case 0xf:
+            v.ora = data;
+            break;
+        case 0x2:
+            v.ddrb = data;
+            control(n);
+            break;
+        case 0x3:
+            v.ddra = data;
+            break;
+        case 0x4:
+        case 0x6:
+            v.t1_latch = (v.t1_latch & 0xff00) | data;
+            break;
+        case 0x5:
+            v.t1_latch = (v.t1_latch & 0x00ff) | data << 8;
+            v.t1_zero  = now + v.t1_latch + 1;
+            v.t1_armed = true;
+            v.ifr &= ~VIA_T1;
+            cpu->events.at(v.t1_event, v.t1_zero);
+            break;
+        case 0x7:
+            v.t1_latch = (v.t1_latch & 0x00ff) | data << 8;
+            v.ifr &= ~VIA_T1;
+            break;
+        case 0x8:
+            v.t2_latch = (v.t2_latch & 0xff00) | data;
+            break;
+        case 0x9:
+            v.t2_latch = (v.t2_latch & 0x00ff) | data << 8;
+            v.t2_zero  = now + v.t2_latch + 1;
+            v.t2_armed = true;
+            v.ifr &= ~VIA_T2;
+            cpu->events.at(v.t2_event, v.t2_zero);
+            break;
+        case 0xa:
+            v.sr = data;
+            break;
+        case 0xb:
+            v.acr = data;
+            break;
+        case 0xc:
+            v.pcr = data;
+            break;
+        case 0xd:
+            v.ifr &= ~data;
+            break;
+        case 0xe:
+            v.ier = data & 0x80 ? v.ier | (data & 0x7f) : v.ier & ~data;
+            break;
+    }
+    update_irq(n);
+}
+// A timer reaching zero raises its flag. T1 in free-running mode (ACR bit 6)
+// reloads from the latch and goes again, N + 2 cycles a period; otherwise
+// the count runs on without raising the flag until it is rewritten.
+void Mockingboard::timer(Via6522 &v, int flag, size_t cycle)
+{
+    if (flag == VIA_T1) {
+        if (!v.t1_armed)
+            return;
+        if (v.acr & 0x40) {
+            v.t1_zero = cycle + v.t1_latch + 2;
+            cpu->events.at(v.t1_event, v.t1_zero);
+        } else {
+            v.t1_armed = false;
+        }
+    } else {
+        if (!v.t2_armed)
+            return;
+        v.t2_armed = false;
+    }
+    v.ifr |= flag;
+    update_irq(v.index);
+}
+void Mockingboard::update_irq(int n)
+{
+    Via6522 &v = via[n];
+    if (v.ifr & v.ier & 0x7f) {
+        if (!(cpu->irq_lines & (MB_IRQ << n)))
+            irqs++;
+        cpu->assert_irq(MB_IRQ << n);
+    } else {
+        cpu->release_irq(MB_IRQ << n);
+    }
+}
+// Port B drives the PSG bus: /RESET low resets it, otherwise BDIR/BC1 pick
+// inactive, read, write or latch address.
+void Mockingboard::control(int n)
+{
+    Via6522 &v    = via[n];
+    uint8_t  pins = v.orb | ~v.ddrb;
+    uint8_t  data = v.ora & v.ddra;
+    if (!(pins & 4)) {
+        ay[n].reset(cpu->totalcycle);
+        return;
+    }
+    switch (pins & 3) {
+        case 2:
+            ay[n].write(cpu->totalcycle, data);
+            break;
+        case 3:
+            ay[n].latch = data & 0x0f;
+            break;
+    }
+}
+// The cycle counter jumped: every cycle the board keeps moves with it, so
+// running timers and the audio carry on from where they were. The first
+// 6522's T1 event reports it once for the whole board.
+void Mockingboard::moved(size_t from, size_t to)
+{
+    origin = origin - from + to;
+    for (int n = 0; n < 2; n++) {
+        if (via[n].t1_zero != SIZE_MAX)
+            via[n].t1_zero = via[n].t1_zero - from + to;
+        if (via[n].t2_zero != SIZE_MAX)
+            via[n].t2_zero = via[n].t2_zero - from + to;
+        for (AyWrite &w : ay[n].log)
+            w.cycle = w.cycle - from + to;
+    }
+}
+size_t Mockingboard::sample_at(size_t cycle)
+{
+    size_t elapsed = cycle - origin;
+    return (int64_t)elapsed > 0 ? elapsed * rate / MB_CLOCK : 0;
+}
+// Renders at most `max` stereo frames, up to the current cycle, into out.
+size_t Mockingboard::render(int16_t *out, size_t max)
+{
+    size_t end    = sample_at(cpu->totalcycle);
+    size_t n      = end > samples ? (end - samples < max ? end - samples : max) : 0;
+    size_t target = samples + n;
+    for (int k = 0; k < 2; k++) {
+        Ay8910 &a    = ay[k];
+        size_t  pos  = samples;
+        size_t  used = 0;
+        for (; used < a.log.size(); used++) {
+            size_t at = sample_at(a.log[used].cycle);
+            if (at >= target && n > 0)
+                break;
+            if (at > pos) {
+                a.render(out + (pos - samples) * 2 + k, 2, at - pos, rate);
+                pos = at;
+            }
+            a.apply(a.log[used]);
+        }
+        if (target > pos)
+            a.render(out + (pos - samples) * 2 + k, 2, target - pos, rate);
+        a.log.erase(a.log.begin(), a.log.begin() + used);
+    }
+    samples = target;
+    return n;
+}
+
+WavWriter::WavWriter(string path, int rate, int channels)
+{
+    this->channels = channels;
+    out            = fopen(path.c_str(), "wb");
+    if (out == nullptr) {
+        printf("wav: cannot write %s\n", path.c_str());
+        return;
+    }
+    uint8_t hdr[44]{};
+    memcpy(hdr, "RIFF", 4);
+    memcpy(hdr + 8, "WAVEfmt ", 8);
+    uint32_t fmt[4] = {16, (uint32_t)(1 | channels << 16), (uint32_t)rate, (uint32_t)(rate * channels * 2)};
+    memcpy(hdr + 16, fmt, sizeof(fmt));
+    uint16_t align[2] = {(uint16_t)(channels * 2), 16};
+    memcpy(hdr + 32, align, sizeof(align));
+    memcpy(hdr + 36, "data", 4);
+    fwrite(hdr, sizeof(hdr), 1, out);
+}
+WavWriter::~WavWriter()
+{
+    close();
+}
+bool WavWriter::ok()
+{
+    return out != nullptr;
+}
+void WavWriter::write(const int16_t *samples, size_t count)
+{
+    if (out == nullptr)
+        return;
+    fwrite(samples, sizeof(int16_t) * channels, count, out);
+    frames += count;
+}
+void WavWriter::close()
+{
+    if (out == nullptr)
+        return;
+    uint32_t data = frames * channels * 2;
+    uint32_t riff = data + 36;
+    fseek(out, 4, SEEK_SET);
+    fwrite(&riff, 4, 1, out);
+    fseek(out, 40, SEEK_SET);
+    fwrite(&data, 4, 1, out);
+    fclose(out);
+    out = nullptr;
+}
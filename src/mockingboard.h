@@ -0,0 +1,128 @@
+#ifndef _H_MOCKINGBOARD
+#define _H_MOCKINGBOARD
+#include "cpu.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define MB_CLOCK 1020484    // CPU and PSG clock in Hz
+#define MB_IRQ   0x100      // irq source of the first 6522, the second is MB_IRQ << 1
+#define MB_CHUNK 256
+
+#define VIA_T2 0x20
+#define VIA_T1 0x40
+
+class Mockingboard;
+
+// One 6522. Port A is the PSG data bus, port B bits 0-2 its BC1, BDIR and
+// /RESET lines. The timers are not counted down: a timer keeps the cycle it
+// next reaches zero, reads derive the count from it, and a Scheduler event
+// raises the flag at that cycle.
+struct Via6522
+{
+    uint8_t  orb, ora, ddrb, ddra;
+    uint8_t  sr, acr, pcr, ifr, ier;
+    uint16_t t1_latch, t2_latch;
+    size_t   t1_zero, t2_zero;
+    bool     t1_armed, t2_armed;
+    int      t1_event, t2_event;
+
+    Mockingboard *board;
+    int           index;
+};
+
+struct AyWrite
+{
+    size_t  cycle;
+    uint8_t reg;
+    uint8_t value;
+};
+
+// AY-3-8910. Register writes are only logged with their cycle; render()
+// applies them when the audio reaches that cycle, so between two writes the
+// registers are constant and a whole run of samples is produced in one pass.
+class Ay8910 {
+  public:
+    uint8_t         regs[16]{};
+    uint8_t         latch = 0;
+    vector<AyWrite> log;
+
+  private:
+    uint8_t  state[16]{};
+    uint32_t tone_phase[3]{};
+    uint64_t noise_acc = 0;
+    uint32_t lfsr      = 1;
+    uint64_t env_acc   = 0;
+    int      env_pos   = 0;
+    int      env_inv   = 0;
+    bool     env_hold  = false;
+
+  public:
+    void    reset(size_t cycle);
+    void    write(size_t cycle, uint8_t value);
+    uint8_t read();
+
+    void apply(const AyWrite &w);
+    void render(int16_t *out, int stride, size_t n, int rate);
+
+  private:
+    void env_step();
+};
+
+// Mockingboard in a slot ($Cn00 page): the first 6522 and PSG at $Cn00-$Cn0F,
+// the second at $Cn80-$Cn8F. render() turns the PSG logs into 16-bit stereo,
+// the first PSG on the left and the second on the right, up to the current
+// cycle.
+class Mockingboard {
+  public:
+    Via6522 via[2]{};
+    Ay8910  ay[2];
+    size_t  irqs    = 0;
+    size_t  samples = 0;
+    int     rate;
+    int     slot;
+
+  private:
+    Cpu   *cpu;
+    size_t origin;
+
+  public:
+    Mockingboard(Cpu *cpu, int slot = 4, int rate = 44100);
+    ~Mockingboard();
+
+    bool   ok();
+    size_t render(int16_t *out, size_t max);
+
+    uint8_t read(uint16_t addr);
+    void    write(uint16_t addr, uint8_t data);
+    void    timer(Via6522 &v, int flag, size_t cycle);
+    void    moved(size_t from, size_t to);
+
+  private:
+    void   control(int n);
+    void   update_irq(int n);
+    size_t sample_at(size_t cycle);
+};
+
+// 16-bit PCM WAV writer; the sizes are patched in by close().
+class WavWriter {
+  public:
+    size_t frames = 0;
+
+  private:
+    FILE *out = nullptr;
+    int   channels;
+
+  public:
+    WavWriter(string path, int rate, int channels);
+    ~WavWriter();
+
+    bool ok();
+    void write(const int16_t *samples, size_t count);
+    void close();
+};
+#endif
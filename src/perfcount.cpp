@@ -0,0 +1,125 @@
+#include "perfcount.h"
+#include <cerrno>
+#include <cstring>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char *PerfCounters::names[PERF_EVENT_COUNT] = {
+    "task-clock-ns", "cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses",
+};
+
+PerfCounters::PerfCounters()
+{
+    for (int e = 0; e < PERF_EVENT_COUNT; e++)
+        fd[e] = -1;
+#ifdef __linux__
+    static const uint32_t types[PERF_EVENT_COUNT] = {
+        PERF_TYPE_SOFTWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE,
+    };
+    static const uint64_t configs[PERF_EVENT_COUNT] = {
+        PERF_COUNT_SW_TASK_CLOCK,
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    };
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size           = sizeof(attr);
+        attr.type           = types[e];
+        attr.config         = configs[e];
+        attr.disabled       = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fd[e]               = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd[e] < 0 && error.empty())
+            error = string(names[e]) + ": " + strerror(errno);
+    }
+#else
+    error = "perf_event_open needs Linux";
+#endif
+}
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        if (fd[e] >= 0)
+            close(fd[e]);
+    }
+#endif
+}
+bool PerfCounters::ok()
+{
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        if (fd[e] >= 0)
+            return true;
+    }
+    return false;
+}
+bool PerfCounters::has(PerfEvent e)
+{
+    return fd[e] >= 0;
+}
+// base holds value, time enabled and time running at start(); stop() adds
+// the difference, scaled by enabled/running if the event was multiplexed.
+void PerfCounters::start()
+{
+#ifdef __linux__
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        if (fd[e] < 0)
+            continue;
+        ioctl(fd[e], PERF_EVENT_IOC_ENABLE, 0);
+        if (read(fd[e], base[e], sizeof(base[e])) != sizeof(base[e]))
+            memset(base[e], 0, sizeof(base[e]));
+    }
+#endif
+}
+void PerfCounters::stop()
+{
+#ifdef __linux__
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        if (fd[e] < 0)
+            continue;
+        uint64_t now[3];
+        if (read(fd[e], now, sizeof(now)) != sizeof(now))
+            continue;
+        ioctl(fd[e], PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t count   = now[0] - base[e][0];
+        uint64_t enabled = now[1] - base[e][1];
+        uint64_t running = now[2] - base[e][2];
+        if (running > 0 && running < enabled)
+            count = (uint64_t)((double)count * enabled / running);
+        value[e] += count;
+    }
+#endif
+}
+void PerfCounters::clear()
+{
+    memset(value, 0, sizeof(value));
+}
+void PerfCounters::report(FILE *out, const char *label, size_t instructions, size_t frames)
+{
+    if (!ok()) {
+        fprintf(out, "%s perf counters unavailable (%s)\n", label, error.c_str());
+        return;
+    }
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        if (fd[e] < 0) {
+            fprintf(out, "%s %-13s      unavailable\n", label, names[e]);
+            continue;
+        }
+        fprintf(out, "%s %-13s %14llu  %10.3f per 6502 instruction  %12.1f per frame\n", label, names[e],
+                (unsigned long long)value[e], instructions ? (double)value[e] / instructions : 0.0,
+                frames ? (double)value[e] / frames : 0.0);
+    }
+    if (fd[PERF_CYCLES] >= 0 && fd[PERF_INSTRUCTIONS] >= 0 && value[PERF_CYCLES] > 0)
+        fprintf(out, "%s host IPC %.2f\n", label, (double)value[PERF_INSTRUCTIONS] / value[PERF_CYCLES]);
+}
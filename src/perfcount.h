@@ -0,0 +1,47 @@
+#ifndef _H_PERFCOUNT
+#define _H_PERFCOUNT
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+using namespace std;
+
+enum PerfEvent
+{
+    PERF_TASK_CLOCK,
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_EVENT_COUNT
+};
+
+// Linux perf_event_open counters for this thread, user space only. Each
+// event is opened on its own, so a missing PMU or a paranoid kernel only
+// loses the events it refuses; fd is -1 for those and report() says why.
+// start()/stop() pairs accumulate, scaled up when the kernel multiplexed.
+class PerfCounters {
+  public:
+    static const char *names[PERF_EVENT_COUNT];
+
+    int      fd[PERF_EVENT_COUNT];
+    uint64_t value[PERF_EVENT_COUNT]{};
+    string   error;
+
+  private:
+    uint64_t base[PERF_EVENT_COUNT][3]{};
+
+  public:
+    PerfCounters();
+    ~PerfCounters();
+
+    bool ok();
+    bool has(PerfEvent e);
+    void start();
+    void stop();
+    void clear();
+    void report(FILE *out, const char *label, size_t instructions, size_t frames);
+};
+#endif
@@ -0,0 +1,89 @@
+#include "profiler.h"
+#include "cpu.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+struct Routine
+{
+    uint16_t start;
+    uint16_t end;
+    uint64_t cycles;
+    uint32_t calls;
+};
+
+// a run of this many cold bytes ends a hot range that has no JSR target after it
+static const int ROUTINE_GAP = 16;
+
+Profiler::Profiler(int64_t period)
+{
+    this->period = period < 1 ? 1 : period;
+    countdown    = this->period;
+}
+void Profiler::clear()
+{
+    memset(hist, 0, sizeof(hist));
+    memset(calls, 0, sizeof(calls));
+    total     = 0;
+    countdown = period;
+}
+void Profiler::report(Cpu *cpu, FILE *out, size_t top, size_t listing)
+{
+    std::vector<Routine> routines;
+    uint64_t             sampled = 0;
+    int                  cold    = 0;
+    Routine              cur{0, 0, 0, 0};
+    bool                 open    = false;
+
+    for (size_t adr = 0; adr < 0x10000; adr++) {
+        bool entry = calls[adr] > 0;
+        bool hot   = hist[adr] > 0;
+
+        if (open && (entry || (!hot && ++cold > ROUTINE_GAP))) {
+            if (cur.cycles > 0)
+                routines.push_back(cur);
+            open = false;
+        }
+        if (!open && (entry || hot)) {
+            cur  = Routine{(uint16_t)adr, (uint16_t)adr, 0, calls[adr]};
+            open = true;
+            cold = 0;
+        }
+        if (hot) {
+            cur.end = adr;
+            cur.cycles += hist[adr];
+            sampled += hist[adr];
+            cold = 0;
+        }
+    }
+    if (open && cur.cycles > 0)
+        routines.push_back(cur);
+
+    std::sort(routines.begin(), routines.end(),
+              [](const Routine &l, const Routine &r) { return l.cycles > r.cycles; });
+
+    fprintf(out, "profile: %llu cycles, period %lld, %zu routines\n", (unsigned long long)total, (long long)period,
+            routines.size());
+    if (sampled == 0)
+        return;
+
+    fprintf(out, "\n rank      cycles       %%    calls  routine\n");
+    for (size_t i = 0; i < routines.size() && i < top; i++) {
+        auto &r = routines[i];
+        fprintf(out, "%5zu %11llu  %6.2f%% %8u  $%04X-$%04X\n", i + 1, (unsigned long long)r.cycles,
+                100.0 * r.cycles / sampled, r.calls, r.start, r.end);
+    }
+
+    char text[32];
+    for (size_t i = 0; i < routines.size() && i < listing; i++) {
+        auto &r = routines[i];
+        fprintf(out, "\n$%04X-$%04X  %.2f%%\n", r.start, r.end, 100.0 * r.cycles / sampled);
+        for (size_t adr = r.start; adr <= r.end; adr++) {
+            if (hist[adr] == 0)
+                continue;
+            cpu->disasm(adr, text, sizeof(text));
+            fprintf(out, "    %04zX  %-16s %11llu  %6.2f%%\n", adr, text, (unsigned long long)hist[adr],
+                    100.0 * hist[adr] / sampled);
+        }
+    }
+}
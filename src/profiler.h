@@ -0,0 +1,44 @@
+#ifndef _H_PROFILER
+#define _H_PROFILER
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+class Cpu;
+
+// Flat 64K histogram of cycles spent at each PC. With period 1 every
+// instruction is counted exactly, otherwise the PC is sampled once every
+// `period` cycles. The hook is only compiled into Cpu::run with CPU_PROFILER.
+class Profiler {
+  public:
+    uint64_t hist[0x10000]{};
+    uint32_t calls[0x10000]{};
+    uint64_t total  = 0;
+    int64_t  period = 1;
+
+  private:
+    int64_t countdown = 1;
+
+  public:
+    Profiler(int64_t period = 1);
+
+    inline void sample(uint16_t pc, uint8_t opcode, uint16_t target, int cycles)
+    {
+        if (opcode == 0x20)
+            calls[target]++;
+        total += cycles;
+        if (period == 1) {
+            hist[pc] += cycles;
+            return;
+        }
+        countdown -= cycles;
+        if (countdown <= 0) {
+            hist[pc] += period;
+            countdown += period;
+        }
+    }
+
+    void clear();
+    void report(Cpu *cpu, FILE *out, size_t top = 20, size_t listing = 8);
+};
+#endif
@@ -0,0 +1,47 @@
+#include "recomp.h"
+
+RecompRunner::RecompRunner()
+{
+}
+RecompRunner::~RecompRunner()
+{
+    delete[] table;
+}
+bool RecompRunner::attach(Cpu *cpu, const RecompModule *module)
+{
+    Mem *mem = cpu->mem;
+    if (mem->bios_rom == nullptr || mem->prg_rom == nullptr || mem->bios_rom->hash != module->bios_hash ||
+        mem->prg_rom->hash != module->prg_hash) {
+        printf("recomp: module was compiled for a different bios or program\n");
+        return false;
+    }
+    this->cpu      = cpu;
+    cpu->idle_skip = false;
+    if (table == nullptr)
+        table = new RecompFn[0x10000];
+    for (size_t i = 0; i < 0x10000; i++)
+        table[i] = nullptr;
+    for (size_t i = 0; i < module->count; i++)
+        table[module->entries[i].pc] = module->entries[i].fn;
+    return true;
+}
+void RecompRunner::run_frame()
+{
+    cpu->start_frame();
+    while (0 < cpu->frame_left) {
+        RecompFn fn = table[cpu->pc];
+        if (fn != nullptr && cpu->pending == 0 && !cpu->mem->banked && fn(cpu, cpu->pc)) {
+            native_calls++;
+            if (cpu->totalcycle >= cpu->events.next)
+                cpu->events.fire(cpu->totalcycle);
+            continue;
+        }
+        cpu->frame_left -= cpu->run(false);
+        interp_steps++;
+    }
+}
+void RecompRunner::step()
+{
+    run_frame();
+    cpu->draw_frame();
+}
@@ -0,0 +1,84 @@
+#ifndef _H_RECOMP
+#define _H_RECOMP
+#include "cpu.h"
+#include <cstddef>
+#include <cstdint>
+
+// Runtime side of tools/recomp. The tool turns the reachable code of a program
+// into C++ functions, one per straight-line region. A region function can be
+// entered at any of its instructions; it first checks that the region's bytes
+// in RAM still match what was compiled and returns false otherwise. It runs
+// until the frame budget in Cpu::frame_left is spent, a scheduled event is
+// due, control leaves the region, or a store hits the region, and leaves Cpu
+// exactly as the interpreter would have.
+typedef bool (*RecompFn)(Cpu *c, uint16_t pc);
+
+struct RecompEntry
+{
+    uint16_t pc;
+    RecompFn fn;
+};
+
+struct RecompModule
+{
+    uint64_t           bios_hash;
+    uint64_t           prg_hash;
+    const RecompEntry *entries;
+    size_t             count;
+};
+
+// Runs frames through the compiled module, falling back to Cpu::run for
+// addresses it does not cover, modified code, pending interrupts, the
+// instructions the compiler leaves to the interpreter and while any page is
+// banked to aux memory, as region code reads and checks main RAM.
+class RecompRunner {
+  public:
+    Cpu   *cpu          = nullptr;
+    size_t native_calls = 0;
+    size_t interp_steps = 0;
+
+  private:
+    RecompFn *table = nullptr;
+
+  public:
+    RecompRunner();
+    ~RecompRunner();
+
+    bool attach(Cpu *cpu, const RecompModule *module);
+    void run_frame();
+    void step();
+};
+
+static inline uint8_t recomp_read(Mem *m, uint16_t addr)
+{
+    return (addr & 0xf000) == 0xc000 ? m->get(addr) : m->ram[addr];
+}
+static inline void recomp_nz(Cpu *c, uint8_t v)
+{
+    c->zero     = v == 0;
+    c->negative = v > 0x7f;
+}
+static inline uint8_t recomp_p(Cpu *c)
+{
+    return (c->negative << 7) | (c->overflow << 6) | 0x20 | (c->decimal << 3) | (c->interrupt << 2) | (c->zero << 1) |
+           c->carry;
+}
+static inline void recomp_setp(Cpu *c, uint8_t p)
+{
+    c->negative  = p & 0x80;
+    c->overflow  = p & 0x40;
+    c->decimal   = p & 0x08;
+    c->interrupt = p & 0x04;
+    c->zero      = p & 0x02;
+    c->carry     = p & 0x01;
+}
+
+#define RECOMP_STEP(to, cyc)                                                                                           \
+    c->steps++;                                                                                                        \
+    c->cpuclock += (cyc);                                                                                              \
+    c->totalcycle += (cyc);                                                                                            \
+    if ((c->frame_left -= (cyc)) <= 0 || c->totalcycle >= c->events.next) {                                           \
+        c->pc = (to);                                                                                                  \
+        return true;                                                                                                   \
+    }
+#endif
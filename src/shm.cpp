@@ -0,0 +1,101 @@
+#include "shm.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+ShmExport::ShmExport(string name)
+{
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(ShmState)) != 0) {
+        printf("shm: cannot create %s\n", name.c_str());
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    void *p = mmap(nullptr, sizeof(ShmState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        printf("shm: cannot map %s\n", name.c_str());
+        shm_unlink(name.c_str());
+        return;
+    }
+    this->name = name;
+    state      = (ShmState *)p;
+    state->seq.store(1, std::memory_order_relaxed);
+    state->magic   = SHM_MAGIC;
+    state->version = SHM_VERSION;
+    state->size    = sizeof(ShmState);
+    state->frame   = 0;
+    state->seq.store(2, std::memory_order_release);
+}
+ShmExport::~ShmExport()
+{
+    if (state == nullptr)
+        return;
+    munmap(state, sizeof(ShmState));
+    shm_unlink(name.c_str());
+}
+bool ShmExport::ok()
+{
+    return state != nullptr;
+}
+void ShmExport::publish(Cpu *cpu)
+{
+    if (state == nullptr)
+        return;
+    uint64_t seq = state->seq.load(std::memory_order_relaxed);
+    state->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Mem *mem          = cpu->mem;
+    state->frame      = state->frame + 1;
+    state->totalcycle = cpu->totalcycle;
+    state->steps      = cpu->steps;
+    state->pc         = cpu->pc;
+    state->a          = cpu->a;
+    state->x          = cpu->x;
+    state->y          = cpu->y;
+    state->sp         = cpu->sp;
+    state->p          = (cpu->negative << 7) | (cpu->overflow << 6) | 0x20 | (cpu->decimal << 3) |
+               (cpu->interrupt << 2) | (cpu->zero << 1) | cpu->carry;
+    state->page_2   = mem->page_2;
+    state->switches = mem->switches;
+    memcpy(state->ram, mem->ram, sizeof(state->ram));
+    if (cpu->imgdata != nullptr) {
+        for (int y = 0; y < 192; y++) {
+            if (!cpu->drawn_rows[y])
+                continue;
+            cpu->drawn_rows[y] = 0;
+            memcpy(state->pixels + y * 1120, cpu->imgdata + y * 1120, 1120 * sizeof(uint32_t));
+        }
+    }
+    state->seq.store(seq + 2, std::memory_order_release);
+}
+const ShmState *ShmExport::attach(string name)
+{
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        printf("shm: cannot open %s\n", name.c_str());
+        return nullptr;
+    }
+    void *p = mmap(nullptr, sizeof(ShmState), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        printf("shm: cannot map %s\n", name.c_str());
+        return nullptr;
+    }
+    const ShmState *state = (const ShmState *)p;
+    if (state->magic != SHM_MAGIC || state->version != SHM_VERSION || state->size != sizeof(ShmState)) {
+        printf("shm: %s is not an emulator state segment\n", name.c_str());
+        munmap(p, sizeof(ShmState));
+        return nullptr;
+    }
+    return state;
+}
+void ShmExport::detach(const ShmState *state)
+{
+    if (state != nullptr)
+        munmap((void *)state, sizeof(ShmState));
+}
@@ -0,0 +1,78 @@
+#ifndef _H_SHM
+#define _H_SHM
+#include "cpu.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+#define SHM_MAGIC   0x32414853    // "SHA2"
+#define SHM_VERSION 1
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the sequence counter must be lock-free to be shared");
+
+// Machine state as published once per frame. `seq` is odd while the writer is
+// updating the rest; a reader that sees the same even value before and after
+// looking at the fields has seen one consistent frame.
+struct ShmState
+{
+    uint32_t              magic;
+    uint32_t              version;
+    uint64_t              size;
+    std::atomic<uint64_t> seq;
+
+    uint64_t frame;
+    uint64_t totalcycle;
+    uint64_t steps;
+    uint16_t pc;
+    uint8_t  a;
+    uint8_t  x;
+    uint8_t  y;
+    uint8_t  sp;
+    uint8_t  p;
+    uint8_t  page_2;
+    uint32_t switches;
+    uint32_t pad;
+
+    uint8_t  ram[0x10000];
+    uint32_t pixels[560 * 2 * 192];
+};
+
+// Publishes a Cpu into a POSIX shared-memory segment. publish() copies the
+// registers and RAM every frame but only the pixel rows draw_frame redrew,
+// so an unchanged screen costs nothing. Readers map the segment read-only
+// with attach() and read fields in place between read_begin() and
+// read_retry(), which never block the writer.
+class ShmExport {
+  public:
+    ShmState *state = nullptr;
+
+  private:
+    string name;
+
+  public:
+    ShmExport(string name);
+    ~ShmExport();
+
+    bool ok();
+    void publish(Cpu *cpu);
+
+    static const ShmState *attach(string name);
+    static void            detach(const ShmState *state);
+
+    static inline uint64_t read_begin(const ShmState *state)
+    {
+        uint64_t seq;
+        while ((seq = state->seq.load(std::memory_order_acquire)) & 1)
+            ;
+        return seq;
+    }
+    static inline bool read_retry(const ShmState *state, uint64_t seq)
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return state->seq.load(std::memory_order_relaxed) != seq;
+    }
+};
+#endif
@@ -0,0 +1,69 @@
+#include "slot.h"
+#include <cstdio>
+
+// Takes the first slot remove() freed, if any, before growing the table.
+int Scheduler::add(EventFn fn, void *ctx, MoveFn moved)
+{
+    size_t id = 0;
+    while (id < count && events[id].fn != nullptr)
+        id++;
+    if (id == MAX_EVENTS) {
+        printf("scheduler: more than %d events\n", MAX_EVENTS);
+        return -1;
+    }
+    events[id] = Event{SIZE_MAX, fn, ctx, moved};
+    if (id == count)
+        count++;
+    return id;
+}
+void Scheduler::remove(int id)
+{
+    events[id] = Event{SIZE_MAX, nullptr, nullptr, nullptr};
+    while (count > 0 && events[count - 1].fn == nullptr)
+        count--;
+    update();
+}
+void Scheduler::at(int id, size_t cycle)
+{
+    events[id].when = cycle;
+    if (cycle < next)
+        next = cycle;
+}
+void Scheduler::cancel(int id)
+{
+    events[id].when = SIZE_MAX;
+    update();
+}
+void Scheduler::fire(size_t now)
+{
+    while (next <= now) {
+        for (size_t i = 0; i < count; i++) {
+            size_t when = events[i].when;
+            if (when <= now) {
+                events[i].when = SIZE_MAX;
+                events[i].fn(events[i].ctx, when);
+            }
+        }
+        update();
+    }
+}
+// Overdue events stay due at the new cycle.
+void Scheduler::rebase(size_t from, size_t to)
+{
+    for (size_t i = 0; i < count; i++) {
+        size_t when = events[i].when;
+        if (when != SIZE_MAX)
+            events[i].when = when > from ? when - from + to : to;
+        if (events[i].moved != nullptr)
+            events[i].moved(events[i].ctx, from, to);
+    }
+    update();
+}
+void Scheduler::update()
+{
+    next = SIZE_MAX;
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].when < next)
+            next = events[i].when;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef _H_SLOT
+#define _H_SLOT
+#include <cstddef>
+#include <cstdint>
+
+#define MAX_EVENTS 16
+
+typedef uint8_t (*IoRead)(void *ctx, uint16_t addr);
+typedef void (*IoWrite)(void *ctx, uint16_t addr, uint8_t data);
+typedef void (*EventFn)(void *ctx, size_t cycle);
+typedef void (*MoveFn)(void *ctx, size_t from, size_t to);
+
+// One address range of a device. A null read leaves the range to RAM/ROM,
+// a null write ignores stores (they still land in RAM as before).
+struct IoHandler
+{
+    IoRead  read;
+    IoWrite write;
+    void   *ctx;
+};
+
+// What a peripheral card decodes in its slot n (1-7): the 16 soft switches at
+// $C0n0+$80, the $Cn00 page and the shared $C800-$CFFE expansion ROM, which
+// belongs to the slot whose $Cn00 page was touched last until $CFFF is read.
+struct Card
+{
+    IoHandler io;
+    IoHandler rom;
+    IoHandler c8;
+};
+
+// Cycle-scheduled callbacks for devices, so nothing has to be polled per
+// instruction. A device reserves an event once with add(), arms it with at()
+// and gives it back with remove() when it goes away; Cpu compares totalcycle
+// with `next` after every instruction and calls fire(), which runs each due
+// callback once with the cycle it was due. When the cycle counter jumps
+// (Cpu::reset, Snapshot::restore) rebase() keeps armed events the same
+// distance ahead and calls the moved callbacks, so devices can shift the
+// cycles they keep themselves.
+class Scheduler {
+  public:
+    size_t next = SIZE_MAX;
+
+  private:
+    struct Event
+    {
+        size_t  when;
+        EventFn fn;
+        void   *ctx;
+        MoveFn  moved;
+    };
+    Event  events[MAX_EVENTS]{};
+    size_t count = 0;
+
+  public:
+    int  add(EventFn fn, void *ctx, MoveFn moved = nullptr);
+    void remove(int id);
+    void at(int id, size_t cycle);
+    void cancel(int id);
+    void fire(size_t now);
+    void rebase(size_t from, size_t to);
+
+  private:
+    void update();
+};
+#endif
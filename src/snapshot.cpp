@@ -0,0 +1,149 @@
+#include "snapshot.h"
+#include "cpu.h"
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static std::mutex                                    mapped_lock;
+static std::unordered_map<uint64_t, const Snapshot *> mapped;
+
+Snapshot *Snapshot::take(Cpu *cpu)
+{
+    size_t    len  = cpu->mem->has_aux() ? 0xc000 : 0;
+    Snapshot *snap = new (::operator new(sizeof(Snapshot) + len)) Snapshot();
+    snap->aux_len  = len;
+    snap->save(cpu);
+    return snap;
+}
+void Snapshot::save(Cpu *cpu)
+{
+    a          = cpu->a;
+    x          = cpu->x;
+    y          = cpu->y;
+    sp         = cpu->sp;
+    pc         = cpu->pc;
+    p          = (cpu->negative << 7) | (cpu->overflow << 6) | (cpu->decimal << 3) | (cpu->interrupt << 2) |
+                 (cpu->zero << 1) | cpu->carry;
+    key        = cpu->mem->key;
+    page_2     = cpu->mem->page_2;
+    switches   = cpu->mem->switches;
+    irq_lines  = cpu->irq_lines;
+    nmi_lines  = cpu->nmi_lines;
+    pending    = cpu->pending;
+    cpuclock   = cpu->cpuclock;
+    steps      = cpu->steps;
+    totalcycle = cpu->totalcycle;
+    writes     = cpu->mem->writes;
+    io_reads   = cpu->mem->io_reads;
+    memcpy(ram, cpu->mem->ram, sizeof(ram));
+    memcpy((uint8_t *)(this + 1), cpu->mem->aux, aux_len);
+}
+void Snapshot::restore(Cpu *cpu) const
+{
+    cpu->a          = a;
+    cpu->x          = x;
+    cpu->y          = y;
+    cpu->sp         = sp;
+    cpu->pc         = pc;
+    cpu->negative   = (p >> 7) & 1;
+    cpu->overflow   = (p >> 6) & 1;
+    cpu->decimal    = (p >> 3) & 1;
+    cpu->interrupt  = (p >> 2) & 1;
+    cpu->zero       = (p >> 1) & 1;
+    cpu->carry      = p & 1;
+    cpu->irq_lines  = irq_lines;
+    cpu->nmi_lines  = nmi_lines;
+    cpu->pending    = pending;
+    cpu->cpuclock   = cpuclock;
+    cpu->steps      = steps;
+    cpu->events.rebase(cpu->totalcycle, totalcycle);
+    cpu->totalcycle = totalcycle;
+    cpu->frame_left = 0;
+
+    Mem *mem      = cpu->mem;
+    mem->key      = key;
+    mem->page_2   = page_2;
+    mem->switches = switches;
+    mem->writes   = writes;
+    mem->io_reads = io_reads;
+    memcpy(mem->ram, ram, sizeof(ram));
+    mem->set_aux(aux_len > 0 ? aux() : nullptr);
+    mem->rehash();
+    mem->update_banks();
+    memset(mem->dirty_scanlines, 1, sizeof(mem->dirty_scanlines));
+    memset(mem->dirty_text, 1, sizeof(mem->dirty_text));
+    mem->video_writes++;
+}
+uint64_t SnapshotCache::key(uint64_t bios_hash, uint64_t prg_hash, size_t frames, const string &script)
+{
+    uint64_t parts[5] = {bios_hash, prg_hash, frames, SNAPSHOT_VERSION, sizeof(Snapshot)};
+    uint64_t h        = Loader::hash((const uint8_t *)parts, sizeof(parts));
+    return Loader::hash((const uint8_t *)script.data(), script.size(), h);
+}
+string SnapshotCache::path(const string &dir, uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.snap", (unsigned long long)key);
+    return dir + "/" + name;
+}
+const Snapshot *SnapshotCache::open(const string &path, uint64_t key)
+{
+    std::lock_guard<std::mutex> lk(mapped_lock);
+    auto                        it = mapped.find(key);
+    if (it != mapped.end())
+        return it->second;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    size_t      size = sizeof(SnapshotHeader) + sizeof(Snapshot);
+    if (fstat(fd, &st) != 0 || ((size_t)st.st_size != size && (size_t)st.st_size != size + 0xc000)) {
+        printf("snapshot: %s has the wrong size, ignoring it\n", path.c_str());
+        close(fd);
+        return nullptr;
+    }
+    size = st.st_size;
+    void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        printf("snapshot: cannot map %s\n", path.c_str());
+        return nullptr;
+    }
+
+    auto *hdr = (const SnapshotHeader *)map;
+    auto *snap = (const Snapshot *)(hdr + 1);
+    if (hdr->magic != SNAPSHOT_MAGIC || hdr->version != SNAPSHOT_VERSION || hdr->size != size - sizeof(*hdr) ||
+        hdr->key != key || snap->size() != hdr->size) {
+        printf("snapshot: %s does not match, ignoring it\n", path.c_str());
+        munmap(map, size);
+        return nullptr;
+    }
+    mapped[key] = snap;
+    return snap;
+}
+bool SnapshotCache::save(const string &path, uint64_t key, const Snapshot &snap)
+{
+    string tmp = path + ".tmp" + std::to_string(getpid());
+    FILE  *f   = fopen(tmp.c_str(), "wb");
+    if (f == nullptr) {
+        printf("snapshot: cannot write %s\n", tmp.c_str());
+        return false;
+    }
+    SnapshotHeader hdr{SNAPSHOT_MAGIC, SNAPSHOT_VERSION, snap.size(), key, 0};
+    bool           ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 && fwrite(&snap, snap.size(), 1, f) == 1;
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        printf("snapshot: cannot write %s\n", path.c_str());
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef _H_SNAPSHOT
+#define _H_SNAPSHOT
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+#define SNAPSHOT_MAGIC   0x50414e53    // "SNAP"
+#define SNAPSHOT_VERSION 3
+
+class Cpu;
+
+// Machine state at a frame boundary: registers, interrupt lines, counters and
+// the whole 64K address space, followed by aux_len bytes of aux memory if the
+// machine has any. Plain data, allocated at its full size() by take() and
+// written or mapped as is; restoring one puts a Cpu back exactly where take()
+// found it.
+struct Snapshot
+{
+    uint8_t  a;
+    uint8_t  x;
+    uint8_t  y;
+    uint8_t  sp;
+    uint16_t pc;
+    uint8_t  p;
+    uint8_t  key;
+    int32_t  page_2;
+    uint32_t switches;
+    uint32_t irq_lines;
+    uint32_t nmi_lines;
+    uint32_t pending;
+    uint64_t cpuclock;
+    uint64_t steps;
+    uint64_t totalcycle;
+    uint64_t writes;
+    uint64_t io_reads;
+    uint64_t aux_len;    // 0, or 0xc000 when aux memory follows
+    uint8_t  ram[0x10000];
+
+    static Snapshot *take(Cpu *cpu);
+    void             restore(Cpu *cpu) const;
+
+    inline size_t size() const
+    {
+        return sizeof(Snapshot) + aux_len;
+    }
+    inline const uint8_t *aux() const
+    {
+        return (const uint8_t *)(this + 1);
+    }
+    static void operator delete(void *p)
+    {
+        ::operator delete(p);
+    }
+
+  private:
+    void save(Cpu *cpu);
+};
+
+struct SnapshotHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+    uint64_t key;
+    uint64_t reserved;
+};
+
+// Post-boot snapshots on disk, one file per key. Files are written to a
+// temporary name and renamed so concurrent jobs never see a partial one, and
+// are memory-mapped read-only when opened; mappings stay cached for the life
+// of the process.
+class SnapshotCache {
+  public:
+    static uint64_t        key(uint64_t bios_hash, uint64_t prg_hash, size_t frames, const string &script);
+    static string          path(const string &dir, uint64_t key);
+    static const Snapshot *open(const string &path, uint64_t key);
+    static bool            save(const string &path, uint64_t key, const Snapshot &snap);
+};
+#endif
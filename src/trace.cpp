@@ -0,0 +1,125 @@
+#include "trace.h"
+
+static size_t ring_size(size_t records)
+{
+    size_t n = Tracer::CHUNK;
+    while (n < records) {
+        n <<= 1;
+    }
+    return n;
+}
+Tracer::Tracer(size_t records)
+{
+    size_t n = ring_size(records);
+    ring     = new TraceRecord[n]{};
+    mask     = n - 1;
+}
+Tracer::Tracer(string path, size_t records)
+{
+    size_t n = ring_size(records < 4 * CHUNK ? 4 * CHUNK : records);
+    ring     = new TraceRecord[n]{};
+    mask     = n - 1;
+    chunks   = n / CHUNK;
+
+    out = fopen(path.c_str(), "wb");
+    if (out == nullptr || !write_header(out)) {
+        printf("trace: cannot write %s\n", path.c_str());
+        if (out != nullptr)
+            fclose(out);
+        out = nullptr;
+        return;
+    }
+    streaming = true;
+    writer    = std::thread(&Tracer::writer_loop, this);
+}
+Tracer::~Tracer()
+{
+    close();
+    delete[] ring;
+}
+void Tracer::chunk_full()
+{
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        filled.store(head, std::memory_order_release);
+    }
+    ready.notify_one();
+
+    if (written.load(std::memory_order_acquire) + chunks * CHUNK < head + CHUNK) {
+        std::unique_lock<std::mutex> lk(lock);
+        drained.wait(lk, [this] { return written.load() + chunks * CHUNK >= head + CHUNK; });
+    }
+}
+void Tracer::writer_loop()
+{
+    for (;;) {
+        size_t done = written.load();
+        {
+            std::unique_lock<std::mutex> lk(lock);
+            ready.wait(lk, [this, done] { return filled.load() > done || stopping.load(); });
+        }
+        size_t end = filled.load(std::memory_order_acquire);
+        if (end == done)
+            return;
+
+        for (size_t pos = done; pos < end; pos += CHUNK) {
+            fwrite(&ring[pos & mask], sizeof(TraceRecord), CHUNK, out);
+            written.store(pos + CHUNK, std::memory_order_release);
+            std::lock_guard<std::mutex> lk(lock);
+            drained.notify_one();
+        }
+    }
+}
+void Tracer::close()
+{
+    if (!streaming)
+        return;
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        stopping = true;
+    }
+    ready.notify_one();
+    writer.join();
+
+    for (size_t pos = written.load(); pos < head; pos++) {
+        fwrite(&ring[pos & mask], sizeof(TraceRecord), 1, out);
+    }
+    written = head;
+    fclose(out);
+    out       = nullptr;
+    streaming = false;
+}
+size_t Tracer::size()
+{
+    if (chunks > 0)
+        return head;
+    return head < mask + 1 ? head : mask + 1;
+}
+bool Tracer::save(string path)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    if (f == nullptr || !write_header(f)) {
+        printf("trace: cannot write %s\n", path.c_str());
+        if (f != nullptr)
+            fclose(f);
+        return false;
+    }
+    size_t count = head < mask + 1 ? head : mask + 1;
+    for (size_t pos = head - count; pos < head; pos++) {
+        fwrite(&ring[pos & mask], sizeof(TraceRecord), 1, f);
+    }
+    fclose(f);
+    return true;
+}
+bool Tracer::write_header(FILE *f)
+{
+    TraceHeader hdr{TRACE_MAGIC, TRACE_VERSION, sizeof(TraceRecord), 0};
+    return fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+}
+bool Tracer::read_header(FILE *f)
+{
+    TraceHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1)
+        return false;
+    return hdr.magic == TRACE_MAGIC && hdr.version == TRACE_VERSION && hdr.record_size == sizeof(TraceRecord);
+}
@@ -0,0 +1,102 @@
+#ifndef _H_TRACE
+#define _H_TRACE
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+#define TRACE_MAGIC   0x35364354    // "TC65"
+#define TRACE_VERSION 1
+
+// One executed instruction, captured before it runs. `cycle` holds the low
+// 32 bits of Cpu::totalcycle; readers extend it when it wraps.
+struct TraceRecord
+{
+    uint32_t cycle;
+    uint16_t pc;
+    uint8_t  opcode;
+    uint8_t  op1;
+    uint8_t  op2;
+    uint8_t  a;
+    uint8_t  x;
+    uint8_t  y;
+    uint8_t  p;
+    uint8_t  sp;
+    uint8_t  pad[2];
+};
+static_assert(sizeof(TraceRecord) == 16, "trace records are 16 bytes");
+
+struct TraceHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+};
+
+// Records go into a power-of-two ring split into chunks. In ring mode the
+// oldest records are overwritten and save() writes what is left; in stream
+// mode every filled chunk is handed to a writer thread that appends it to
+// the file, and record() only blocks if the writer falls a whole ring behind.
+class Tracer {
+  public:
+    static const size_t CHUNK = 1 << 14;
+
+    TraceRecord *ring = nullptr;
+    size_t       mask = 0;
+    size_t       head = 0;
+
+  private:
+    bool   streaming = false;
+    FILE  *out       = nullptr;
+    size_t chunks    = 0;
+
+    std::atomic<size_t>     filled{0};
+    std::atomic<size_t>     written{0};
+    std::atomic<bool>       stopping{false};
+    std::mutex              lock;
+    std::condition_variable ready;
+    std::condition_variable drained;
+    std::thread             writer;
+
+  public:
+    Tracer(size_t records);
+    Tracer(string path, size_t records = 1 << 20);
+    ~Tracer();
+
+    inline void record(uint32_t cycle, uint16_t pc, uint8_t opcode, uint8_t op1, uint8_t op2, uint8_t a, uint8_t x,
+                       uint8_t y, uint8_t p, uint8_t sp)
+    {
+        TraceRecord &r = ring[head & mask];
+        r.cycle        = cycle;
+        r.pc           = pc;
+        r.opcode       = opcode;
+        r.op1          = op1;
+        r.op2          = op2;
+        r.a            = a;
+        r.x            = x;
+        r.y            = y;
+        r.p            = p;
+        r.sp           = sp;
+        if ((++head & (CHUNK - 1)) == 0 && streaming)
+            chunk_full();
+    }
+
+    bool   save(string path);
+    size_t size();
+    void   close();
+
+    static bool write_header(FILE *f);
+    static bool read_header(FILE *f);
+
+  private:
+    void chunk_full();
+    void writer_loop();
+};
+#endif
@@ -0,0 +1,1495 @@
+#include "capture.h"
+#include "cpu.h"
+#include "debugger.h"
+#include "fuzz.h"
+#include "lanes.h"
+#include "metrics.h"
+#include "mockingboard.h"
+#include "perfcount.h"
+#include "shm.h"
+#include "snapshot.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+// 6502 conformance runner used by ctest.
+//
+//   conformance cycles
+//       runs every documented opcode and compares the cycles Cpu::run reports
+//       with the NMOS reference table, including page-cross and branch penalties
+//   conformance decimal
+//       checks decimal mode ADC/SBC against known NMOS results, including the
+//       N/V/Z quirks of ADC
+//   conformance interrupts
+//       checks IRQ masking by the I flag, the pushed frame and NMI edge triggering
+//   conformance cmos
+//       checks the 65C02 additions, its decimal flags and the fixed JMP (abs)
+//       against the NMOS decode of the same bytes
+//   conformance slots
+//       checks card I/O, slot ROM and $C800 dispatch and that scheduled
+//       events fire on time, also across idle-skipped loops
+//   conformance debug
+//       checks breakpoints, watchpoints, step over and run to cycle
+//   conformance video
+//       checks aux memory banking through RAMRD/RAMWRT and 80STORE, the
+//       switch status bits, and double hi-res, 80-column and lo-res output
+//   conformance beam
+//       checks the floating bus against the video scanner address in and out
+//       of blanking, the vertical blank status and a mid-frame page flip
+//   conformance capture
+//       records a scripted sequence of screens as Y4M and as a delta file and
+//       checks that the delta file converts back to the same Y4M
+//   conformance shm
+//       publishes two frames to a shared-memory segment and reads them back
+//       through a second, read-only mapping
+//   conformance metrics
+//       checks the histogram bucket bounds and quantiles, merging of shards
+//       recorded on two threads, and the Prometheus and JSON dumps
+//   conformance perf
+//       runs frames between perf counter start and stop and checks that every
+//       counter the host grants counts, and that the rest report unavailable
+//   conformance heatmap
+//       runs a few instructions, one rewriting code that already ran, and
+//       checks the read, write and fetch counts, the self-modified byte,
+//       saturation and the report and PPM output; skipped unless built with
+//       MEM_HEATMAP
+//   conformance mockingboard
+//       checks the 6522 timers in one-shot and free-running mode through the
+//       scheduler and IRQ handler, PSG register access through port B, the
+//       rendered square wave and the WAV header
+//   conformance fuzz
+//       runs inputs for a small key-driven program that jams, recurses without
+//       end or jumps into the soft switches depending on the key, and checks
+//       that the fuzzer finds each crash and reproduces it from its file
+//   conformance run <bin> <load> <start> [<success-pc>|any] [<error-addr>]
+//       loads a raw test image (Klaus Dormann's 6502_functional_test.bin,
+//       6502_decimal_test.bin, ...) and runs it until it traps in a jump or
+//       branch to itself. The test passes if the trap is at success-pc and
+//       the byte at error-addr is zero.
+//
+// Exits 0 on success, 1 on divergence (after a state dump) and 77 when a test
+// image or build option is missing so ctest reports it as skipped.
+
+#define EXIT_SKIP 77
+
+static const int ref_cycles[256] = {
+    7, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6,    // 00
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,    // 10
+    6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6,    // 20
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,    // 30
+    6, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6,    // 40
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,    // 50
+    6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6,    // 60
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,    // 70
+    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,    // 80
+    2, 6, 2, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5,    // 90
+    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,    // a0
+    2, 5, 2, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4,    // b0
+    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,    // c0
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,    // d0
+    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,    // e0
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,    // f0
+};
+
+// opcodes that take one extra cycle when the indexed address crosses a page
+static const uint8_t ref_page_penalty[] = {
+    0x11, 0x19, 0x1d, 0x31, 0x39, 0x3d, 0x51, 0x59, 0x5d, 0x71, 0x79, 0x7d, 0xb1, 0xb3, 0xb9, 0xbc, 0xbd,
+    0xbe, 0xbf, 0xd1, 0xd9, 0xdd, 0xf1, 0xf9, 0xfd, 0x1c, 0x3c, 0x5c, 0x7c, 0xdc, 0xfc,
+};
+
+static const uint8_t documented[] = {
+    0x00, 0x01, 0x05, 0x06, 0x08, 0x09, 0x0a, 0x0d, 0x0e, 0x10, 0x11, 0x15, 0x16, 0x18, 0x19, 0x1d, 0x1e, 0x20, 0x21,
+    0x24, 0x25, 0x26, 0x28, 0x29, 0x2a, 0x2c, 0x2d, 0x2e, 0x30, 0x31, 0x35, 0x36, 0x38, 0x39, 0x3d, 0x3e, 0x40, 0x41,
+    0x45, 0x46, 0x48, 0x49, 0x4a, 0x4c, 0x4d, 0x4e, 0x50, 0x51, 0x55, 0x56, 0x58, 0x59, 0x5d, 0x5e, 0x60, 0x61, 0x65,
+    0x66, 0x68, 0x69, 0x6a, 0x6c, 0x6d, 0x6e, 0x70, 0x71, 0x75, 0x76, 0x78, 0x79, 0x7d, 0x7e, 0x81, 0x84, 0x85, 0x86,
+    0x88, 0x8a, 0x8c, 0x8d, 0x8e, 0x90, 0x91, 0x94, 0x95, 0x96, 0x98, 0x99, 0x9a, 0x9d, 0xa0, 0xa1, 0xa2, 0xa4, 0xa5,
+    0xa6, 0xa8, 0xa9, 0xaa, 0xac, 0xad, 0xae, 0xb0, 0xb1, 0xb4, 0xb5, 0xb6, 0xb8, 0xb9, 0xba, 0xbc, 0xbd, 0xbe, 0xc0,
+    0xc1, 0xc4, 0xc5, 0xc6, 0xc8, 0xc9, 0xca, 0xcc, 0xcd, 0xce, 0xd0, 0xd1, 0xd5, 0xd6, 0xd8, 0xd9, 0xdd, 0xde, 0xe0,
+    0xe1, 0xe4, 0xe5, 0xe6, 0xe8, 0xe9, 0xea, 0xec, 0xed, 0xee, 0xf0, 0xf1, 0xf5, 0xf6, 0xf8, 0xf9, 0xfd, 0xfe,
+};
+
+static bool has_page_penalty(uint8_t op)
+{
+    for (auto p : ref_page_penalty) {
+        if (p == op)
+            return true;
+    }
+    return false;
+}
+static bool is_branch(uint8_t op)
+{
+    return (op & 0x1f) == 0x10;
+}
+static void set_branch_flag(Cpu *cpu, uint8_t op, bool taken)
+{
+    bool value = ((op >> 5) & 1) == (taken ? 1 : 0);
+    switch (op >> 6) {
+        case 0:
+            cpu->negative = value;
+            break;
+        case 1:
+            cpu->overflow = value;
+            break;
+        case 2:
+            cpu->carry = value;
+            break;
+        case 3:
+            cpu->zero = value;
+            break;
+    }
+}
+static void dump_state(Cpu *cpu, uint16_t pc)
+{
+    char text[32];
+    printf("\n----------- state -----------\n");
+    printf("pc         : %04X\n", pc);
+    printf("regs       : A:%02X X:%02X Y:%02X SP:%02X\n", cpu->a, cpu->x, cpu->y, cpu->sp);
+    printf("flags      : N:%d V:%d D:%d I:%d Z:%d C:%d\n", cpu->negative, cpu->overflow, cpu->decimal,
+           cpu->interrupt, cpu->zero, cpu->carry);
+    printf("steps      : %zu\n", cpu->steps);
+    printf("totalcycle : %zu\n", cpu->totalcycle);
+
+    uint16_t adr = pc;
+    for (int i = 0; i < 8; i++) {
+        int len = cpu->disasm(adr, text, sizeof(text));
+        printf("  %s %04X  %s\n", adr == pc ? ">" : " ", adr, text);
+        adr += len;
+    }
+    printf("zero page  :");
+    for (int i = 0; i < 0x40; i++) {
+        printf("%s%02X", (i & 15) == 0 ? "\n  " : " ", cpu->mem->ram[i]);
+    }
+    printf("\nstack      :");
+    for (int i = cpu->sp + 1; i < 0x100 && i < cpu->sp + 17; i++) {
+        printf(" %02X", cpu->mem->ram[0x100 + i]);
+    }
+    printf("\n");
+}
+
+// Runs one instruction at `at` and returns the cycles Cpu::run reported.
+// Operands point at $20xx so that with X/Y = 1, `cross` moves the
+// effective address from $20FF to $2100.
+static int time_instruction(Cpu *cpu, uint8_t op, uint16_t at, bool cross, int branch)
+{
+    cpu->reset();
+    cpu->sp = 0xfd;
+    cpu->x  = 1;
+    cpu->y  = 1;
+
+    uint8_t *ram = cpu->mem->ram;
+    uint8_t  lo  = cross ? 0xff : 0x10;
+    ram[at]      = op;
+    ram[at + 1]  = lo;
+    ram[at + 2]  = 0x20;
+    ram[lo]      = 0x10;
+    ram[0x00]    = 0xff;
+    ram[0x01]    = 0x20;
+    ram[0x11]    = 0x20;
+    ram[0xfe]    = 0x00;
+    ram[0xff]    = 0x20;
+
+    if (is_branch(op)) {
+        set_branch_flag(cpu, op, branch != 0);
+        ram[at + 1] = branch == 2 ? 0x7f : 0x02;
+    }
+    if ((op & 0x1f) == 0x11) {
+        ram[at + 1] = cross ? 0x00 : 0x10;
+    }
+    cpu->pc = at;
+    return cpu->run(false);
+}
+static int test_cycles()
+{
+    Cpu *cpu    = new Cpu();
+    int  failed = 0;
+    cpu->init();
+
+    for (auto op : documented) {
+        struct Case
+        {
+            const char *name;
+            bool        cross;
+            int         branch;
+            uint16_t    at;
+            int         expect;
+        };
+        Case cases[3];
+        int  ncases = 0;
+
+        if (is_branch(op)) {
+            cases[ncases++] = Case{"not taken", false, 0, 0x0300, ref_cycles[op]};
+            cases[ncases++] = Case{"taken", false, 1, 0x0300, ref_cycles[op] + 1};
+            cases[ncases++] = Case{"taken, page cross", false, 2, 0x0390, ref_cycles[op] + 2};
+        } else {
+            cases[ncases++] = Case{"", false, 0, 0x0300, ref_cycles[op]};
+            if (has_page_penalty(op))
+                cases[ncases++] = Case{"page cross", true, 0, 0x0300, ref_cycles[op] + 1};
+        }
+
+        for (int i = 0; i < ncases; i++) {
+            auto &c      = cases[i];
+            int   actual = time_instruction(cpu, op, c.at, c.cross, c.branch);
+            if (actual != c.expect) {
+                char text[32];
+                uint8_t code[3] = {op, cpu->mem->ram[c.at + 1], cpu->mem->ram[c.at + 2]};
+                cpu->disasm(c.at, code, text, sizeof(text));
+                printf("cycles: %02X %-16s %-18s expected %d, got %d\n", op, text, c.name, c.expect, actual);
+                failed++;
+            }
+        }
+    }
+    if (failed > 0) {
+        printf("cycles: %d mismatches\n", failed);
+    } else {
+        printf("cycles: %zu opcodes match the reference table\n", sizeof(documented));
+    }
+    delete cpu;
+    return failed > 0 ? 1 : 0;
+}
+struct DecimalCase
+{
+    uint8_t op;
+    uint8_t a;
+    uint8_t value;
+    bool    carry;
+    uint8_t result;
+    bool    carry_out;
+    int     nvz;    // expected N, V, Z as 0bNVZ, -1 to skip
+};
+
+static const DecimalCase decimal_cases[] = {
+    {0x69, 0x12, 0x34, false, 0x46, false, -1}, {0x69, 0x15, 0x26, false, 0x41, false, -1},
+    {0x69, 0x58, 0x46, true, 0x05, true, -1},   {0x69, 0x81, 0x92, false, 0x73, true, -1},
+    {0x69, 0x99, 0x01, false, 0x00, true, 0b100}, {0x69, 0x79, 0x00, true, 0x80, false, 0b110},
+    {0xe9, 0x46, 0x12, true, 0x34, true, -1},   {0xe9, 0x40, 0x13, true, 0x27, true, -1},
+    {0xe9, 0x32, 0x02, false, 0x29, true, -1},  {0xe9, 0x12, 0x21, true, 0x91, false, 0b100},
+    {0xe9, 0x21, 0x34, true, 0x87, false, -1},
+};
+
+static int test_decimal()
+{
+    Cpu *cpu    = new Cpu();
+    int  failed = 0;
+    cpu->init();
+
+    for (auto &c : decimal_cases) {
+        cpu->mem->ram[0x300] = c.op;
+        cpu->mem->ram[0x301] = c.value;
+        cpu->pc              = 0x300;
+        cpu->a               = c.a;
+        cpu->carry           = c.carry;
+        cpu->decimal         = true;
+        cpu->run(false);
+
+        int nvz = (cpu->negative << 2) | (cpu->overflow << 1) | cpu->zero;
+        if (cpu->a != c.result || cpu->carry != c.carry_out || (c.nvz >= 0 && nvz != c.nvz)) {
+            printf("decimal: %s %02X,%02X C=%d: expected %02X C=%d, got %02X C=%d N=%d V=%d Z=%d\n",
+                   c.op == 0x69 ? "ADC" : "SBC", c.a, c.value, c.carry, c.result, c.carry_out, cpu->a, cpu->carry,
+                   cpu->negative, cpu->overflow, cpu->zero);
+            failed++;
+        }
+    }
+    if (failed == 0)
+        printf("decimal: %zu cases passed\n", sizeof(decimal_cases) / sizeof(decimal_cases[0]));
+    delete cpu;
+    return failed > 0 ? 1 : 0;
+}
+#define EXPECT(cond)                                                                                                   \
+    if (!(cond)) {                                                                                                     \
+        printf("%s: line %d: %s\n", __func__, __LINE__, #cond);                                                       \
+        dump_state(cpu, cpu->pc);                                                                                      \
+        delete cpu;                                                                                                    \
+        return 1;                                                                                                      \
+    }
+
+static int test_interrupts()
+{
+    Cpu *cpu = new Cpu();
+    cpu->init();
+    uint8_t *ram = cpu->mem->ram;
+    for (int i = 0; i < 0x10000; i++) {
+        ram[i] = 0xea;
+    }
+    ram[0xfffa] = 0x00;
+    ram[0xfffb] = 0x50;
+    ram[0xfffe] = 0x00;
+    ram[0xffff] = 0x40;
+    cpu->pc     = 0x0300;
+    cpu->sp     = 0xff;
+
+    cpu->interrupt = true;
+    cpu->assert_irq(0x10);
+    cpu->run(false);
+    EXPECT(cpu->pc == 0x0301);
+
+    cpu->interrupt = false;
+    int cycles     = cpu->run(false);
+    EXPECT(cpu->pc == 0x4001);
+    EXPECT(cycles == 7 + 2);
+    EXPECT(cpu->sp == 0xfc);
+    EXPECT(ram[0x1ff] == 0x03 && ram[0x1fe] == 0x01);
+    EXPECT((ram[0x1fd] & 0x30) == 0x20);
+    EXPECT(cpu->interrupt);
+
+    cpu->release_irq(0x10);
+    EXPECT(cpu->pending == 0);
+
+    cpu->assert_nmi(0x20);
+    cpu->run(false);
+    EXPECT(cpu->pc == 0x5001);
+    cpu->assert_nmi(0x40);
+    cpu->run(false);
+    EXPECT(cpu->pc == 0x5002);
+    cpu->release_nmi(0x20);
+    cpu->release_nmi(0x40);
+    cpu->assert_nmi(0x20);
+    cpu->run(false);
+    EXPECT(cpu->pc == 0x5001);
+    EXPECT(cpu->sp == 0xf6);
+
+    printf("interrupts: passed\n");
+    delete cpu;
+    return 0;
+}
+// Runs `bytes` at $0300 and returns the cycles of its first instruction.
+static int run_at(Cpu *cpu, std::initializer_list<uint8_t> bytes)
+{
+    uint16_t at = 0x300;
+    for (auto b : bytes)
+        cpu->mem->ram[at++] = b;
+    cpu->pc = 0x300;
+    return cpu->run(false);
+}
+static int test_cmos()
+{
+    Cpu *cpu = new Cpu();
+    cpu->init();
+    uint8_t *ram = cpu->mem->ram;
+
+    EXPECT(run_at(cpu, {0x80, 0x10}) == 2 && cpu->pc == 0x302);
+    cpu->variant = CPU_CMOS;
+    EXPECT(run_at(cpu, {0x80, 0x10}) == 3 && cpu->pc == 0x312);
+
+    cpu->x = 0x42;
+    run_at(cpu, {0xda});
+    run_at(cpu, {0x7a});
+    EXPECT(cpu->y == 0x42 && cpu->sp == 0xff && !cpu->zero);
+
+    ram[0x2000] = 0x55;
+    EXPECT(run_at(cpu, {0x9c, 0x00, 0x20}) == 4 && ram[0x2000] == 0);
+
+    cpu->a    = 0x0f;
+    ram[0x10] = 0xf0;
+    EXPECT(run_at(cpu, {0x04, 0x10}) == 5 && ram[0x10] == 0xff && cpu->zero);
+    run_at(cpu, {0x14, 0x10});
+    EXPECT(ram[0x10] == 0xf0 && !cpu->zero);
+
+    ram[0x20]   = 0x34;
+    ram[0x21]   = 0x12;
+    ram[0x1234] = 0x80;
+    EXPECT(run_at(cpu, {0xb2, 0x20}) == 5 && cpu->a == 0x80 && cpu->negative);
+
+    run_at(cpu, {0x89, 0x00});
+    EXPECT(cpu->zero && cpu->negative);
+    run_at(cpu, {0x1a});
+    EXPECT(cpu->a == 0x81);
+
+    ram[0x12ff] = 0x00;
+    ram[0x1300] = 0x40;
+    ram[0x1200] = 0x50;
+    EXPECT(run_at(cpu, {0x6c, 0xff, 0x12}) == 6 && cpu->pc == 0x4000);
+
+    cpu->x      = 2;
+    ram[0x1236] = 0x78;
+    ram[0x1237] = 0x56;
+    run_at(cpu, {0x7c, 0x34, 0x12});
+    EXPECT(cpu->pc == 0x5678);
+
+    cpu->a       = 0x99;
+    cpu->carry   = false;
+    cpu->decimal = true;
+    EXPECT(run_at(cpu, {0x69, 0x01}) == 3 && cpu->a == 0x00 && cpu->carry && cpu->zero && !cpu->negative);
+
+    ram[0xfffe] = 0x00;
+    ram[0xffff] = 0x60;
+    run_at(cpu, {0x00});
+    EXPECT(cpu->pc == 0x6000 && !cpu->decimal && cpu->interrupt);
+
+    EXPECT(run_at(cpu, {0x03}) == 1 && cpu->pc == 0x301);
+    EXPECT(run_at(cpu, {0x02, 0x00}) == 2 && cpu->pc == 0x302);
+    EXPECT(run_at(cpu, {0x5c, 0x00, 0x00}) == 8 && cpu->pc == 0x303);
+
+    char    text[32];
+    uint8_t lda[] = {0xb2, 0x20, 0x00};
+    cpu->disasm(0x300, lda, text, sizeof(text));
+    EXPECT(strcmp(text, "LDA ($20)") == 0);
+
+    // lockstep lanes decode with the variant of the machines they load
+    static const uint8_t loop[] = {
+        0xa9, 0x00,          // $0300 LDA #0
+        0xa2, 0x00,          // $0302 LDX #0
+        0x9e, 0x00, 0x10,    // $0304 STZ $1000,X
+        0x1a,                // $0307 INC A
+        0xda,                // $0308 PHX
+        0xfa,                // $0309 PLX
+        0x89, 0x01,          // $030A BIT #1
+        0xf0, 0x03,          // $030C BEQ $0311
+        0x9d, 0x00, 0x11,    // $030E STA $1100,X
+        0xe8,                // $0311 INX
+        0x80, 0xf0,          // $0312 BRA $0304
+    };
+    Cpu     *ref     = new Cpu();
+    Cpu     *lane[2] = {new Cpu(), new Cpu()};
+    LaneCpu *lanes   = new LaneCpu();
+    for (Cpu *c : {ref, lane[0], lane[1]}) {
+        c->init();
+        c->variant   = CPU_CMOS;
+        c->idle_skip = false;
+        c->sp        = 0xff;
+        c->pc        = 0x300;
+        memset(c->mem->ram + 0x1000, 0xee, 0x200);
+        memcpy(c->mem->ram + 0x300, loop, sizeof(loop));
+    }
+    EXPECT(lanes->load(0, lane[0]) && lanes->load(1, lane[1]));
+    ref->start_frame();
+    while (0 < ref->frame_left)
+        ref->frame_left -= ref->run(false);
+    lanes->step();
+    lanes->store(0, lane[0]);
+    lanes->store(1, lane[1]);
+    EXPECT(lanes->lockstep_steps > 0 && ref->mem->ram[0x1000] == 0 && ref->mem->ram[0x1100] == 1 &&
+           ref->mem->ram[0x1101] == 0xee);
+    for (Cpu *c : lane) {
+        EXPECT(memcmp(c->mem->ram, ref->mem->ram, sizeof(ref->mem->ram)) == 0);
+        EXPECT(c->pc == ref->pc && c->a == ref->a && c->x == ref->x && c->sp == ref->sp &&
+               c->totalcycle == ref->totalcycle && c->steps == ref->steps);
+    }
+    Cpu *nmos = new Cpu();
+    nmos->init();
+    EXPECT(!lanes->load(2, nmos));
+    delete nmos;
+    delete lanes;
+    delete lane[0];
+    delete lane[1];
+    delete ref;
+
+    printf("cmos: passed\n");
+    delete cpu;
+    return 0;
+}
+struct TestCard
+{
+    uint16_t last_addr;
+    uint8_t  last_data;
+    int      fired;
+    size_t   late;
+    int      event;
+    Cpu     *cpu;
+};
+static uint8_t card_io_read(void *ctx, uint16_t addr)
+{
+    return 0xa0 | (addr & 0xf);
+}
+static void card_io_write(void *ctx, uint16_t addr, uint8_t data)
+{
+    TestCard *card  = (TestCard *)ctx;
+    card->last_addr = addr;
+    card->last_data = data;
+}
+static uint8_t card_rom_read(void *ctx, uint16_t addr)
+{
+    return addr & 0xff;
+}
+static uint8_t card_c8_read(void *ctx, uint16_t addr)
+{
+    return 0xc8;
+}
+static void card_tick(void *ctx, size_t cycle)
+{
+    TestCard *card = (TestCard *)ctx;
+    card->fired++;
+    if (card->cpu->totalcycle - cycle > card->late)
+        card->late = card->cpu->totalcycle - cycle;
+    card->cpu->events.at(card->event, cycle + 100);
+}
+static int test_slots()
+{
+    Cpu *cpu = new Cpu();
+    cpu->init();
+    Mem     *mem  = cpu->mem;
+    TestCard card = {0, 0, 0, 0, 0, cpu};
+
+    // an empty slot's I/O floats, it does not read the RAM underneath
+    mem->ram[0xc0d3] = 0x33;
+    mem->ram[0xc800] = 0x77;
+    EXPECT(mem->get(0xc0d3) == mem->floating_bus() && mem->floating_bus() != 0x33);
+    EXPECT(!mem->insert_card(0, Card{}));
+    EXPECT(mem->insert_card(5, Card{{card_io_read, card_io_write, &card}, {card_rom_read, nullptr, &card},
+                                    {card_c8_read, nullptr, &card}}));
+
+    size_t io_reads = mem->io_reads;
+    EXPECT(mem->get(0xc0d3) == 0xa3 && mem->io_reads == io_reads + 1);
+    mem->set(0xc0d7, 0x11);
+    EXPECT(card.last_addr == 0xc0d7 && card.last_data == 0x11);
+    EXPECT(mem->get(0xc0c3) == 0x00 && mem->get(0xc0e3) == 0x00);
+
+    EXPECT(mem->get(0xc800) == 0x77);
+    EXPECT(mem->get(0xc512) == 0x12 && mem->c8_slot == 5);
+    EXPECT(mem->get(0xc800) == 0xc8 && mem->get(0xcffe) == 0xc8);
+    mem->get(0xcfff);
+    EXPECT(mem->c8_slot == 0 && mem->get(0xc800) == 0x77);
+    EXPECT(mem->get(0xc600) == mem->ram[0xc600]);
+
+    mem->remove_card(5);
+    EXPECT(mem->get(0xc0d3) == mem->floating_bus() && mem->get(0xc512) == mem->ram[0xc512]);
+
+    // a loop branching to itself, idle skipped, with an event every 100 cycles
+    card.event = cpu->events.add(card_tick, &card);
+    EXPECT(card.event >= 0);
+    mem->ram[0x300] = 0xd0;
+    mem->ram[0x301] = 0xfe;
+    cpu->pc         = 0x300;
+    cpu->zero       = false;
+    cpu->events.at(card.event, cpu->totalcycle + 100);
+    cpu->run_frame();
+    EXPECT(card.fired >= 12600 / 100 - 1 && card.fired <= 12600 / 100 + 1);
+    EXPECT(card.late < 4);
+    EXPECT(cpu->idle_cycles > 0);
+
+    cpu->events.cancel(card.event);
+    cpu->run_frame();
+    EXPECT(card.fired <= 12600 / 100 + 1 && cpu->events.next == SIZE_MAX);
+
+    printf("slots: passed\n");
+    delete cpu;
+    return 0;
+}
+static int test_debugger()
+{
+    Cpu *cpu = new Cpu();
+    cpu->init();
+    uint8_t *ram = cpu->mem->ram;
+
+    // 0300: LDX #0; loop: JSR 0400; INX; BNE loop; JMP 0300
+    // 0400: STA $1234; LDA $10; RTS
+    uint8_t main[] = {0xa2, 0x00, 0x20, 0x00, 0x04, 0xe8, 0xd0, 0xfa, 0x4c, 0x00, 0x03};
+    uint8_t sub[]  = {0x8d, 0x34, 0x12, 0xa5, 0x10, 0x60};
+    memcpy(ram + 0x300, main, sizeof(main));
+    memcpy(ram + 0x400, sub, sizeof(sub));
+    cpu->pc = 0x300;
+
+    Debugger *dbg = new Debugger(cpu);
+    EXPECT(dbg->step(1) == STOP_DONE && cpu->pc == 0x302);
+    EXPECT(dbg->step_over() == STOP_DONE && cpu->pc == 0x305 && cpu->sp == 0xff);
+    EXPECT(dbg->step(1) == STOP_DONE && cpu->x == 1);
+
+    dbg->set_break(0x405);
+    EXPECT(dbg->run_frames(1) == STOP_BREAK && cpu->pc == 0x405 && cpu->x == 1);
+    EXPECT(dbg->run_frames(1) == STOP_BREAK && cpu->pc == 0x405 && cpu->x == 2);
+    dbg->clear_breaks();
+
+    dbg->set_watch(0x1234, 0x1234, false, true);
+    EXPECT(cpu->mem->trap[0x12] & TRAP_WATCH);
+    EXPECT(dbg->run_frames(1) == STOP_WATCH && dbg->hit_addr == 0x1234 && dbg->hit_write && cpu->pc == 0x403);
+    dbg->clear_watches();
+    dbg->set_watch(0x10, 0x10, true, false);
+    EXPECT(dbg->run_frames(1) == STOP_WATCH && dbg->hit_addr == 0x10 && !dbg->hit_write && cpu->pc == 0x405);
+    dbg->clear_watches();
+    EXPECT(cpu->mem->trap[0x00] == 0 && cpu->mem->trap[0x12] == 0 && cpu->mem->trap[0xc0] == TRAP_IO);
+
+    size_t target = cpu->totalcycle + 100000;
+    EXPECT(dbg->run_to_cycle(target) == STOP_DONE && cpu->totalcycle >= target && cpu->totalcycle < target + 8);
+
+    printf("debug: passed\n");
+    delete dbg;
+    delete cpu;
+    return 0;
+}
+static int test_state_hash()
+{
+    Cpu *cpu = new Cpu();
+    Cpu *alt = new Cpu();
+    cpu->init();
+    alt->init();
+    uint64_t empty = cpu->state_hash();
+    EXPECT(empty == alt->state_hash());
+
+    uint32_t seed = 1;
+    for (int i = 0; i < 5000; i++) {
+        seed = seed * 1103515245 + 12345;
+        cpu->mem->set((seed >> 8) & 0xbfff, seed >> 24);
+    }
+    uint64_t h = cpu->state_hash();
+    cpu->mem->rehash();
+    EXPECT(h == cpu->state_hash());
+    EXPECT(h != empty);
+
+    uint8_t old = cpu->mem->ram[0x1234];
+    cpu->mem->set(0x1234, old ^ 0x55);
+    EXPECT(h != cpu->state_hash());
+    cpu->mem->set(0x1234, old);
+    EXPECT(h == cpu->state_hash());
+
+    cpu->a ^= 1;
+    EXPECT(h != cpu->state_hash());
+    cpu->a ^= 1;
+    cpu->carry = !cpu->carry;
+    EXPECT(h != cpu->state_hash());
+    cpu->carry = !cpu->carry;
+
+    // the same bytes written in reverse order
+    for (int a = 0xbfff; a >= 0; a--) {
+        if (cpu->mem->ram[a] != 0)
+            alt->mem->set(a, cpu->mem->ram[a]);
+    }
+    EXPECT(h == alt->state_hash());
+
+    // the soft switches and aux memory count too, and an aux byte does not
+    // cancel the same byte at the same main address
+    cpu->mem->set(0x1234, 0x5a);
+    uint64_t main = cpu->state_hash();
+    cpu->mem->set_switch(0xc005);    // RAMWRT, writes go to aux
+    uint64_t banked = cpu->state_hash();
+    EXPECT(banked != main);
+    cpu->mem->set(0x1234, 0x5a);
+    uint64_t aux = cpu->state_hash();
+    EXPECT(aux != banked && cpu->mem->aux[0x1234] == 0x5a);
+    cpu->mem->rehash();
+    EXPECT(aux == cpu->state_hash());
+    cpu->mem->set(0x1234, 0);
+    EXPECT(banked == cpu->state_hash());
+    cpu->mem->set(0x1234, 0x5a);
+
+    Snapshot *snap = Snapshot::take(cpu);
+    alt->init();
+    snap->restore(alt);
+    EXPECT(aux == alt->state_hash());
+    delete snap;
+
+    printf("state hash: passed\n");
+    delete alt;
+    delete cpu;
+    return 0;
+}
+static int test_video()
+{
+    Cpu *cpu = new Cpu();
+    cpu->init();
+    Mem *mem = cpu->mem;
+
+    // aux memory is only allocated once a page is banked in, here by 80STORE
+    // with PAGE2, and reset drops it again; snapshots carry it only if present
+    EXPECT(!mem->has_aux() && mem->aux[0x1234] == 0 && sizeof(Mem) < 80 * 1024);
+    Snapshot *bare = Snapshot::take(cpu);
+    EXPECT(bare->aux_len == 0 && bare->size() == sizeof(Snapshot));
+    mem->set(0xc001, 0);
+    EXPECT(!mem->has_aux());
+    mem->get(0xc055);
+    EXPECT(mem->has_aux());
+    mem->get(0xc054);
+    mem->set(0xc000, 0);
+    Snapshot *full = Snapshot::take(cpu);
+    EXPECT(full->aux_len == 0xc000);
+    bare->restore(cpu);
+    EXPECT(!mem->has_aux());
+    full->restore(cpu);
+    EXPECT(mem->has_aux());
+    cpu->init();
+    EXPECT(!mem->has_aux());
+    delete bare;
+    delete full;
+
+    // RAMWRT sends writes to aux, RAMRD reads them back
+    mem->set(0x1234, 0x11);
+    mem->set(0xc005, 0);
+    mem->set(0x1234, 0x22);
+    EXPECT(mem->ram[0x1234] == 0x11 && mem->aux[0x1234] == 0x22 && mem->get(0x1234) == 0x11);
+    mem->set(0xc003, 0);
+    EXPECT(mem->get(0x1234) == 0x22 && (mem->get(0xc013) & 0x80) && (mem->get(0xc014) & 0x80));
+    mem->set(0xc002, 0);
+    mem->set(0xc004, 0);
+    EXPECT(mem->get(0x1234) == 0x11 && !(mem->get(0xc013) & 0x80) && mem->get(0x0100) == mem->ram[0x0100]);
+
+    // 80STORE: PAGE2 picks the aux text and hi-res pages, not the displayed page
+    mem->set(0xc001, 0);
+    mem->get(0xc055);
+    EXPECT(mem->display_page() == 0 && (mem->get(0xc018) & 0x80));
+    const uint8_t magenta[4] = {0x08, 0x11, 0x22, 0x44};
+    const char   *hello     = "HELLO";
+    for (int i = 0; i < 2; i++) {
+        mem->set(0x2000 + i, magenta[2 * i]);
+        mem->set(0x0400 + i, 0x80 | hello[2 * i]);
+    }
+    mem->get(0xc054);
+    for (int i = 0; i < 2; i++) {
+        mem->set(0x2000 + i, magenta[2 * i + 1]);
+        mem->set(0x0400 + i, 0x80 | hello[2 * i + 1]);
+    }
+    EXPECT(mem->aux[0x2000] == 0x08 && mem->ram[0x2000] == 0x11 && mem->aux[0x0400] == ('H' | 0x80));
+
+    // double hi-res: 560 dots, 140 pixels of four
+    mem->set(0xc00d, 0);
+    mem->get(0xc05e);
+    EXPECT((mem->get(0xc01f) & 0x80) && (mem->get(0xc07f) & 0x80) && (mem->get(0xc01d) & 0x80));
+    cpu->draw_frame();
+    uint32_t *img = cpu->get_img_data();
+    for (int x = 0; x < 28; x++)
+        EXPECT(img[x] == 0xffdd0033 && img[560 + x] == 0xffdd0033);
+    EXPECT(img[28] == 0xff000000);
+
+    // a later write only redraws its own row; main bytes hold dots 7-13
+    mem->set(0x2000 + mem->scanline_to_offset[8], 0x7f);
+    EXPECT(mem->dirty_scanlines[8] && !mem->dirty_scanlines[0]);
+    cpu->draw_frame();
+    EXPECT(img[8 * 1120 + 8] == 0xffffffff && img[8 * 1120] == 0xff000000 && !mem->dirty_scanlines[8]);
+
+    // 80 columns: H from aux at dot 0, E from main at dot 7; the second line
+    // of H has dots 1 and 5 lit
+    mem->get(0xc051);
+    cpu->draw_frame();
+    EXPECT(img[1120 + 1] == 0xff00ff00 && img[1120 + 5] == 0xff00ff00 && img[1120 + 2] == 0xff000000);
+    EXPECT(img[1120 + 8] == 0xff00ff00 && img[1120 + 9] == 0xff000000);
+    mem->set(0xc00c, 0);
+    cpu->draw_frame();
+    // 40 columns: E from main, each dot two pixels wide
+    EXPECT(img[1120 + 2] == 0xff00ff00 && img[1120 + 3] == 0xff00ff00 && img[1120 + 4] == 0xff000000);
+    EXPECT(img[1120 + 14 + 2] == 0xff00ff00);
+
+    // lo-res, low nibble in the top half of the block
+    mem->set(0xc000, 0);
+    mem->get(0xc050);
+    mem->get(0xc056);
+    mem->set(0x0400, 0x9d);
+    cpu->draw_frame();
+    EXPECT(img[0] == 0xffffff00 && img[4 * 1120] == 0xffff6600);
+
+    printf("video: passed\n");
+    delete cpu;
+    return 0;
+}
+// Puts the beam at cycle h of line, or the next position after it: the beam
+// moves more than one position a CPU cycle. Returns where it ended up.
+static int set_beam(Cpu *cpu, int line, int h)
+{
+    int target      = line * VIDEO_LINE_CYCLES + h;
+    cpu->totalcycle = cpu->mem->frame_start + (size_t)target * FRAME_CYCLES / (VIDEO_LINE_CYCLES * VIDEO_LINES);
+    while (cpu->mem->beam_cycle() < target)
+        cpu->totalcycle++;
+    return cpu->mem->beam_cycle() - line * VIDEO_LINE_CYCLES;
+}
+static int test_beam()
+{
+    Cpu *cpu = new Cpu();
+    cpu->init();
+    Mem *mem = cpu->mem;
+    for (int addr = 0x400; addr < 0x6000; addr++)
+        mem->ram[addr] = addr * 7 + (addr >> 8);
+    cpu->start_frame();
+
+    // visible bytes are the row's own, from cycle 25 of the line
+    for (int y : {0, 65, 130, 191}) {
+        for (int col : {0, 17, 38}) {
+            int h = set_beam(cpu, y, 25 + col);
+            EXPECT(mem->get(0xc030) == mem->ram[0x2000 + mem->scanline_to_offset[y] + h - 25]);
+        }
+    }
+    // the counter sits at 0 for two cycles, then blanking reads the 24 bytes
+    // before the row, which for the top third are the screen holes at $68
+    EXPECT(set_beam(cpu, 0, 0) == 0 && mem->get(0xc0c0) == mem->ram[0x2068]);
+    for (int h0 : {1, 12, 23}) {
+        int h = set_beam(cpu, 0, h0);
+        EXPECT(mem->get(0xc0c0) == mem->ram[0x2068 + h - 1]);
+        h = set_beam(cpu, 64, h0);
+        EXPECT(mem->get(0xc0c0) == mem->ram[0x2000 + 40 - 24 + h - 1]);
+    }
+    // vertical blanking counts on into a fourth third
+    int h = set_beam(cpu, 200, 25);
+    EXPECT(h == 25 && mem->get(0xc0c0) == mem->ram[0x2000 | (200 & 7) << 10 | (200 >> 3 & 7) << 7 | 0x78]);
+    set_beam(cpu, 100, 0);
+    EXPECT(mem->get(0xc019) & 0x80);
+    set_beam(cpu, 200, 0);
+    EXPECT(!(mem->get(0xc019) & 0x80));
+    // buttons read released, the rest of the byte floats
+    h = set_beam(cpu, 0, 25);
+    EXPECT(mem->get(0xc061) == (mem->ram[0x2000 + h - 25] & 0x7f));
+
+    // text mode reads the text page; switch reads float too
+    h            = set_beam(cpu, 24, 30);
+    uint8_t seen = mem->get(0xc051);
+    EXPECT(seen == mem->ram[0x400 + mem->text_row_to_offset[3] + h - 25] && mem->get(0xc030) == seen);
+    mem->get(0xc050);
+
+    // flipping to an empty page 2 at line 96 keeps the top half of page 1
+    cpu->start_frame();
+    for (int addr = 0x2000; addr < 0x4000; addr++)
+        mem->ram[addr] = 0x7f;
+    memset(mem->ram + 0x4000, 0, 0x2000);
+    set_beam(cpu, 96, 0);
+    mem->get(0xc055);
+    EXPECT(mem->scan_line == 96);
+    cpu->draw_frame();
+    EXPECT(cpu->imgdata[0] == 0xff00ff00 && cpu->imgdata[95 * 1120] == 0xff00ff00);
+    EXPECT(cpu->imgdata[96 * 1120] == 0xff000000 && cpu->imgdata[191 * 1120] == 0xff000000);
+    // the next frame shows page 2 throughout, a flip back in blanking changes
+    // nothing on screen
+    cpu->start_frame();
+    set_beam(cpu, 250, 0);
+    mem->get(0xc054);
+    cpu->draw_frame();
+    EXPECT(cpu->imgdata[0] == 0xff000000 && cpu->imgdata[191 * 1120] == 0xff000000);
+    cpu->start_frame();
+    cpu->draw_frame();
+    EXPECT(cpu->imgdata[0] == 0xff00ff00 && mem->scan_line == 0);
+    printf("beam: passed\n");
+    delete cpu;
+    return 0;
+}
+static int test_shm()
+{
+    Cpu *cpu = new Cpu();
+    cpu->init();
+    string name = "/apple2-conformance-" + to_string(getpid());
+
+    ShmExport *out = new ShmExport(name);
+    EXPECT(out->ok());
+    const ShmState *in = ShmExport::attach(name);
+    EXPECT(in != nullptr && in->seq.load() == 2 && in->frame == 0);
+
+    cpu->a  = 0x42;
+    cpu->pc = 0x1234;
+    cpu->mem->set(0x2000, 0x01);
+    cpu->draw_frame();
+    out->publish(cpu);
+    uint64_t seq = ShmExport::read_begin(in);
+    EXPECT(seq == 4 && in->frame == 1 && in->a == 0x42 && in->pc == 0x1234 && in->ram[0x2000] == 0x01);
+    EXPECT(in->pixels[0] == 0xff00ff00 && in->pixels[2] == 0xff000000 && !ShmExport::read_retry(in, seq));
+    for (int y = 0; y < 192; y++)
+        EXPECT(!cpu->drawn_rows[y]);
+
+    // only the redrawn row is copied again
+    cpu->mem->set(0x2000, 0x00);
+    cpu->mem->set(0x2400, 0x7f);
+    cpu->draw_frame();
+    out->publish(cpu);
+    EXPECT(ShmExport::read_retry(in, seq));
+    seq = ShmExport::read_begin(in);
+    EXPECT(seq == 6 && in->frame == 2 && in->pixels[0] == 0xff000000 && in->pixels[1120] == 0xff00ff00);
+
+    ShmExport::detach(in);
+    delete out;
+    EXPECT(ShmExport::attach(name) == nullptr);
+    printf("shm: passed\n");
+    delete cpu;
+    return 0;
+}
+static string read_file(const char *path)
+{
+    string data;
+    FILE  *f = fopen(path, "rb");
+    if (f == nullptr)
+        return data;
+    char   buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        data.append(buf, n);
+    fclose(f);
+    return data;
+}
+static int test_capture()
+{
+    Cpu *cpu = new Cpu();
+    cpu->init();
+    Mem *mem = cpu->mem;
+
+    // a ring of two slots, so the encoders are made to fall behind
+    Capture *a2v = new Capture("capture_test.a2v", CAPTURE_A2V, 2);
+    Capture *y4m = new Capture("capture_test.y4m", CAPTURE_Y4M, 2);
+    EXPECT(a2v->ok() && y4m->ok());
+
+    uint32_t seed = 1;
+    for (int f = 0; f < 40; f++) {
+        if (f == 5)
+            mem->set(0x2000, 0x01);    // top left dot
+        if (f == 6)
+            mem->set(0x2000, 0x01);    // written but unchanged
+        if (f >= 10 && f < 20) {
+            for (int i = 0; i < 300; i++) {
+                seed = seed * 1103515245 + 12345;
+                mem->set(0x2000 + (seed >> 8) % 0x2000, seed >> 24);
+            }
+        }
+        if (f == 25)
+            mem->set(0x4000, 0x7f);
+        if (f == 26)
+            mem->page_2 = 1;
+        if (f == 30)
+            mem->page_2 = 0;
+        if (f == 33)
+            mem->set_switch(0xc051);    // text, all inverse @
+        if (f == 36) {
+            mem->set_switch(0xc050);    // lo-res, recorded blank
+            mem->set_switch(0xc056);
+        }
+        a2v->frame(mem);
+        y4m->frame(mem);
+    }
+    a2v->close();
+    y4m->close();
+    // blank, the dot, ten noisy frames, page 2, page 1 again, text and lo-res
+    EXPECT(a2v->frames == 40 && a2v->stored == 16 && y4m->stored == 16);
+    EXPECT(a2v->blanked == 4 && y4m->blanked == 4);
+    delete a2v;
+    delete y4m;
+
+    EXPECT(Capture::to_y4m("capture_test.a2v", "capture_conv.y4m"));
+    string direct = read_file("capture_test.y4m");
+    string conv   = read_file("capture_conv.y4m");
+    size_t header = direct.find('\n') + 1;
+    size_t frame  = 6 + CAPTURE_WIDTH * CAPTURE_ROWS * 3 / 2;
+    EXPECT(direct.size() == header + 40 * frame && direct == conv);
+    // frame 5 lights exactly the first dot of row 0, frame 26 the first seven
+    EXPECT((uint8_t)direct[header + 5 * frame + 6] == 0xff && direct[header + 5 * frame + 7] == 0);
+    EXPECT(direct.compare(header + 26 * frame + 6, 7, string(7, (char)0xff)) == 0);
+    // the bottom line of an inverse glyph is fully lit, the lo-res frame dark
+    size_t plane = CAPTURE_WIDTH * CAPTURE_ROWS;
+    size_t line7 = header + 33 * frame + 6 + 7 * CAPTURE_WIDTH;
+    EXPECT(direct.compare(line7, CAPTURE_WIDTH, string(CAPTURE_WIDTH, (char)0xff)) == 0);
+    EXPECT(direct.compare(header + 36 * frame + 6, plane, string(plane, 0)) == 0);
+
+    remove("capture_test.a2v");
+    remove("capture_test.y4m");
+    remove("capture_conv.y4m");
+    printf("capture: passed\n");
+    delete cpu;
+    return 0;
+}
+static int test_image(const char *path, uint16_t load, uint16_t start, int success, int error_addr)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr) {
+        printf("%s: not found, skipping\n", path);
+        return EXIT_SKIP;
+    }
+    Cpu *cpu = new Cpu();
+    cpu->init();
+    size_t len = fread(&cpu->mem->ram[load], 1, 0x10000 - load, f);
+    fclose(f);
+    if (len == 0) {
+        printf("%s: empty image\n", path);
+        delete cpu;
+        return 1;
+    }
+
+    cpu->pc           = start;
+    const size_t max  = 200000000;
+    uint16_t     trap = 0;
+    while (cpu->steps < max) {
+        uint16_t prepc = cpu->pc;
+        cpu->run(false);
+        if (cpu->pc == prepc) {
+            trap = prepc;
+            break;
+        }
+    }
+
+    int result = 0;
+    if (cpu->steps >= max) {
+        printf("%s: no trap after %zu instructions\n", path, max);
+        result = 1;
+    } else if (success >= 0 && trap != success) {
+        printf("%s: trapped at %04X, expected %04X\n", path, trap, success);
+        result = 1;
+    } else if (error_addr >= 0 && cpu->mem->ram[error_addr] != 0) {
+        printf("%s: error flag at %04X is %02X\n", path, error_addr, cpu->mem->ram[error_addr]);
+        result = 1;
+    }
+    if (result != 0) {
+        dump_state(cpu, trap);
+    } else {
+        printf("%s: passed at %04X after %zu instructions, %zu cycles\n", path, trap, cpu->steps, cpu->totalcycle);
+    }
+    delete cpu;
+    return result;
+}
+static int test_metrics()
+{
+    Cpu *cpu = new Cpu();
+    cpu->init();
+
+    // exact below 16, then every bucket is within 1/16 of its low edge
+    for (uint64_t v : std::initializer_list<uint64_t>{0, 15, 16, 17, 31, 32, 1000, 16667000, UINT64_MAX}) {
+        int i = Metrics::bucket(v);
+        EXPECT(i >= 0 && i < HIST_BUCKETS && Metrics::bucket_low(i) <= v);
+        EXPECT(v - Metrics::bucket_low(i) <= Metrics::bucket_low(i) / 16);
+        EXPECT(i + 1 == HIST_BUCKETS || Metrics::bucket_low(i + 1) > v);
+    }
+
+    Metrics *m = new Metrics();
+    EXPECT(m->value(M_CPU_STEP) == 0 && m->quantile(M_CPU_STEP, 0.5) == 0);
+    // 1..1000us on this thread and 1001..2000us on another
+    for (uint64_t us = 1; us <= 1000; us++)
+        m->observe(M_CPU_STEP, us * 1000);
+    m->add(M_INSTRUCTIONS, 5);
+    std::thread other([m] {
+        for (uint64_t us = 1001; us <= 2000; us++)
+            m->observe(M_CPU_STEP, us * 1000);
+        m->add(M_INSTRUCTIONS, 7);
+    });
+    other.join();
+    m->add(M_INSTRUCTIONS, 1);
+    EXPECT(m->value(M_CPU_STEP) == 2000 && m->value(M_INSTRUCTIONS) == 13);
+    uint64_t p50 = m->quantile(M_CPU_STEP, 0.5);
+    uint64_t p99 = m->quantile(M_CPU_STEP, 0.99);
+    EXPECT(p50 <= 1000000 && p50 >= 1000000 - 1000000 / 16);
+    EXPECT(p99 <= 1980000 && p99 >= 1980000 - 1980000 / 16);
+    EXPECT(m->quantile(M_CPU_STEP, 0) == 1000 && m->quantile(M_CPU_STEP, 1) >= 2000000 - 2000000 / 16);
+
+    EXPECT(m->dump("metrics_test.prom") && m->dump("metrics_test.json"));
+    string prom = read_file("metrics_test.prom");
+    string json = read_file("metrics_test.json");
+    EXPECT(prom.find("# TYPE apple2_cpu_step_seconds histogram\n") != string::npos);
+    EXPECT(prom.find("apple2_cpu_step_seconds_bucket{le=\"+Inf\"} 2000\n") != string::npos);
+    EXPECT(prom.find("apple2_cpu_step_seconds_count 2000\n") != string::npos);
+    EXPECT(prom.find("apple2_cpu_step_seconds_sum 2.001000000\n") != string::npos);
+    EXPECT(prom.find("apple2_instructions_total 13\n") != string::npos);
+    EXPECT(prom.find("apple2_draw_frame_seconds_count 0\n") != string::npos);
+    EXPECT(json[0] == '{' && json.find("\"apple2_instructions_total\": 13") != string::npos);
+    EXPECT(json.find("\"apple2_cpu_step_seconds\": {\"count\": 2000, \"sum_ns\": 2001000000, \"min_ns\": 1000, "
+                     "\"max_ns\": 2000000") != string::npos);
+    remove("metrics_test.prom");
+    remove("metrics_test.json");
+    delete m;
+
+    // a new instance on the same thread starts from its own shard; Cpu::step
+    // records one step, one draw and the instructions of each frame
+    m            = new Metrics();
+    cpu->metrics = m;
+    cpu->mem->set(0x400, 0x4c);    // JMP $0400
+    cpu->mem->set(0x401, 0x00);
+    cpu->mem->set(0x402, 0x04);
+    cpu->pc        = 0x400;
+    cpu->idle_skip = false;
+    size_t steps0  = cpu->steps;
+    for (int f = 0; f < 3; f++)
+        cpu->step();
+    EXPECT(m->value(M_FRAMES) == 3 && m->value(M_CPU_STEP) == 3 && m->value(M_DRAW_FRAME) == 3);
+    EXPECT(m->value(M_INSTRUCTIONS) == cpu->steps - steps0 && m->value(M_INSTRUCTIONS) == 3 * 12600 / 3);
+    cpu->metrics = nullptr;
+    delete m;
+    printf("metrics: passed\n");
+    delete cpu;
+    return 0;
+}
+static int test_heatmap()
+{
+#ifndef MEM_HEATMAP
+    printf("heatmap: not compiled in, rebuild with -DMEM_HEATMAP=ON, skipping\n");
+    return EXIT_SKIP;
+#else
+    Cpu *cpu = new Cpu();
+    cpu->init();
+    Mem *mem = cpu->mem;
+
+    // the second STA rewrites the operand of the first LDA, which already ran
+    const uint8_t prg[] = {0xa9, 0x05,           // LDA #$05
+                           0x8d, 0x00, 0x20,     // STA $2000
+                           0xad, 0x00, 0x20,     // LDA $2000
+                           0x8d, 0x01, 0x03,     // STA $0301
+                           0x4c, 0x0b, 0x03};    // JMP $030B
+    memcpy(mem->ram + 0x300, prg, sizeof(prg));
+    Heatmap *heat  = new Heatmap();
+    mem->heat      = heat;
+    cpu->pc        = 0x300;
+    cpu->idle_skip = false;
+    for (int i = 0; i < 14; i++)
+        cpu->run(false);
+
+    EXPECT(heat->fetches[0x300] == 1 && heat->fetches[0x302] == 1 && heat->fetches[0x30b] == 10);
+    EXPECT(heat->fetches[0x301] == 0 && heat->reads[0x301] == 1 && heat->reads[0x30c] == 10);
+    EXPECT(heat->reads[0x2000] == 1 && heat->writes[0x2000] == 1 && heat->flags[0x2000] == 0);
+    EXPECT(heat->writes[0x301] == 1 && heat->smc[0x301] == 1 && (heat->flags[0x301] & HEAT_SMC));
+    EXPECT((heat->flags[0x30d] & HEAT_EXECUTED) && !(heat->flags[0x30d] & HEAT_SMC) && heat->smc[0x30d] == 0);
+
+    // counters stop at the top instead of wrapping
+    heat->reads[0x10] = UINT32_MAX - 1;
+    heat->read(0x10);
+    heat->read(0x10);
+    EXPECT(heat->reads[0x10] == UINT32_MAX);
+
+    FILE *out = fopen("heatmap_test.txt", "w");
+    EXPECT(out != nullptr);
+    heat->report(out);
+    fclose(out);
+    string report = read_file("heatmap_test.txt");
+    EXPECT(report.find("\n$0000 ") != string::npos && report.find("\n$0300 ") != string::npos &&
+           report.find("\n$2000 ") != string::npos && report.find("\n$0400 ") == string::npos);
+    EXPECT(report.find("\ntotal ") != string::npos);
+
+    // the self-modified byte is white, $2000 has writes, reads and no fetches
+    EXPECT(heat->save_ppm("heatmap_test.ppm"));
+    string ppm    = read_file("heatmap_test.ppm");
+    size_t pixels = ppm.size() - 0x10000 * 3;
+    EXPECT(ppm.compare(0, pixels, "P6\n256 256\n255\n") == 0);
+    EXPECT(ppm.compare(pixels + 0x301 * 3, 3, string(3, (char)0xff)) == 0);
+    EXPECT(ppm[pixels + 0x2000 * 3] != 0 && ppm[pixels + 0x2000 * 3 + 1] != 0 && ppm[pixels + 0x2000 * 3 + 2] == 0);
+    EXPECT(ppm[pixels + 0x400 * 3] == 0);
+    remove("heatmap_test.txt");
+    remove("heatmap_test.ppm");
+
+    heat->clear();
+    EXPECT(heat->reads[0x10] == 0 && heat->fetches[0x30b] == 0 && heat->flags[0x301] == 0);
+    mem->heat = nullptr;
+    delete heat;
+    printf("heatmap: passed\n");
+    delete cpu;
+    return 0;
+#endif
+}
+// Latches PSG register reg of the first 6522 and writes value into it.
+static void ay_set(Mem *mem, uint8_t reg, uint8_t value)
+{
+    mem->set(0xc401, reg);
+    mem->set(0xc400, 0x07);
+    mem->set(0xc400, 0x04);
+    mem->set(0xc401, value);
+    mem->set(0xc400, 0x06);
+    mem->set(0xc400, 0x04);
+}
+static int test_mockingboard()
+{
+    Cpu *cpu = new Cpu();
+    cpu->init();
+    Mem          *mem = cpu->mem;
+    Mockingboard *mb  = new Mockingboard(cpu);
+    EXPECT(mb->ok() && mb->slot == 4);
+
+    // IRQ handler at $4000 acknowledges T1 and counts in $10
+    mem->ram[0xfffe] = 0x00;
+    mem->ram[0xffff] = 0x40;
+    mem->ram[0x4000] = 0xad;    // LDA $C404
+    mem->ram[0x4001] = 0x04;
+    mem->ram[0x4002] = 0xc4;
+    mem->ram[0x4003] = 0xe6;    // INC $10
+    mem->ram[0x4004] = 0x10;
+    mem->ram[0x4005] = 0x40;    // RTI
+    mem->ram[0x300]  = 0xd0;    // BNE $0300
+    mem->ram[0x301]  = 0xfe;
+    mem->ram[0x10]   = 0;
+    cpu->pc          = 0x300;
+    cpu->sp          = 0xff;
+    cpu->zero        = false;
+    cpu->interrupt   = true;
+
+    // one-shot T1, masked by the I flag
+    mem->set(0xc40e, 0xc0);
+    mem->set(0xc404, 0xe8);
+    mem->set(0xc405, 0x03);
+    EXPECT(mem->get(0xc405) == 0x03 && mem->get(0xc40e) == 0xc0);
+    cpu->run_frame();
+    EXPECT(mb->irqs == 1 && (cpu->irq_lines & MB_IRQ) && mem->get(0xc40d) == 0xc0);
+    mem->get(0xc404);
+    EXPECT(mem->get(0xc40d) == 0x00 && !(cpu->irq_lines & MB_IRQ));
+    cpu->run_frame();
+    EXPECT(mb->irqs == 1 && mem->ram[0x10] == 0);
+
+    // free-running T1 every 1000 cycles, taken by the handler
+    mem->set(0xc40b, 0x40);
+    mem->set(0xc404, 998 & 0xff);
+    mem->set(0xc405, 998 >> 8);
+    cpu->interrupt = false;
+    cpu->run_frame();
+    EXPECT(mem->ram[0x10] >= 12 && mem->ram[0x10] <= 13 && mb->irqs == (size_t)mem->ram[0x10] + 1);
+    mem->set(0xc40e, 0x40);
+    cpu->run_frame();
+    EXPECT(mem->ram[0x10] <= 13 && (mem->get(0xc40d) & 0x40) && !(cpu->irq_lines & MB_IRQ));
+    cpu->interrupt = true;
+
+    // tone A at 1020484 / (16 * 64) Hz, full volume, the rest muted
+    mem->set(0xc403, 0xff);
+    mem->set(0xc402, 0xff);
+    ay_set(mem, 0, 64);
+    ay_set(mem, 1, 0xf0);
+    ay_set(mem, 7, 0x3e);
+    ay_set(mem, 8, 15);
+    EXPECT(mb->ay[0].regs[1] == 0 && mb->ay[0].regs[7] == 0x3e && mb->ay[1].log.size() == 16);
+    mem->set(0xc403, 0x00);
+    mem->set(0xc400, 0x05);
+    EXPECT(mem->get(0xc401) == 15);
+
+    int16_t pcm[2 * 1024];
+    while (mb->render(pcm, 1024) > 0)
+        ;
+    cpu->run_frame();
+    size_t n = mb->render(pcm, 1024);
+    EXPECT(n >= 543 && n <= 545 && mb->ay[0].log.empty());
+    int edges = 0;
+    for (size_t i = 0; i < n; i++) {
+        EXPECT(pcm[i * 2] == 0 || pcm[i * 2] == 10922);
+        EXPECT(pcm[i * 2 + 1] == 0);
+        edges += i > 0 && pcm[i * 2] > pcm[i * 2 - 2];
+    }
+    EXPECT(edges >= 12 && edges <= 13);
+
+    // /RESET clears the PSG, silencing it from that cycle on
+    mem->set(0xc400, 0x00);
+    EXPECT(mb->ay[0].regs[8] == 0);
+    cpu->run_frame();
+    mb->render(pcm, 1024);
+    EXPECT(pcm[200] == 0 && pcm[400] == 0);
+
+    WavWriter *wav = new WavWriter("mockingboard_test.wav", 44100, 2);
+    EXPECT(wav->ok());
+    wav->write(pcm, n);
+    wav->close();
+    string file = read_file("mockingboard_test.wav");
+    EXPECT(file.size() == 44 + n * 4 && file.compare(0, 4, "RIFF") == 0 && file.compare(8, 8, "WAVEfmt ") == 0);
+    uint32_t riff, rate, data;
+    memcpy(&riff, file.data() + 4, 4);
+    memcpy(&rate, file.data() + 24, 4);
+    memcpy(&data, file.data() + 40, 4);
+    EXPECT(riff == 36 + n * 4 && rate == 44100 && data == n * 4);
+    delete wav;
+    remove("mockingboard_test.wav");
+
+    // reset and restore move the cycle counter; an armed one-shot T1 keeps
+    // its count and still fires, and the audio carries on
+    mem->set(0xc40b, 0x00);
+    mem->set(0xc404, 0xe8);
+    mem->set(0xc405, 0x03);
+    uint8_t   count = mem->get(0xc404);
+    Snapshot *snap  = Snapshot::take(cpu);
+    while (mb->render(pcm, 1024) > 0)
+        ;
+    cpu->reset();
+    EXPECT(cpu->totalcycle == 7 && mem->get(0xc404) == count && cpu->events.next == mb->via[0].t1_zero);
+    EXPECT(mb->render(pcm, 1024) == 0);
+    snap->restore(cpu);
+    EXPECT(mem->get(0xc404) == count && cpu->events.next == mb->via[0].t1_zero && !(mem->get(0xc40d) & 0x40));
+    cpu->run_frame();
+    n = mb->render(pcm, 1024);
+    EXPECT(n >= 543 && n <= 545 && (mem->get(0xc40d) & 0x40));
+    delete snap;
+
+    // a loop polling the T1 counter is not idle: with idle skip on it sees
+    // the high byte reach 0 at the same cycle as with it off
+    const uint8_t poll[] = {0xad, 0x05, 0xc4,     // LDA $C405
+                            0xd0, 0xfb,           // BNE $0500
+                            0xae, 0x04, 0xc4,     // LDX $C404
+                            0x86, 0x11,           // STX $11
+                            0x4c, 0x0a, 0x05};    // JMP $050A
+    uint8_t low[2];
+    for (int skip = 0; skip < 2; skip++) {
+        memcpy(mem->ram + 0x500, poll, sizeof(poll));
+        cpu->pc        = 0x500;
+        cpu->idle_skip = skip;
+        mem->set(0xc404, 0xff);
+        mem->set(0xc405, 0x20);
+        cpu->run_frame();
+        EXPECT(cpu->pc == 0x50a);
+        low[skip] = mem->ram[0x11];
+    }
+    EXPECT(low[0] == low[1] && low[0] > 0xf0);
+    cpu->idle_skip = true;
+
+    delete mb;
+    EXPECT(mem->get(0xc404) == mem->ram[0xc404] && cpu->irq_lines == 0);
+
+    // boards give their four events back, so slots 1-4 fill the scheduler,
+    // a fifth board fits once one of them is gone, and boards can come and go
+    Mockingboard *boards[4];
+    for (int s = 0; s < 4; s++) {
+        boards[s] = new Mockingboard(cpu, s + 1);
+        EXPECT(boards[s]->ok());
+    }
+    Mockingboard *extra = new Mockingboard(cpu, 5);
+    EXPECT(!extra->ok());
+    delete extra;
+    delete boards[1];
+    extra = new Mockingboard(cpu, 5);
+    EXPECT(extra->ok());
+    delete extra;
+    delete boards[0];
+    delete boards[2];
+    delete boards[3];
+    for (int i = 0; i < 8; i++) {
+        mb = new Mockingboard(cpu);
+        EXPECT(mb->ok());
+        delete mb;
+    }
+    printf("mockingboard: passed\n");
+    delete cpu;
+    return 0;
+}
+// Waits for a key: A jams on KIL, B recurses through JSR until S wraps, C
+// jumps to $C000 and anything else counts up in $10.
+static const uint8_t fuzz_prg[] = {
+    0x00, 0x08, 0x20, 0x00,                // load $0800, 32 bytes
+    0xad, 0x00, 0xc0, 0x10, 0xfb,          // $0800 LDA $C000, BPL $0800
+    0x2c, 0x10, 0xc0,                      // $0805 BIT $C010
+    0xc9, 0xc1, 0xf0, 0x0d,                // $0808 CMP #'A', BEQ $0819
+    0xc9, 0xc2, 0xf0, 0x0a,                // $080C CMP #'B', BEQ $081A
+    0xc9, 0xc3, 0xf0, 0x09,                // $0810 CMP #'C', BEQ $081D
+    0xe6, 0x10, 0x4c, 0x00, 0x08,          // $0814 INC $10, JMP $0800
+    0x02,                                  // $0819 KIL
+    0x20, 0x1a, 0x08,                      // $081A JSR $081A
+    0x4c, 0x00, 0xc0,                      // $081D JMP $C000
+};
+static int test_fuzz()
+{
+    Cpu *cpu = new Cpu();
+    FILE *f  = fopen("fuzz_test.bin", "wb");
+    EXPECT(f != nullptr);
+    fwrite(fuzz_prg, sizeof(fuzz_prg), 1, f);
+    fclose(f);
+    f = fopen("fuzz_test.rom", "wb");
+    EXPECT(f != nullptr);
+    for (int i = 0; i < 0x4000; i++)
+        fputc(0xea, f);
+    fclose(f);
+
+    FuzzConfig cfg;
+    cfg.bios       = "fuzz_test.rom";
+    cfg.prg        = "fuzz_test.bin";
+    cfg.threads    = 2;
+    cfg.frames     = 20;
+    cfg.keys       = "65,66,67,68";
+    cfg.score_addr = 0x10;
+    Fuzzer *fuzz   = new Fuzzer();
+    EXPECT(fuzz->init(cfg));
+
+    vector<uint8_t> cov(0x10000);
+    vector<uint8_t> keys(20);
+    FuzzResult      r = fuzz->execute(fuzz->machine(0), keys, cov.data());
+    EXPECT(r.crash == FUZZ_NONE && r.frame == 20 && r.coverage == 2 && cov[0x800] && cov[0x803]);
+    keys[3] = 'D';
+    keys[4] = 'D';
+    r       = fuzz->execute(fuzz->machine(1), keys, cov.data());
+    EXPECT(r.crash == FUZZ_NONE && r.score == 2 && r.coverage == 11 && !cov[0x819]);
+    keys[6] = 'A';
+    r       = fuzz->execute(fuzz->machine(0), keys, cov.data());
+    EXPECT(r.crash == FUZZ_KIL && r.pc == 0x819 && r.frame == 6 && r.score == 2);
+    keys[6] = 'B';
+    r       = fuzz->execute(fuzz->machine(0), keys, cov.data());
+    EXPECT(r.crash == FUZZ_STACK && r.pc == 0x81a && r.frame == 6);
+    keys[6] = 'C';
+    r       = fuzz->execute(fuzz->machine(0), keys, cov.data());
+    EXPECT(r.crash == FUZZ_IO && r.pc == 0xc000 && r.frame == 6);
+
+    // from the empty input, mutation has to find all three
+    fuzz->run(2000, 0, nullptr);
+    EXPECT(fuzz->crashes.size() == 3 && fuzz->best_score > 0 && fuzz->covered == 15);
+    for (auto &c : fuzz->crashes) {
+        EXPECT(Fuzzer::save_input("fuzz_test.keys", c.keys));
+        EXPECT(Fuzzer::load_input("fuzz_test.keys", keys) && keys == c.keys);
+        r = fuzz->execute(fuzz->machine(0), keys, cov.data());
+        EXPECT(r.crash == c.result.crash && r.pc == c.result.pc && r.frame == c.result.frame);
+    }
+    delete fuzz;
+    remove("fuzz_test.keys");
+    remove("fuzz_test.bin");
+    remove("fuzz_test.rom");
+    printf("fuzz: passed\n");
+    delete cpu;
+    return 0;
+}
+static int test_perf()
+{
+    Cpu *cpu = new Cpu();
+    cpu->init();
+    cpu->mem->set(0x400, 0x4c);    // JMP $0400
+    cpu->mem->set(0x401, 0x00);
+    cpu->mem->set(0x402, 0x04);
+    cpu->pc        = 0x400;
+    cpu->idle_skip = false;
+
+    PerfCounters *perf = new PerfCounters();
+    EXPECT(perf->ok() || !perf->error.empty());
+    perf->start();
+    for (int f = 0; f < 10; f++)
+        cpu->step();
+    perf->stop();
+    uint64_t first[PERF_EVENT_COUNT];
+    memcpy(first, perf->value, sizeof(first));
+    for (int e = 0; e < PERF_EVENT_COUNT; e++)
+        EXPECT(perf->has((PerfEvent)e) ? e >= PERF_BRANCH_MISSES || first[e] > 0 : first[e] == 0);
+    // the loop itself runs only while started
+    perf->start();
+    cpu->step();
+    perf->stop();
+    for (int e = 0; e < PERF_EVENT_COUNT; e++)
+        EXPECT(perf->value[e] >= first[e]);
+    perf->report(stdout, "perf:", cpu->steps, 11);
+    perf->clear();
+    EXPECT(perf->value[PERF_CYCLES] == 0 && perf->value[PERF_TASK_CLOCK] == 0);
+    delete perf;
+    printf("perf: passed\n");
+    delete cpu;
+    return 0;
+}
+int main(int argc, char **argv)
+{
+    string mode = argc > 1 ? argv[1] : "";
+    if (mode == "cycles")
+        return test_cycles();
+    if (mode == "decimal")
+        return test_decimal();
+    if (mode == "interrupts")
+        return test_interrupts();
+    if (mode == "hash")
+        return test_state_hash();
+    if (mode == "cmos")
+        return test_cmos();
+    if (mode == "slots")
+        return test_slots();
+    if (mode == "debug")
+        return test_debugger();
+    if (mode == "video")
+        return test_video();
+    if (mode == "beam")
+        return test_beam();
+    if (mode == "capture")
+        return test_capture();
+    if (mode == "shm")
+        return test_shm();
+    if (mode == "metrics")
+        return test_metrics();
+    if (mode == "perf")
+        return test_perf();
+    if (mode == "heatmap")
+        return test_heatmap();
+    if (mode == "mockingboard")
+        return test_mockingboard();
+    if (mode == "fuzz")
+        return test_fuzz();
+
+    if (mode == "run" && argc >= 5) {
+        uint16_t load       = strtoul(argv[3], nullptr, 16);
+        uint16_t start      = strtoul(argv[4], nullptr, 16);
+        int      success    = argc > 5 && strcmp(argv[5], "any") != 0 ? (int)strtoul(argv[5], nullptr, 16) : -1;
+        int      error_addr = argc > 6 ? (int)strtoul(argv[6], nullptr, 16) : -1;
+        return test_image(argv[2], load, start, success, error_addr);
+    }
+
+    printf("usage: conformance cycles\n");
+    printf("       conformance decimal\n");
+    printf("       conformance interrupts\n");
+    printf("       conformance hash\n");
+    printf("       conformance cmos\n");
+    printf("       conformance slots\n");
+    printf("       conformance debug\n");
+    printf("       conformance video\n");
+    printf("       conformance beam\n");
+    printf("       conformance capture\n");
+    printf("       conformance shm\n");
+    printf("       conformance metrics\n");
+    printf("       conformance perf\n");
+    printf("       conformance heatmap\n");
+    printf("       conformance mockingboard\n");
+    printf("       conformance fuzz\n");
+    printf("       conformance run <bin> <load> <start> [<success-pc>|any] [<error-addr>]\n");
+    return 1;
+}
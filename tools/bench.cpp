@@ -0,0 +1,204 @@
+#include "PC.h"
+#include "env.h"
+#include "lanes.h"
+#include "perfcount.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static void usage()
+{
+    printf("usage: bench [options] program.bin\n");
+    printf("  -f frames    frames to run per instance (default 300)\n");
+    printf("  -n count     number of instances (default %d)\n", LANES);
+    printf("  -b bios      bios rom (default rom/Apple2e.rom)\n");
+    printf("  -k frame     press a key in instance i at frame+i so the lanes diverge\n");
+    printf("  -e threads   measure the batch environment instead (0 = all hardware threads)\n");
+    printf("  -s frames    batch environment frame skip (default 4)\n");
+    printf("  -P           count host cycles, instructions, branch and cache misses with perf_event_open\n");
+}
+static std::vector<PC *> boot(size_t count, string bios, string prg)
+{
+    std::vector<PC *> pcs;
+    for (size_t i = 0; i < count; i++) {
+        PC *pc = new PC();
+        pc->cpu->init();
+        if (!pc->load_bios(bios) || !pc->load_prg(prg)) {
+            delete pc;
+            break;
+        }
+        pc->cpu->idle_skip = false;
+        pcs.push_back(pc);
+    }
+    return pcs;
+}
+static void press(std::vector<PC *> &pcs, size_t base, long key, size_t f)
+{
+    for (size_t i = 0; i < pcs.size(); i++) {
+        if (key >= 0 && f == (size_t)key + base + i)
+            pcs[i]->key_down(' ');
+    }
+}
+static int bench_env(string bios, string prg, size_t count, size_t frames, size_t threads, size_t skip)
+{
+    a2_env_config cfg{};
+    cfg.bios      = bios.c_str();
+    cfg.prg       = prg.c_str();
+    cfg.count     = count;
+    cfg.threads   = threads;
+    cfg.frameskip = skip;
+    cfg.ram_len   = 0x100;
+    cfg.scale     = 2;
+
+    a2_env *env = a2_env_create(&cfg);
+    if (env == nullptr)
+        return 1;
+    std::vector<uint8_t> actions(count);
+    std::vector<uint8_t> ram(a2_env_ram_size(env));
+    std::vector<uint8_t> obs(a2_env_frame_size(env));
+
+    size_t steps = (frames + skip - 1) / skip;
+    auto   start = std::chrono::steady_clock::now();
+    a2_env_reset(env, nullptr, ram.data(), obs.data());
+    for (size_t s = 0; s < steps; s++) {
+        for (size_t i = 0; i < count; i++)
+            actions[i] = (s + i) % 16 == 0 ? ' ' : 0;
+        a2_env_step(env, actions.data(), ram.data(), obs.data());
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("environments %zu  steps %zu  frame skip %zu\n", count, steps, skip);
+    printf("%.3fs  %.0f env steps/s  %.0f env frames/s\n", secs, count * steps / secs, count * steps * skip / secs);
+    a2_env_destroy(env);
+    return 0;
+}
+int main(int argc, char **argv)
+{
+    string bios   = "rom/Apple2e.rom";
+    string prg    = "";
+    size_t frames = 300;
+    size_t count  = LANES;
+    long   key    = -1;
+    long   env    = -1;
+    size_t skip   = 4;
+    bool   perf   = false;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-f" && i + 1 < argc) {
+            frames = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-n" && i + 1 < argc) {
+            count = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-b" && i + 1 < argc) {
+            bios = argv[++i];
+        } else if (arg == "-k" && i + 1 < argc) {
+            key = strtol(argv[++i], nullptr, 10);
+        } else if (arg == "-e" && i + 1 < argc) {
+            env = strtol(argv[++i], nullptr, 10);
+        } else if (arg == "-s" && i + 1 < argc) {
+            skip = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-P") {
+            perf = true;
+        } else if (arg[0] != '-' && prg.empty()) {
+            prg = arg;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (prg.empty() || count == 0) {
+        usage();
+        return 1;
+    }
+    if (env >= 0)
+        return bench_env(bios, prg, count, frames, env, skip > 0 ? skip : 1);
+
+    // N independent scalar interpreters, one frame each in turn
+    std::vector<PC *> scalar = boot(count, bios, prg);
+    if (scalar.size() != count)
+        return 1;
+    PerfCounters *scalar_perf = perf ? new PerfCounters() : nullptr;
+    PerfCounters *lane_perf   = perf ? new PerfCounters() : nullptr;
+    if (scalar_perf != nullptr)
+        scalar_perf->start();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t f = 0; f < frames; f++) {
+        press(scalar, 0, key, f);
+        for (auto pc : scalar) {
+            pc->cpu->start_frame();
+            while (0 < pc->cpu->frame_left)
+                pc->cpu->frame_left -= pc->cpu->run(false);
+        }
+    }
+    double scalar_secs  = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (scalar_perf != nullptr)
+        scalar_perf->stop();
+    size_t scalar_instr = 0;
+    for (auto pc : scalar)
+        scalar_instr += pc->cpu->steps;
+
+    // the same instances packed LANES at a time into lockstep groups
+    std::vector<PC *>      lanes = boot(count, bios, prg);
+    std::vector<LaneCpu *> groups;
+    if (lanes.size() != count)
+        return 1;
+    for (size_t i = 0; i < count; i++) {
+        if (i % LANES == 0)
+            groups.push_back(new LaneCpu());
+        if (!groups.back()->load(i % LANES, lanes[i]->cpu))
+            return 1;
+    }
+    if (lane_perf != nullptr)
+        lane_perf->start();
+    start = std::chrono::steady_clock::now();
+    for (size_t f = 0; f < frames; f++) {
+        press(lanes, 0, key, f);
+        for (auto g : groups)
+            g->step();
+    }
+    double lane_secs  = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (lane_perf != nullptr)
+        lane_perf->stop();
+    size_t lane_instr = 0;
+    size_t lockstep   = 0;
+    for (size_t i = 0; i < count; i++) {
+        groups[i / LANES]->store(i % LANES, lanes[i]->cpu);
+        lane_instr += lanes[i]->cpu->steps;
+    }
+    for (auto g : groups)
+        lockstep += g->lockstep_steps;
+
+    size_t mismatch = 0;
+    for (size_t i = 0; i < count; i++) {
+        Cpu *s = scalar[i]->cpu;
+        Cpu *l = lanes[i]->cpu;
+        if (memcmp(s->mem->ram, l->mem->ram, sizeof(s->mem->ram)) != 0 || s->pc != l->pc || s->a != l->a ||
+            s->x != l->x || s->y != l->y || s->sp != l->sp || s->totalcycle != l->totalcycle ||
+            s->mem->frame_start != l->mem->frame_start || s->mem->scan_line != l->mem->scan_line)
+            mismatch++;
+    }
+
+    printf("instances %zu  frames %zu  lanes %d\n", count, frames, LANES);
+    printf("scalar    %zu instructions  %.3fs  %.2f MIPS\n", scalar_instr, scalar_secs,
+           scalar_instr / scalar_secs / 1e6);
+    printf("lockstep  %zu instructions  %.3fs  %.2f MIPS  (%.1f%% in lockstep)\n", lane_instr, lane_secs,
+           lane_instr / lane_secs / 1e6, 100.0 * lockstep / lane_instr);
+    printf("speedup   %.2fx  mismatched instances %zu\n", scalar_secs / lane_secs, mismatch);
+    if (perf) {
+        scalar_perf->report(stdout, "scalar  ", scalar_instr, count * frames);
+        lane_perf->report(stdout, "lockstep", lane_instr, count * frames);
+        delete scalar_perf;
+        delete lane_perf;
+    }
+
+    for (auto g : groups)
+        delete g;
+    for (auto pc : scalar)
+        delete pc;
+    for (auto pc : lanes)
+        delete pc;
+    return mismatch == 0 ? 0 : 2;
+}
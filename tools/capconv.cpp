@@ -0,0 +1,12 @@
+#include "capture.h"
+#include <cstdio>
+#include <string>
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        printf("usage: capconv capture.a2v out.y4m\n");
+        return 1;
+    }
+    return Capture::to_y4m(argv[1], argv[2]) ? 0 : 1;
+}
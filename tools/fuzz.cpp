@@ -0,0 +1,119 @@
+#include "fuzz.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+static void usage()
+{
+    printf("usage: fuzz [options] program.bin\n");
+    printf("  -b bios       bios rom (default rom/Apple2e.rom)\n");
+    printf("  -j threads    worker threads (default one per hardware thread)\n");
+    printf("  -f frames     frames per input (default 600)\n");
+    printf("  -n inputs     stop after this many inputs (default 10000, 0 = no limit)\n");
+    printf("  -T seconds    stop after this many seconds\n");
+    printf("  -o dir        keep the corpus and crashes in dir, resuming from its corpus\n");
+    printf("  -a keys       keys to press, decimal ASCII codes separated by commas\n");
+    printf("                (default arrows, return, space, A, Z, I, J, K, L, M)\n");
+    printf("  -s addr[:len] also keep inputs that raise the peak of len RAM bytes at hex addr\n");
+    printf("  -S seed       random seed (default 1)\n");
+    printf("  -w dir        start from a cached post-boot snapshot in dir, creating it on first use\n");
+    printf("  -W frames     frames to boot before the start snapshot is taken (default 0)\n");
+    printf("  -k script     keys pressed while booting, as frame:ascii[,frame:ascii...]\n");
+    printf("  -x file       run one input file from the start snapshot and report how it ends\n");
+}
+static void print_result(const char *what, const FuzzResult &r)
+{
+    if (r.crash != FUZZ_NONE) {
+        printf("%s: %s at $%04X in frame %zu, %zu pcs", what, Fuzzer::crash_name(r.crash), r.pc, r.frame, r.coverage);
+    } else {
+        printf("%s: ran %zu frames, %zu pcs", what, r.frame, r.coverage);
+    }
+    printf("  score %llu\n", (unsigned long long)r.score);
+}
+int main(int argc, char **argv)
+{
+    FuzzConfig cfg;
+    size_t     limit   = 10000;
+    double     seconds = 0;
+    string     replay  = "";
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-b" && i + 1 < argc) {
+            cfg.bios = argv[++i];
+        } else if (arg == "-j" && i + 1 < argc) {
+            cfg.threads = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-f" && i + 1 < argc) {
+            cfg.frames = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-n" && i + 1 < argc) {
+            limit = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-T" && i + 1 < argc) {
+            seconds = strtod(argv[++i], nullptr);
+        } else if (arg == "-o" && i + 1 < argc) {
+            cfg.out_dir = argv[++i];
+        } else if (arg == "-a" && i + 1 < argc) {
+            cfg.keys = argv[++i];
+        } else if (arg == "-s" && i + 1 < argc) {
+            char *rest     = nullptr;
+            cfg.score_addr = strtoul(argv[++i], &rest, 16);
+            cfg.score_len  = *rest == ':' ? strtoull(rest + 1, nullptr, 10) : 1;
+        } else if (arg == "-S" && i + 1 < argc) {
+            cfg.seed = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-w" && i + 1 < argc) {
+            cfg.cache_dir = argv[++i];
+        } else if (arg == "-W" && i + 1 < argc) {
+            cfg.warmup = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-k" && i + 1 < argc) {
+            cfg.script = argv[++i];
+        } else if (arg == "-x" && i + 1 < argc) {
+            replay = argv[++i];
+        } else if (arg[0] != '-' && cfg.prg.empty()) {
+            cfg.prg = arg;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (cfg.prg.empty()) {
+        usage();
+        return 1;
+    }
+    if (limit == 0)
+        limit = SIZE_MAX;
+
+    Fuzzer *fuzz = new Fuzzer();
+    if (!replay.empty()) {
+        cfg.threads = 1;
+        cfg.out_dir = "";
+    }
+    if (!fuzz->init(cfg)) {
+        delete fuzz;
+        return 1;
+    }
+    if (!replay.empty()) {
+        vector<uint8_t> keys;
+        vector<uint8_t> cov(0x10000);
+        if (!Fuzzer::load_input(replay, keys)) {
+            delete fuzz;
+            return 1;
+        }
+        FuzzResult r = fuzz->execute(fuzz->machine(0), keys, cov.data());
+        print_result(replay.c_str(), r);
+        delete fuzz;
+        return r.crash != FUZZ_NONE ? 2 : 0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    fuzz->run(limit, seconds, stdout);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("inputs %zu  time %.3fs  %.1f/s  threads %zu  corpus %zu  pcs %zu  crashes %zu\n", fuzz->execs.load(), secs,
+           fuzz->execs / secs, fuzz->cfg.threads, fuzz->corpus.size(), fuzz->covered, fuzz->crashes.size());
+    if (cfg.score_addr >= 0)
+        printf("best score %llu\n", (unsigned long long)fuzz->best_score);
+    for (auto &c : fuzz->crashes)
+        print_result("crash", c.result);
+    delete fuzz;
+    return 0;
+}
@@ -0,0 +1,312 @@
+#include "PC.h"
+#include "capture.h"
+#include "debugger.h"
+#include "metrics.h"
+#include "mockingboard.h"
+#include "perfcount.h"
+#include "shm.h"
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <thread>
+#include <cstdlib>
+#include <string>
+
+static volatile sig_atomic_t dump_requested = 0;
+
+static void on_sigusr1(int)
+{
+    dump_requested = 1;
+}
+static void usage()
+{
+    printf("usage: headless [options] program.bin\n");
+    printf("  -f frames    frames to run (default 600)\n");
+    printf("  -b bios      bios rom (default rom/Apple2e.rom)\n");
+    printf("  -p period    profile pcs, sampling every period cycles (1 = every instruction)\n");
+    printf("  -o file      write the profile report to file\n");
+    printf("  -I           do not fast-forward idle loops\n");
+    printf("  -R           pace emulation to 60 frames per second\n");
+    printf("  -t file      write a binary instruction trace to file\n");
+    printf("  -r records   only keep the last records of the trace in memory\n");
+    printf("  -w dir       start from a cached post-boot snapshot in dir, creating it on first use\n");
+    printf("  -W frames    frames to boot before the snapshot is taken (default 0)\n");
+    printf("  -k script    keys pressed while booting, as frame:ascii[,frame:ascii...]\n");
+    printf("  -d           start the debugger console instead of running frames\n");
+    printf("  -m file      count memory accesses, print a per-page summary and write a PPM heatmap to file\n");
+    printf("  -s name      publish frames, RAM and registers in the POSIX shared-memory segment name\n");
+    printf("  -c file      capture the screen to file, Y4M if it ends in .y4m, otherwise delta-compressed A2V\n");
+    printf("  -P           count host cycles, instructions, branch and cache misses with perf_event_open\n");
+    printf("  -M file      write frame timing metrics to file at exit and on SIGUSR1, JSON if it ends in .json\n");
+    printf("  -A file      put a Mockingboard in slot 4 and write its output to the WAV file\n");
+}
+int main(int argc, char **argv)
+{
+    string  bios   = "rom/Apple2e.rom";
+    string  prg    = "";
+    string  report = "";
+    size_t  frames = 600;
+    int64_t period = 0;
+    string  trace  = "";
+    size_t  ring   = 0;
+    bool    idle   = true;
+    bool    pace   = false;
+    string  warm   = "";
+    size_t  boot   = 0;
+    string  script = "";
+    bool    debug  = false;
+    string  heat   = "";
+    string  video  = "";
+    string  shm    = "";
+    string  stats  = "";
+    bool    perf   = false;
+    string  audio  = "";
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-f" && i + 1 < argc) {
+            frames = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-b" && i + 1 < argc) {
+            bios = argv[++i];
+        } else if (arg == "-p" && i + 1 < argc) {
+            period = strtoll(argv[++i], nullptr, 10);
+        } else if (arg == "-o" && i + 1 < argc) {
+            report = argv[++i];
+        } else if (arg == "-I") {
+            idle = false;
+        } else if (arg == "-R") {
+            pace = true;
+        } else if (arg == "-t" && i + 1 < argc) {
+            trace = argv[++i];
+        } else if (arg == "-r" && i + 1 < argc) {
+            ring = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-w" && i + 1 < argc) {
+            warm = argv[++i];
+        } else if (arg == "-W" && i + 1 < argc) {
+            boot = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-k" && i + 1 < argc) {
+            script = argv[++i];
+        } else if (arg == "-d") {
+            debug = true;
+        } else if (arg == "-m" && i + 1 < argc) {
+            heat = argv[++i];
+        } else if (arg == "-s" && i + 1 < argc) {
+            shm = argv[++i];
+        } else if (arg == "-c" && i + 1 < argc) {
+            video = argv[++i];
+        } else if (arg == "-P") {
+            perf = true;
+        } else if (arg == "-M" && i + 1 < argc) {
+            stats = argv[++i];
+        } else if (arg == "-A" && i + 1 < argc) {
+            audio = argv[++i];
+        } else if (arg[0] != '-' && prg.empty()) {
+            prg = arg;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (prg.empty()) {
+        usage();
+        return 1;
+    }
+
+    auto boot0 = std::chrono::steady_clock::now();
+    PC  *pc    = new PC();
+    pc->cpu->init();
+    if (!pc->load_bios(bios) || !pc->load_prg(prg)) {
+        delete pc;
+        return 1;
+    }
+    if (!warm.empty()) {
+        bool hit = false;
+        if (!pc->warm_boot(warm, boot, script, &hit)) {
+            delete pc;
+            return 1;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - boot0).count();
+        printf("warm boot: %s after %zu frames in %.2fms\n", hit ? "restored" : "created", boot, ms);
+    }
+
+    if (period > 0) {
+#ifdef CPU_PROFILER
+        pc->cpu->prof = new Profiler(period);
+#else
+        printf("headless: profiler not compiled in, rebuild with -DCPU_PROFILER=ON\n");
+#endif
+    }
+
+    if (!trace.empty()) {
+#ifdef CPU_TRACE
+        pc->cpu->tracer = ring > 0 ? new Tracer(ring) : new Tracer(trace);
+#else
+        printf("headless: tracing not compiled in, rebuild with -DCPU_TRACE=ON\n");
+#endif
+    }
+
+    if (!heat.empty()) {
+#ifdef MEM_HEATMAP
+        pc->cpu->mem->heat = new Heatmap();
+#else
+        printf("headless: heatmap not compiled in, rebuild with -DMEM_HEATMAP=ON\n");
+#endif
+    }
+
+    Capture *cap = nullptr;
+    if (!video.empty()) {
+        bool y4m = video.size() > 4 && video.compare(video.size() - 4, 4, ".y4m") == 0;
+        cap      = new Capture(video, y4m ? CAPTURE_Y4M : CAPTURE_A2V);
+        if (!cap->ok()) {
+            delete cap;
+            delete pc;
+            return 1;
+        }
+    }
+
+    ShmExport *out = nullptr;
+    if (!shm.empty()) {
+        out = new ShmExport(shm);
+        if (!out->ok()) {
+            delete out;
+            delete cap;
+            delete pc;
+            return 1;
+        }
+    }
+
+    Metrics *metrics = nullptr;
+    if (!stats.empty()) {
+        metrics          = new Metrics();
+        pc->cpu->metrics = metrics;
+        signal(SIGUSR1, on_sigusr1);
+    }
+
+    Mockingboard *mb  = nullptr;
+    WavWriter    *wav = nullptr;
+    if (!audio.empty()) {
+        mb  = new Mockingboard(pc->cpu);
+        wav = new WavWriter(audio, mb->rate, 2);
+        if (!mb->ok() || !wav->ok()) {
+            delete wav;
+            delete mb;
+            delete metrics;
+            delete out;
+            delete cap;
+            delete pc;
+            return 1;
+        }
+    }
+    int16_t pcm[2 * 1024];
+
+    pc->cpu->idle_skip = idle;
+    pc->start();
+    if (debug) {
+        Debugger *dbg = new Debugger(pc->cpu);
+        dbg->repl(stdin, stdout);
+        delete dbg;
+        delete wav;
+        delete mb;
+        delete metrics;
+        delete out;
+        delete cap;
+        delete pc;
+        return 0;
+    }
+    PerfCounters *counters = perf ? new PerfCounters() : nullptr;
+    size_t        steps0   = pc->cpu->steps;
+    size_t        cycles0  = pc->cpu->totalcycle;
+    size_t        idle0    = pc->cpu->idle_cycles;
+    auto          start    = std::chrono::steady_clock::now();
+    auto          cpu0     = clock();
+    for (size_t f = 0; f < frames; f++) {
+        if (counters != nullptr) {
+            counters->start();
+            pc->tick();
+            counters->stop();
+        } else {
+            pc->tick();
+        }
+        if (cap != nullptr)
+            cap->frame(pc->cpu->mem);
+        if (out != nullptr)
+            out->publish(pc->cpu);
+        for (size_t n; mb != nullptr && (n = mb->render(pcm, 1024)) > 0;)
+            wav->write(pcm, n);
+        if (pace) {
+            auto     deadline = start + std::chrono::microseconds(16667 * (f + 1));
+            uint64_t t0       = Metrics::now();
+            if (metrics != nullptr && std::chrono::steady_clock::now() > deadline)
+                metrics->add(M_FRAMES_DROPPED, 1);
+            std::this_thread::sleep_until(deadline);
+            if (metrics != nullptr)
+                metrics->observe(M_SLEEP, Metrics::now() - t0);
+        }
+        if (dump_requested) {
+            dump_requested = 0;
+            metrics->dump(stats.c_str());
+        }
+    }
+    auto   end  = std::chrono::steady_clock::now();
+    double secs = std::chrono::duration<double>(end - start).count();
+    double busy = (double)(clock() - cpu0) / CLOCKS_PER_SEC;
+
+    size_t steps = pc->cpu->steps - steps0;
+    printf("frames %zu  instructions %zu  time %.3fs  %.2f MIPS  %.1f fps\n", frames, steps, secs, steps / secs / 1e6,
+           frames / secs);
+    printf("host cpu %.3fs (%.1f%%)  idle cycles %.1f%%\n", busy, 100.0 * busy / secs,
+           100.0 * (pc->cpu->idle_cycles - idle0) / (pc->cpu->totalcycle - cycles0));
+    if (counters != nullptr) {
+        counters->report(stdout, "perf", steps, frames);
+        delete counters;
+    }
+
+    if (metrics != nullptr) {
+        metrics->dump(stats.c_str());
+        pc->cpu->metrics = nullptr;
+        delete metrics;
+    }
+    delete out;
+    if (mb != nullptr) {
+        wav->close();
+        printf("audio: %zu frames, %zu irqs\n", wav->frames, mb->irqs);
+        delete wav;
+        delete mb;
+    }
+    if (cap != nullptr) {
+        cap->close();
+        printf("capture: %zu frames, %zu stored, %zu bytes, %zu stalls, %zu blanked\n", cap->frames, cap->stored,
+               cap->bytes, cap->stalls, cap->blanked);
+        delete cap;
+    }
+    if (pc->cpu->prof != nullptr) {
+        FILE *out = report.empty() ? stdout : fopen(report.c_str(), "w");
+        if (out == nullptr) {
+            printf("headless: cannot write %s\n", report.c_str());
+        } else {
+            pc->cpu->prof->report(pc->cpu, out);
+            if (out != stdout)
+                fclose(out);
+        }
+        delete pc->cpu->prof;
+        pc->cpu->prof = nullptr;
+    }
+    if (pc->cpu->mem->heat != nullptr) {
+        pc->cpu->mem->heat->report(stdout);
+        pc->cpu->mem->heat->save_ppm(heat);
+        delete pc->cpu->mem->heat;
+        pc->cpu->mem->heat = nullptr;
+    }
+    if (pc->cpu->tracer != nullptr) {
+        if (ring > 0) {
+            pc->cpu->tracer->save(trace);
+        } else {
+            pc->cpu->tracer->close();
+        }
+        printf("trace: %zu records\n", pc->cpu->tracer->size());
+        delete pc->cpu->tracer;
+        pc->cpu->tracer = nullptr;
+    }
+    delete pc;
+    return 0;
+}
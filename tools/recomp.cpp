@@ -0,0 +1,630 @@
+#include "PC.h"
+#include "cpu_enum.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Longest run of instructions put into one region function.
+static const size_t REGION_MAX = 192;
+
+struct Region
+{
+    uint16_t              start;
+    size_t                len;
+    std::vector<uint16_t> pcs;
+};
+
+static Cpu    *cpu = nullptr;
+static uint8_t ram[0x10000 + 2];
+static bool    insn[0x10000];
+static bool    entry[0x10000];
+
+static void usage()
+{
+    printf("usage: recomp [options] program.bin\n");
+    printf("  -b bios      bios rom (default rom/Apple2e.rom)\n");
+    printf("  -o file      output file (default stdout)\n");
+    printf("  -n name      name of the RecompModule symbol (default recomp_module)\n");
+    printf("  -e addr      extra entry point in hex, may be repeated\n");
+    printf("  -t frames    also add every pc the interpreter runs in this many frames (default 1200)\n");
+}
+static bool ends_flow(size_t kind)
+{
+    return kind == JMP || kind == RTS || kind == RTI || kind == BRK;
+}
+static bool native(size_t kind)
+{
+    switch (kind) {
+        case ORA:
+        case AND:
+        case EOR:
+        case ADC:
+        case SBC:
+        case CMP:
+        case CPX:
+        case CPY:
+        case DEC:
+        case DEX:
+        case DEY:
+        case INC:
+        case INX:
+        case INY:
+        case ASLA:
+        case ASL:
+        case ROLA:
+        case ROL:
+        case LSRA:
+        case LSR:
+        case RORA:
+        case ROR:
+        case LDA:
+        case STA:
+        case LDX:
+        case STX:
+        case LDY:
+        case STY:
+        case TAX:
+        case TXA:
+        case TAY:
+        case TYA:
+        case TSX:
+        case TXS:
+        case PLA:
+        case PHA:
+        case PLP:
+        case PHP:
+        case BPL:
+        case BMI:
+        case BVC:
+        case BVS:
+        case BCC:
+        case BCS:
+        case BNE:
+        case BEQ:
+        case JSR:
+        case RTS:
+        case JMP:
+        case BIT:
+        case CLC:
+        case SEC:
+        case CLD:
+        case SED:
+        case CLI:
+        case SEI:
+        case CLV:
+        case NOP:
+        case LAX:
+        case SAX:
+            return true;
+    }
+    return false;
+}
+// Recursive descent from the entry points, following branches, JSR and JMP
+// targets. Code in the I/O and slot pages and KIL/undefined opcodes are left
+// alone.
+static void explore(std::vector<uint16_t> work)
+{
+    while (!work.empty()) {
+        uint16_t pc = work.back();
+        work.pop_back();
+        for (;;) {
+            if (insn[pc] || (pc & 0xf000) == 0xc000)
+                break;
+            auto &o   = cpu->opcode_info(ram[pc]);
+            int   len = cpu->oplen(ram[pc]);
+            if (pc + len > 0x10000 || o.opcode == UNI || o.opcode == KIL)
+                break;
+            insn[pc]      = true;
+            uint16_t next = pc + len;
+            uint16_t abs  = ram[pc + 1] | (ram[pc + 2] << 8);
+            if (o.adm == REL)
+                work.push_back((uint16_t)(next + (int8_t)ram[pc + 1]));
+            if (o.opcode == JSR || (o.opcode == JMP && o.adm == ABS))
+                work.push_back(abs);
+            if (ends_flow(o.opcode))
+                break;
+            pc = next;
+        }
+    }
+}
+static std::vector<Region> partition()
+{
+    std::vector<Region> regions;
+    bool                open = false;
+    uint16_t            next = 0;
+    for (size_t pc = 0; pc < 0x10000; pc++) {
+        if (!insn[pc])
+            continue;
+        auto &o   = cpu->opcode_info(ram[pc]);
+        int   len = cpu->oplen(ram[pc]);
+        if (!open || pc != next || regions.back().pcs.size() >= REGION_MAX) {
+            regions.push_back(Region{(uint16_t)pc, 0, {}});
+            open = true;
+        }
+        Region &r = regions.back();
+        r.pcs.push_back(pc);
+        r.len = pc + len - r.start;
+        next  = pc + len;
+        if (ends_flow(o.opcode))
+            open = false;
+    }
+    return regions;
+}
+
+// Per-instruction code generation. `out` collects the body of one
+// instruction, `smc` the conditions under which one of its stores hit the
+// region being compiled.
+struct Emit
+{
+    FILE         *out;
+    const Region *region;
+    uint16_t      pc;
+    uint16_t      next;
+    std::string   smc;
+
+    bool own(uint16_t addr)
+    {
+        return (uint16_t)(addr - region->start) < region->len;
+    }
+    bool has(uint16_t addr)
+    {
+        for (auto p : region->pcs) {
+            if (p == addr)
+                return true;
+        }
+        return false;
+    }
+    void line(const char *fmt, ...) __attribute__((format(printf, 2, 3)))
+    {
+        va_list ap;
+        va_start(ap, fmt);
+        fprintf(out, "        ");
+        vfprintf(out, fmt, ap);
+        fprintf(out, "\n");
+        va_end(ap);
+    }
+    void store(const std::string &ea, bool fixed, uint16_t addr, const std::string &value)
+    {
+        line("m->set(%s, %s);", ea.c_str(), value.c_str());
+        if (fixed) {
+            if (own(addr))
+                smc = "true";
+        } else if (smc != "true") {
+            char cond[64];
+            snprintf(cond, sizeof(cond), "(uint16_t)(%s - 0x%04X) < %zu", ea.c_str(), region->start, region->len);
+            smc = smc.empty() ? cond : smc + " || " + cond;
+        }
+    }
+    void step(const char *target, const std::string &cycles)
+    {
+        line("RECOMP_STEP(%s, %s);", target, cycles.c_str());
+        if (!smc.empty()) {
+            line("if (%s) {", smc.c_str());
+            line("    c->pc = %s;", target);
+            line("    return true;");
+            line("}");
+        }
+    }
+    void jump(uint16_t target, const std::string &cycles)
+    {
+        char t[8];
+        snprintf(t, sizeof(t), "0x%04X", target);
+        step(t, cycles);
+        if (has(target)) {
+            line("goto L_%04X;", target);
+        } else {
+            line("c->pc = 0x%04X;", target);
+            line("return true;");
+        }
+    }
+    void interpret()
+    {
+        line("c->pc = 0x%04X;", pc);
+        line("c->frame_left -= c->run(false);");
+        line("return true;");
+    }
+};
+
+static void emit_insn(Emit &e)
+{
+    uint16_t    pc   = e.pc;
+    uint8_t     op   = ram[pc];
+    auto       &o    = cpu->opcode_info(op);
+    size_t      kind = o.opcode;
+    uint8_t     b1   = ram[pc + 1];
+    uint16_t    abs  = b1 | (ram[pc + 2] << 8);
+    uint16_t    next = e.next;
+    std::string cyc  = std::to_string(o.cycle);
+    char        buf[128];
+
+    if (!native(kind) || o.adm == IZP || o.adm == IAX) {
+        e.interpret();
+        return;
+    }
+    if (kind == ADC || kind == SBC) {
+        e.line("if (c->decimal) {");
+        e.line("    c->pc = 0x%04X;", pc);
+        e.line("    c->frame_left -= c->run(false);");
+        e.line("    return true;");
+        e.line("}");
+    }
+
+    // effective address and operand; NOPs with an indexed mode only need the
+    // page-cross penalty
+    std::string ea;
+    std::string val;
+    bool        fixed   = false;
+    uint16_t    addr    = 0;
+    bool        operand = kind != NOP;
+    switch (o.adm) {
+        case IMM:
+            snprintf(buf, sizeof(buf), "0x%02X", b1);
+            val = buf;
+            break;
+        case ZP:
+        case ABS:
+            fixed = true;
+            addr  = o.adm == ZP ? b1 : abs;
+            snprintf(buf, sizeof(buf), "0x%04X", addr);
+            ea = buf;
+            snprintf(buf, sizeof(buf), (addr & 0xf000) == 0xc000 ? "m->get(0x%04X)" : "m->ram[0x%04X]", addr);
+            val = buf;
+            break;
+        case ZPX:
+        case ZPY:
+            if (operand)
+                e.line("uint16_t ea = (0x%02X + c->%s) & 0xff;", b1, o.adm == ZPX ? "x" : "y");
+            ea  = "ea";
+            val = "m->ram[ea]";
+            break;
+        case IZX:
+            if (operand) {
+                e.line("uint8_t  zp = 0x%02X + c->x;", b1);
+                e.line("uint16_t ea = m->ram[zp] | (m->ram[(uint8_t)(zp + 1)] << 8);");
+            }
+            ea  = "ea";
+            val = "recomp_read(m, ea)";
+            break;
+        case IZY:
+        case IZYr:
+            e.line("uint32_t base = m->ram[0x%02X] | (m->ram[0x%02X] << 8);", b1, (uint8_t)(b1 + 1));
+            if (operand)
+                e.line("uint16_t ea   = base + c->y;");
+            if (o.adm == IZYr) {
+                e.line("int      pen  = (base >> 8) != ((base + c->y) >> 8);");
+                cyc += " + pen";
+            }
+            ea  = "ea";
+            val = "recomp_read(m, ea)";
+            break;
+        case ABX:
+        case ABXr:
+        case ABY:
+        case ABYr: {
+            const char *r = o.adm == ABX || o.adm == ABXr ? "x" : "y";
+            if (operand)
+                e.line("uint16_t ea = 0x%04X + c->%s;", abs, r);
+            if (o.adm == ABXr || o.adm == ABYr) {
+                e.line("int      pen = ((0x%04X + c->%s) >> 8) != 0x%02X;", abs, r, abs >> 8);
+                cyc += " + pen";
+            }
+            ea  = "ea";
+            val = "recomp_read(m, ea)";
+        } break;
+    }
+
+    const char *reg = kind == CPX || kind == LDX || kind == STX   ? "x"
+                      : kind == CPY || kind == LDY || kind == STY ? "y"
+                                                                  : "a";
+    switch (kind) {
+        case ORA:
+        case AND:
+        case EOR:
+            e.line("c->a %s= %s;", kind == ORA ? "|" : kind == AND ? "&" : "^", val.c_str());
+            e.line("recomp_nz(c, c->a);");
+            break;
+        case ADC:
+        case SBC:
+            e.line("uint16_t v = %s%s;", val.c_str(), kind == SBC ? " ^ 0xff" : "");
+            e.line("uint16_t r = c->a + v + c->carry;");
+            e.line("c->carry    = r > 0xff;");
+            e.line("c->overflow = (c->a & 0x80) == (v & 0x80) && (v & 0x80) != (r & 0x80);");
+            e.line("c->a        = r;");
+            e.line("recomp_nz(c, c->a);");
+            break;
+        case CMP:
+        case CPX:
+        case CPY:
+            e.line("uint16_t r = c->%s + (%s ^ 0xff) + 1;", reg, val.c_str());
+            e.line("c->carry   = r > 0xff;");
+            e.line("recomp_nz(c, r);");
+            break;
+        case DEC:
+        case INC:
+            e.line("uint8_t r = %s %s 1;", val.c_str(), kind == INC ? "+" : "-");
+            e.line("recomp_nz(c, r);");
+            e.store(ea, fixed, addr, "r");
+            break;
+        case DEX:
+        case DEY:
+        case INX:
+        case INY: {
+            const char *r = kind == DEX || kind == INX ? "x" : "y";
+            e.line("c->%s%s;", r, kind == INX || kind == INY ? "++" : "--");
+            e.line("recomp_nz(c, c->%s);", r);
+        } break;
+        case ASLA:
+        case ROLA:
+            e.line("uint16_t r = (c->a << 1)%s;", kind == ROLA ? " | c->carry" : "");
+            e.line("c->carry   = r > 0xff;");
+            e.line("c->a       = r;");
+            e.line("recomp_nz(c, c->a);");
+            break;
+        case ASL:
+        case ROL:
+            e.line("uint16_t r = (%s << 1)%s;", val.c_str(), kind == ROL ? " | c->carry" : "");
+            e.line("c->carry   = r > 0xff;");
+            e.line("recomp_nz(c, r);");
+            e.store(ea, fixed, addr, "r");
+            break;
+        case LSRA:
+        case RORA:
+            e.line("uint8_t r = (c->a >> 1)%s;", kind == RORA ? " | (c->carry << 7)" : "");
+            e.line("c->carry  = c->a & 1;");
+            e.line("c->a      = r;");
+            e.line("recomp_nz(c, c->a);");
+            break;
+        case LSR:
+        case ROR:
+            e.line("uint8_t v = %s;", val.c_str());
+            e.line("uint8_t r = (v >> 1)%s;", kind == ROR ? " | (c->carry << 7)" : "");
+            e.line("c->carry  = v & 1;");
+            e.line("recomp_nz(c, r);");
+            e.store(ea, fixed, addr, "r");
+            break;
+        case LDA:
+        case LDX:
+        case LDY:
+            e.line("c->%s = %s;", reg, val.c_str());
+            e.line("recomp_nz(c, c->%s);", reg);
+            break;
+        case LAX:
+            e.line("c->a = %s;", val.c_str());
+            e.line("c->x = c->a;");
+            e.line("recomp_nz(c, c->x);");
+            break;
+        case STA:
+        case STX:
+        case STY:
+            e.store(ea, fixed, addr, std::string("c->") + reg);
+            break;
+        case SAX:
+            e.store(ea, fixed, addr, "c->a & c->x");
+            break;
+        case TAX:
+        case TAY:
+        case TXA:
+        case TYA:
+        case TSX: {
+            const char *dst = kind == TAX || kind == TSX ? "x" : kind == TAY ? "y" : "a";
+            const char *src = kind == TXA ? "x" : kind == TYA ? "y" : kind == TSX ? "sp" : "a";
+            e.line("c->%s = c->%s;", dst, src);
+            e.line("recomp_nz(c, c->%s);", dst);
+        } break;
+        case TXS:
+            e.line("c->sp = c->x;");
+            break;
+        case PLA:
+            e.line("c->sp++;");
+            e.line("c->a = m->ram[0x100 + c->sp];");
+            e.line("recomp_nz(c, c->a);");
+            break;
+        case PLP:
+            e.line("c->sp++;");
+            e.line("recomp_setp(c, m->ram[0x100 + c->sp]);");
+            break;
+        case PHA:
+        case PHP:
+            e.line("uint16_t ea = 0x100 + c->sp--;");
+            e.store("ea", false, 0, kind == PHA ? "c->a" : "recomp_p(c) | 0x10");
+            break;
+        case BIT:
+            e.line("uint8_t v = %s;", val.c_str());
+            e.line("c->negative = v & 0x80;");
+            e.line("c->overflow = v & 0x40;");
+            e.line("c->zero     = (c->a & v) == 0;");
+            break;
+        case CLC:
+        case SEC:
+            e.line("c->carry = %s;", kind == SEC ? "true" : "false");
+            break;
+        case CLD:
+        case SED:
+            e.line("c->decimal = %s;", kind == SED ? "true" : "false");
+            break;
+        case CLI:
+        case SEI:
+            e.line("c->interrupt = %s;", kind == SEI ? "true" : "false");
+            break;
+        case CLV:
+            e.line("c->overflow = false;");
+            break;
+        case NOP:
+            break;
+        case BPL:
+        case BMI:
+        case BVC:
+        case BVS:
+        case BCC:
+        case BCS:
+        case BNE:
+        case BEQ: {
+            static const char *cond[] = {"!c->negative", "c->negative", "!c->overflow", "c->overflow",
+                                         "!c->carry",    "c->carry",    "!c->zero",     "c->zero"};
+            uint16_t target = next + (int8_t)b1;
+            int      taken  = o.cycle + 1 + ((next >> 8) != (target >> 8));
+            fprintf(e.out, "        if (%s) {\n", cond[kind - BPL]);
+            Emit inner  = e;
+            inner.smc   = "";
+            inner.jump(target, std::to_string(taken));
+            fprintf(e.out, "        }\n");
+        } break;
+        case JSR:
+            e.line("uint16_t ea = 0x100 + c->sp--;");
+            e.store("ea", false, 0, std::to_string((uint16_t)(pc + 2) >> 8));
+            e.line("ea = 0x100 + c->sp--;");
+            e.store("ea", false, 0, std::to_string((uint16_t)(pc + 2) & 0xff));
+            e.jump(abs, cyc);
+            return;
+        case RTS:
+            e.line("c->sp++;");
+            e.line("uint16_t lo = m->ram[0x100 + c->sp];");
+            e.line("c->sp++;");
+            e.line("uint16_t t  = (lo | (m->ram[0x100 + c->sp] << 8)) + 1;");
+            e.step("t", cyc);
+            e.line("c->pc = t;");
+            e.line("return true;");
+            return;
+        case JMP:
+            if (o.adm == ABS) {
+                e.jump(abs, cyc);
+                return;
+            }
+            e.line("uint16_t t = recomp_read(m, 0x%04X);", abs);
+            e.line("t |= recomp_read(m, 0x%04X) << 8;",
+                   cpu->variant == CPU_CMOS ? (uint16_t)(abs + 1) : (abs & 0xff00) | ((abs + 1) & 0xff));
+            e.step("t", cyc);
+            e.line("c->pc = t;");
+            e.line("return true;");
+            return;
+    }
+    snprintf(buf, sizeof(buf), "0x%04X", next);
+    e.step(buf, cyc);
+}
+static void emit_region(FILE *out, const Region &r)
+{
+    fprintf(out, "static const uint8_t code_%04X[] = {", r.start);
+    for (size_t i = 0; i < r.len; i++)
+        fprintf(out, "%s0x%02X", i == 0 ? "\n    " : i % 16 == 0 ? ",\n    " : ", ", ram[r.start + i]);
+    fprintf(out, "};\n");
+    fprintf(out, "static bool rc_%04X(Cpu *c, uint16_t pc)\n{\n", r.start);
+    fprintf(out, "    Mem *m = c->mem;\n");
+    fprintf(out, "    if (memcmp(m->ram + 0x%04X, code_%04X, %zu) != 0)\n        return false;\n", r.start, r.start,
+            r.len);
+    fprintf(out, "    switch (pc) {\n");
+    for (auto pc : r.pcs)
+        fprintf(out, "        case 0x%04X:\n            goto L_%04X;\n", pc, pc);
+    fprintf(out, "        default:\n            return false;\n    }\n");
+
+    char text[32];
+    for (size_t i = 0; i < r.pcs.size(); i++) {
+        uint16_t pc = r.pcs[i];
+        cpu->disasm(pc, ram + pc, text, sizeof(text));
+        fprintf(out, "L_%04X: // %s\n    {\n", pc, text);
+        Emit e{out, &r, pc, (uint16_t)(pc + cpu->oplen(ram[pc])), ""};
+        emit_insn(e);
+        fprintf(out, "    }\n");
+    }
+    auto &last = cpu->opcode_info(ram[r.pcs.back()]);
+    if (!ends_flow(last.opcode))
+        fprintf(out, "    c->pc = 0x%04X;\n    return true;\n", (uint16_t)(r.start + r.len));
+    else
+        fprintf(out, "    return true;\n");
+    fprintf(out, "}\n");
+}
+int main(int argc, char **argv)
+{
+    string                bios   = "rom/Apple2e.rom";
+    string                prg    = "";
+    string                output = "";
+    string                name   = "recomp_module";
+    size_t                frames = 1200;
+    std::vector<uint16_t> entries;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-b" && i + 1 < argc) {
+            bios = argv[++i];
+        } else if (arg == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg == "-n" && i + 1 < argc) {
+            name = argv[++i];
+        } else if (arg == "-e" && i + 1 < argc) {
+            entries.push_back(strtoul(argv[++i], nullptr, 16));
+        } else if (arg == "-t" && i + 1 < argc) {
+            frames = strtoull(argv[++i], nullptr, 10);
+        } else if (arg[0] != '-' && prg.empty()) {
+            prg = arg;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (prg.empty()) {
+        usage();
+        return 1;
+    }
+
+    PC *pc = new PC();
+    pc->cpu->init();
+    if (!pc->load_bios(bios) || !pc->load_prg(prg)) {
+        delete pc;
+        return 1;
+    }
+    cpu = pc->cpu;
+    entries.push_back(cpu->mem->prg_offset);
+    entries.push_back(cpu->mem->ram[0xfffc] | (cpu->mem->ram[0xfffd] << 8));
+
+    // A short interpreted run finds code that is only reachable through
+    // indirect jumps or is unpacked at run time. Code is compiled from the
+    // memory image at its end; whatever changes later is caught by the
+    // regions' own checks.
+    cpu->idle_skip = false;
+    for (size_t f = 0; f < frames; f++) {
+        if (f % 120 == 60)
+            pc->key_down(f % 240 == 60 ? ' ' : '\r');
+        cpu->frame_left = 12600;
+        while (0 < cpu->frame_left) {
+            entry[cpu->pc] = true;
+            cpu->frame_left -= cpu->run(false);
+        }
+    }
+    memcpy(ram, cpu->mem->ram, 0x10000);
+    for (size_t a = 0; a < 0x10000; a++) {
+        if (entry[a])
+            entries.push_back(a);
+    }
+    explore(entries);
+    std::vector<Region> regions = partition();
+
+    FILE *out = output.empty() ? stdout : fopen(output.c_str(), "w");
+    if (out == nullptr) {
+        printf("recomp: cannot write %s\n", output.c_str());
+        delete pc;
+        return 1;
+    }
+    size_t count = 0;
+    for (auto &r : regions)
+        count += r.pcs.size();
+    fprintf(out, "// Generated by tools/recomp from %s, do not edit.\n", prg.c_str());
+    fprintf(out, "// %zu instructions in %zu regions.\n", count, regions.size());
+    fprintf(out, "#include \"recomp.h\"\n#include <cstring>\n\n");
+    for (auto &r : regions)
+        emit_region(out, r);
+
+    fprintf(out, "\nstatic const RecompEntry entries[] = {\n");
+    for (auto &r : regions) {
+        for (auto a : r.pcs)
+            fprintf(out, "    {0x%04X, rc_%04X},\n", a, r.start);
+    }
+    fprintf(out, "};\n");
+    fprintf(out, "extern const RecompModule %s = {0x%016llxULL, 0x%016llxULL, entries, %zu};\n", name.c_str(),
+            (unsigned long long)cpu->mem->bios_rom->hash, (unsigned long long)cpu->mem->prg_rom->hash, count);
+    if (out != stdout)
+        fclose(out);
+    delete pc;
+    return 0;
+}
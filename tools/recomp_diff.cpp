@@ -0,0 +1,117 @@
+#include "PC.h"
+#include "recomp.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+extern const RecompModule recomp_module;
+
+static void usage()
+{
+    printf("usage: recomp_diff [options] bios.rom program.bin\n");
+    printf("  -f frames    frames to compare (default 600)\n");
+    printf("  -R frame     copy main RAM to aux and turn RAMRD on at frame, so reads see a stale copy\n");
+}
+static PC *boot(string bios, string prg)
+{
+    PC *pc = new PC();
+    pc->cpu->init();
+    if (!pc->load_bios(bios) || !pc->load_prg(prg)) {
+        delete pc;
+        return nullptr;
+    }
+    pc->cpu->idle_skip = false;
+    return pc;
+}
+static void press(PC *pc, size_t f)
+{
+    if (f % 90 == 45)
+        pc->key_down(f % 180 == 45 ? ' ' : '\r');
+}
+static bool same(Cpu *l, Cpu *r)
+{
+    return l->a == r->a && l->x == r->x && l->y == r->y && l->sp == r->sp && l->pc == r->pc &&
+           l->negative == r->negative && l->overflow == r->overflow && l->decimal == r->decimal &&
+           l->interrupt == r->interrupt && l->zero == r->zero && l->carry == r->carry && l->steps == r->steps &&
+           l->totalcycle == r->totalcycle && l->mem->key == r->mem->key && l->mem->page_2 == r->mem->page_2 &&
+           l->mem->writes == r->mem->writes && l->mem->switches == r->mem->switches &&
+           memcmp(l->mem->ram, r->mem->ram, sizeof(l->mem->ram)) == 0 && memcmp(l->mem->aux, r->mem->aux, 0xc000) == 0;
+}
+static void ramrd(PC *pc)
+{
+    pc->cpu->mem->set_aux(pc->cpu->mem->ram);
+    pc->cpu->mem->rehash();
+    pc->cpu->mem->set_switch(0xc003);
+}
+// Runs the interpreter and the recompiled module side by side with the same
+// input, comparing the whole machine after every frame, then times each.
+int main(int argc, char **argv)
+{
+    size_t frames = 600;
+    size_t aux_at = SIZE_MAX;
+    string files[2];
+    int    nfiles = 0;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-f" && i + 1 < argc) {
+            frames = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-R" && i + 1 < argc) {
+            aux_at = strtoull(argv[++i], nullptr, 10);
+        } else if (arg[0] != '-' && nfiles < 2) {
+            files[nfiles++] = arg;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (nfiles != 2) {
+        usage();
+        return 1;
+    }
+
+    PC          *ref = boot(files[0], files[1]);
+    PC          *rec = boot(files[0], files[1]);
+    RecompRunner runner;
+    if (ref == nullptr || rec == nullptr || !runner.attach(rec->cpu, &recomp_module))
+        return 1;
+
+    for (size_t f = 0; f < frames; f++) {
+        press(ref, f);
+        press(rec, f);
+        if (f == aux_at) {
+            ramrd(ref);
+            ramrd(rec);
+        }
+        ref->cpu->run_frame();
+        runner.run_frame();
+        if (!same(ref->cpu, rec->cpu)) {
+            printf("recomp: state differs after frame %zu\n", f);
+            printf("  interpreter pc %04X a %02X x %02X y %02X sp %02X steps %zu\n", ref->cpu->pc, ref->cpu->a,
+                   ref->cpu->x, ref->cpu->y, ref->cpu->sp, ref->cpu->steps);
+            printf("  recompiled  pc %04X a %02X x %02X y %02X sp %02X steps %zu\n", rec->cpu->pc, rec->cpu->a,
+                   rec->cpu->x, rec->cpu->y, rec->cpu->sp, rec->cpu->steps);
+            return 1;
+        }
+    }
+    size_t steps = ref->cpu->steps;
+    printf("recomp: %zu frames identical, %zu instructions, %.1f%% interpreted\n", frames, steps,
+           100.0 * runner.interp_steps / steps);
+
+    auto   start = std::chrono::steady_clock::now();
+    for (size_t f = 0; f < frames; f++)
+        ref->cpu->run_frame();
+    double interp = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    start         = std::chrono::steady_clock::now();
+    for (size_t f = 0; f < frames; f++)
+        runner.run_frame();
+    double native = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("interpreter %.3fs  recompiled %.3fs  speedup %.2fx\n", interp, native, interp / native);
+
+    delete ref;
+    delete rec;
+    return 0;
+}
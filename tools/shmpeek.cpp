@@ -0,0 +1,77 @@
+#include "shm.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+static void usage()
+{
+    printf("usage: shmpeek [options] name\n");
+    printf("  -n count     samples to print (default 1)\n");
+    printf("  -i ms        interval between samples (default 1000)\n");
+    printf("  -m addr len  also dump len bytes of RAM from hex addr\n");
+}
+int main(int argc, char **argv)
+{
+    string name     = "";
+    size_t count    = 1;
+    size_t interval = 1000;
+    size_t addr     = 0;
+    size_t len      = 0;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) {
+            count = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-i" && i + 1 < argc) {
+            interval = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-m" && i + 2 < argc) {
+            addr = strtoull(argv[++i], nullptr, 16) & 0xffff;
+            len  = strtoull(argv[++i], nullptr, 10);
+        } else if (arg[0] != '-' && name.empty()) {
+            name = arg;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (name.empty()) {
+        usage();
+        return 1;
+    }
+    const ShmState *s = ShmExport::attach(name);
+    if (s == nullptr)
+        return 1;
+
+    uint8_t bytes[0x10000];
+    if (addr + len > 0x10000)
+        len = 0x10000 - addr;
+    for (size_t n = 0; n < count; n++) {
+        if (n > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+        uint64_t seq, frame, cycle;
+        uint16_t pc;
+        uint8_t  a, x, y, sp, p;
+        do {
+            seq   = ShmExport::read_begin(s);
+            frame = s->frame;
+            cycle = s->totalcycle;
+            pc    = s->pc;
+            a     = s->a;
+            x     = s->x;
+            y     = s->y;
+            sp    = s->sp;
+            p     = s->p;
+            for (size_t i = 0; i < len; i++)
+                bytes[i] = s->ram[addr + i];
+        } while (ShmExport::read_retry(s, seq));
+
+        printf("frame %zu  cycle %zu  PC:%04X A:%02X X:%02X Y:%02X SP:%02X P:%02X\n", (size_t)frame, (size_t)cycle,
+               pc, a, x, y, sp, p);
+        for (size_t i = 0; i < len; i++)
+            printf("%s%02X%s", i % 16 == 0 ? "  " : " ", bytes[i], i % 16 == 15 || i + 1 == len ? "\n" : "");
+    }
+    ShmExport::detach(s);
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "cpu.h"
+#include "trace.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+static void usage()
+{
+    printf("usage: tracedump [options] trace.bin\n");
+    printf("  -s count     skip the first count records\n");
+    printf("  -n count     print at most count records\n");
+}
+int main(int argc, char **argv)
+{
+    string path  = "";
+    size_t skip  = 0;
+    size_t limit = SIZE_MAX;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-s" && i + 1 < argc) {
+            skip = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-n" && i + 1 < argc) {
+            limit = strtoull(argv[++i], nullptr, 10);
+        } else if (arg[0] != '-' && path.empty()) {
+            path = arg;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (path.empty()) {
+        usage();
+        return 1;
+    }
+
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+        printf("tracedump: cannot open %s\n", path.c_str());
+        return 1;
+    }
+    if (!Tracer::read_header(f)) {
+        printf("tracedump: %s is not a trace file\n", path.c_str());
+        fclose(f);
+        return 1;
+    }
+
+    Cpu        *cpu = new Cpu();
+    TraceRecord buf[4096];
+    uint64_t    cycle = 0;
+    uint32_t    last  = 0;
+    size_t      index = 0;
+    size_t      shown = 0;
+    char        text[32];
+    char        hex[16];
+    size_t      n;
+
+    while (shown < limit && (n = fread(buf, sizeof(TraceRecord), 4096, f)) > 0) {
+        for (size_t i = 0; i < n && shown < limit; i++, index++) {
+            auto &r = buf[i];
+            if (r.cycle < last)
+                cycle += 1ULL << 32;
+            last = r.cycle;
+            if (index < skip)
+                continue;
+
+            uint8_t code[3] = {r.opcode, r.op1, r.op2};
+            int     len     = cpu->disasm(r.pc, code, text, sizeof(text));
+            if (len == 1) {
+                snprintf(hex, sizeof(hex), "%02X      ", r.opcode);
+            } else if (len == 2) {
+                snprintf(hex, sizeof(hex), "%02X %02X   ", r.opcode, r.op1);
+            } else {
+                snprintf(hex, sizeof(hex), "%02X %02X %02X", r.opcode, r.op1, r.op2);
+            }
+            printf("%12llu  %04X  %s  %-16s A:%02X X:%02X Y:%02X P:%02X SP:%02X\n",
+                   (unsigned long long)(cycle | r.cycle), r.pc, hex, text, r.a, r.x, r.y, r.p, r.sp);
+            shown++;
+        }
+    }
+    fclose(f);
+    delete cpu;
+    return 0;
+}